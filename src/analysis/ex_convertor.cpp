@@ -1,32 +1,56 @@
 #include "io/GLGPU3DDataset.h"
 #include "extractor/Extractor.h"
+#include <sstream>
+#include <cstdio>
+#include <cstdlib>
 
 int main(int argc, char **argv)
 {
+  if (argc < 3) {
+    fprintf(stderr, "Usage: %s <dataname> <ts> [<tl> [<nthreads>]]\n", argv[0]);
+    return EXIT_FAILURE;
+  }
+
+  const int ts = atoi(argv[2]), 
+            tl = argc > 3 ? atoi(argv[3]) : 1, 
+            nthreads = argc > 4 ? atoi(argv[4]) : 2;
+
   GLGPU3DDataset ds;
   ds.SetPrecomputeSupercurrent(true);
   
   ds.OpenDataFile(argv[1]);
-  ds.LoadTimeStep(atoi(argv[2]));
-  
-  // ds.SetMeshType(GLGPU3D_MESH_HEX);
-  ds.SetMeshType(GLGPU3D_MESH_TET);
-  ds.BuildMeshGraph();
-  
-  // if (tet) ds.SetMeshType(GLGPU3D_MESH_TET);
-  // else ds.SetMeshType(GLGPU3D_MESH_HEX);
-  // ds.BuildMeshGraph();
- 
-  const std::string out = std::string(argv[1]) + "." + argv[2];
-  ds.WriteRaw(out);
-  ds.PrintInfo();
+  if (tl > 1) // decode the following timesteps while converting
+    ds.SetPrefetch(2*nthreads, nthreads);
   
   VortexExtractor extractor;
   extractor.SetDataset(&ds);
-  
-  extractor.ExtractFaces(0);
-  extractor.TraceOverSpace(0);
-  extractor.SaveVortexLines(0);
+
+  for (int t=ts; t<ts+tl; t++) {
+    if (!ds.LoadTimeStep(t)) {
+      fprintf(stderr, "cannot load timestep %d\n", t);
+      return EXIT_FAILURE;
+    }
+
+    if (t == ts) {
+      // ds.SetMeshType(GLGPU3D_MESH_HEX);
+      ds.SetMeshType(GLGPU3D_MESH_TET);
+      ds.BuildMeshGraph();
+    }
+    
+    // if (tet) ds.SetMeshType(GLGPU3D_MESH_TET);
+    // else ds.SetMeshType(GLGPU3D_MESH_HEX);
+    // ds.BuildMeshGraph();
+   
+    std::stringstream ss;
+    ss << argv[1] << "." << t;
+    ds.WriteRaw(ss.str());
+    ds.PrintInfo();
+    
+    extractor.Clear();
+    extractor.ExtractFaces(0);
+    extractor.TraceOverSpace(0);
+    extractor.SaveVortexLines(0);
+  }
 
 #if 0
   VortexExtractor extractor;
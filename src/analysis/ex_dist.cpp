@@ -1,7 +1,7 @@
 #include "def.h"
 #include "common/VortexTransition.h"
 #include "common/VortexLine.h"
-#include "io/GLGPU_IO_Helper.h"
+#include "io/GLGPUSeriesIndex.h"
 #include <vector>
 #include <string>
 #include <iostream>
@@ -21,31 +21,24 @@ static bool LoadTimesteps(const std::string& dataname)
   filenames.clear();
   timesteps.clear();
 
-  GLHeader h;
   char fname[1024];
-
-  while (ifs.getline(fname, 1024)) {
+  while (ifs.getline(fname, 1024)) 
     filenames.push_back(fname);
+  ifs.close();
 
-    bool succ = false;
-    if (!succ) {
-      succ = GLGPU_IO_Helper_ReadBDAT(
-          fname, h, NULL, NULL, NULL, NULL, NULL, NULL, NULL, true);
-    } 
-    if (!succ) {
-      succ = GLGPU_IO_Helper_ReadLegacy(
-          fname, h, NULL, NULL, NULL, NULL, NULL, NULL, NULL, true);
-    }
-    if (!succ) {
-      fprintf(stderr, "cannot open file: %s\n", fname);
+  GLGPUSeriesIndex index;
+  index.Build(filenames, GLGPUSeriesIndex::DefaultIndexFilename(dataname));
+  for (size_t i=0; i<index.NumberOfEntries(); i++)
+    if (!index.GetEntry(i).valid) {
+      fprintf(stderr, "cannot open file: %s\n", index.GetEntry(i).filename.c_str());
       return false;
     }
 
-    timesteps.push_back(h.time);
-    // fprintf(stderr, "frame=%d, time=%f\n", filenames.size()-1, h.time);
+  for (size_t i=0; i<index.NumberOfEntries(); i++) {
+    timesteps.push_back(index.Header(i).time);
+    // fprintf(stderr, "frame=%d, time=%f\n", i, index.Header(i).time);
   }
 
-  ifs.close();
   return true;
 }
 
@@ -2,6 +2,8 @@
 #include <cstdio>
 #include <vector>
 #include <getopt.h>
+#include <chrono>
+#include <thread>
 #include "io/GLGPU3DDataset.h"
 #include "extractor/Extractor.h"
 
@@ -12,7 +14,17 @@ static int nogauge = 0,
            archive = 0,
            gpu = 0,
            nthreads = 0, 
-           tet = 0;
+           tet = 0, 
+           hybrid = 0, 
+           edgecentric = 0,
+           simd = 0, 
+           complexphase = 0,
+           prefetch = 0, 
+           prefetch_threads = 1, 
+           prefetch_mb = 0, 
+           prune = -1, 
+           brick = 0;
+static int roi[6] = {0}, has_roi = 0, halo = 1; // lo[3], hi[3] in node indices
 static int T0=0, T=1; // start and length of timesteps
 static int span=1;
 
@@ -23,12 +35,23 @@ static struct option longopts[] = {
   {"archive", no_argument, &archive, 1}, 
   {"gpu", no_argument, &gpu, 1}, 
   {"tet", no_argument, &tet, 1},
+  {"hybrid", no_argument, &hybrid, 1},
+  {"edgecentric", no_argument, &edgecentric, 1},
+  {"simd", no_argument, &simd, 1},
+  {"complex", no_argument, &complexphase, 1},
   {"input", required_argument, 0, 'i'},
   {"output", required_argument, 0, 'o'},
   {"time", required_argument, 0, 't'}, 
   {"length", required_argument, 0, 'l'},
   {"span", required_argument, 0, 's'},
   {"concurrent", required_argument, 0, 'c'},
+  {"prefetch", required_argument, 0, 'p'},
+  {"prefetch_threads", required_argument, 0, 'P'},
+  {"prefetch_mb", required_argument, 0, 'm'},
+  {"prune", required_argument, 0, 'k'},
+  {"brick", required_argument, 0, 'b'},
+  {"roi", required_argument, 0, 'r'},
+  {"halo", required_argument, 0, 'H'},
   {0, 0, 0, 0} 
 };
 
@@ -38,7 +61,7 @@ static bool parse_arg(int argc, char **argv)
 
   while (1) {
     int option_index = 0;
-    c = getopt_long(argc, argv, "i:t:l:s:c", longopts, &option_index); 
+    c = getopt_long(argc, argv, "i:t:l:s:c:p:P:m:k:b:r:H:", longopts, &option_index); 
     if (c == -1) break;
 
     switch (c) {
@@ -47,6 +70,19 @@ static bool parse_arg(int argc, char **argv)
     case 'l': T = atoi(optarg); break;
     case 's': span = atoi(optarg); break;
     case 'c': nthreads = atoi(optarg); break;
+    case 'p': prefetch = atoi(optarg); break;
+    case 'P': prefetch_threads = atoi(optarg); break;
+    case 'm': prefetch_mb = atoi(optarg); break;
+    case 'k': prune = atoi(optarg); break;
+    case 'b': brick = atoi(optarg); break;
+    case 'r': 
+      has_roi = sscanf(optarg, "%d,%d,%d,%d,%d,%d", &roi[0], &roi[1], &roi[2], &roi[3], &roi[4], &roi[5]) == 6;
+      if (!has_roi) {
+        fprintf(stderr, "FATAL: invalid region of interest: %s\n", optarg);
+        return false;
+      }
+      break;
+    case 'H': halo = atoi(optarg); break;
     default: break; 
     }
   }
@@ -77,12 +113,68 @@ static void print_help(int argc, char **argv)
   fprintf(stderr, "%s -i <input_filename> [-o output_filename] [--nogauge]\n", argv[0]);
   fprintf(stderr, "\n");
   fprintf(stderr, "\t--verbose   verbose output\n"); 
-  fprintf(stderr, "\t--benchmark Enable benchmark\n"); 
+  fprintf(stderr, "\t--benchmark Measure thread scaling from 1 to -c threads\n"); 
   fprintf(stderr, "\t--nogauge   Disable gauge transformation\n"); 
+  fprintf(stderr, "\t--hybrid    Tet mesh, tet faces are only checked where the hex mesh cannot rule them out\n"); 
+  fprintf(stderr, "\t--edgecentric Compute phase jumps per edge, faces sum them up\n"); 
+  fprintf(stderr, "\t--simd      Vectorized face screening (hex mesh)\n"); 
+  fprintf(stderr, "\t--complex   Phase jumps from re/im, rho/phi are not loaded\n"); 
+  fprintf(stderr, "\t--prefetch <n> Decode the next n timesteps in the background\n"); 
+  fprintf(stderr, "\t--prefetch_threads <n> Number of threads decoding timesteps\n"); 
+  fprintf(stderr, "\t--prefetch_mb <n> Limit the decoded timesteps in flight to n MB\n"); 
+  fprintf(stderr, "\t--prune <k> Only check space-time edges within k cells of punctured faces\n"); 
+  fprintf(stderr, "\t--brick <n> Skip n^3 bricks that provably have no punctured face\n");
+  fprintf(stderr, "\t--roi <x0,y0,z0,x1,y1,z1> Only load and extract the nodes [x0,x1)x[y0,y1)x[z0,z1)\n"); 
+  fprintf(stderr, "\t--halo <n> Nodes added around the region of interest, default 1\n");
   fprintf(stderr, "\n");
 }
 
 
+static double elapsed_since(std::chrono::high_resolution_clock::time_point t0)
+{
+  auto t1 = std::chrono::high_resolution_clock::now();
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(t1 - t0).count() / 1000000000.0;
+}
+
+// face and edge extraction of the first two timesteps with 1, 2, 4, .., N threads
+static void run_benchmark(GLGPU3DDataset& ds, VortexExtractor& extractor, int maxthreads)
+{
+  const int nrepeats = 3;
+  typedef std::chrono::high_resolution_clock clock;
+
+  ds.LoadTimeStep(T0+span, 1);
+
+  std::vector<int> nts;
+  for (int n=1; n<maxthreads; n*=2) 
+    nts.push_back(n);
+  nts.push_back(maxthreads);
+
+  std::vector<double> tf(nts.size()), te(nts.size());
+  for (int i=0; i<nts.size(); i++) {
+    extractor.SetNumberOfThreads(nts[i]);
+    for (int r=0; r<nrepeats; r++) { // best of nrepeats
+      extractor.Clear();
+      auto t0 = clock::now();
+      extractor.ExtractFaces(0);
+      extractor.ExtractFaces(1);
+      double t = elapsed_since(t0);
+      if (r == 0 || t < tf[i]) tf[i] = t;
+
+      t0 = clock::now();
+      extractor.ExtractEdges();
+      t = elapsed_since(t0);
+      if (r == 0 || t < te[i]) te[i] = t;
+    }
+  }
+
+  fprintf(stdout, "#threads\tt_faces\tt_edges\tspeedup\tefficiency\n");
+  for (int i=0; i<nts.size(); i++) {
+    const double speedup = (tf[0] + te[0]) / (tf[i] + te[i]);
+    fprintf(stdout, "%d\t%f\t%f\t%.2f\t%.2f\n", 
+        nts[i], tf[i], te[i], speedup, speedup / nts[i]);
+  }
+}
+
 int main(int argc, char **argv)
 {
   if (!parse_arg(argc, argv)) {
@@ -92,9 +184,15 @@ int main(int argc, char **argv)
 
   GLGPU3DDataset ds;
   ds.OpenDataFile(filename_in);
+  if (prefetch > 0)
+    ds.SetPrefetch(prefetch, prefetch_threads, (size_t)prefetch_mb << 20);
+  if (complexphase)
+    ds.SetLoadRhoPhi(false);
+  if (has_roi) 
+    ds.SetRegionOfInterest(roi, roi+3, halo);
   // ds.SetPrecomputeSupercurrent(true);
   ds.LoadTimeStep(T0, 0);
-  if (tet) ds.SetMeshType(GLGPU3D_MESH_TET);
+  if (tet || hybrid) ds.SetMeshType(GLGPU3D_MESH_TET);
   else ds.SetMeshType(GLGPU3D_MESH_HEX);
   ds.BuildMeshGraph();
   ds.PrintInfo();
@@ -111,6 +209,32 @@ int main(int argc, char **argv)
 
   if (gpu)
     extractor.SetGPU(true);
+
+  if (edgecentric)
+    extractor.SetEdgeCentric(true);
+
+  if (simd)
+    extractor.SetSIMD(true);
+
+  if (prune >= 0)
+    extractor.SetEdgePruning(prune);
+
+  if (complexphase)
+    extractor.SetComplexPhase(true);
+
+  if (brick > 0)
+    extractor.SetBrickScreening(brick);
+
+  if (hybrid)
+    extractor.SetHybrid(true);
+
+  if (benchmark) {
+    int maxthreads = nthreads;
+    if (maxthreads == 0) maxthreads = std::thread::hardware_concurrency();
+    if (maxthreads == 0) maxthreads = 1;
+    run_benchmark(ds, extractor, maxthreads);
+    return EXIT_SUCCESS;
+  }
  
   extractor.ExtractFaces(0);
   extractor.TraceOverSpace(0);
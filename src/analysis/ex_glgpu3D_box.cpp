@@ -1,21 +1,32 @@
 #include <iostream>
 #include <cstdio>
+#include <cstdlib>
 #include <vector>
-#include <getopt.h>
 #include "io/GLGPU3DDataset.h"
 #include "extractor/Extractor.h"
 
+// counts the positive and negative punctures of the boundary faces of a box
+// over time; only the box is loaded
 int main(int argc, char **argv)
 {
-  if (argc<5) return false;
+  if (argc < 10) {
+    fprintf(stderr, "Usage: %s <dataname> <ts> <tl> <x0> <y0> <z0> <x1> <y1> <z1>\n", argv[0]);
+    return EXIT_FAILURE;
+  }
 
   const std::string filename_in = argv[1];
   const int T0 = atoi(argv[2]);
   const int T1 = T0 + atoi(argv[3]);
+  const int lo[3] = {atoi(argv[4]), atoi(argv[5]), atoi(argv[6])}, 
+            hi[3] = {atoi(argv[7]), atoi(argv[8]), atoi(argv[9])};
 
   GLGPU3DDataset ds;
   ds.OpenDataFile(filename_in);
-  ds.LoadTimeStep(T0, 0);
+  ds.SetRegionOfInterest(lo, hi, 0);
+  if (!ds.LoadTimeStep(T0, 0)) {
+    fprintf(stderr, "cannot load timestep %d\n", T0);
+    return EXIT_FAILURE;
+  }
   ds.SetMeshType(GLGPU3D_MESH_HEX);
   ds.BuildMeshGraph();
   ds.PrintInfo();
@@ -15,6 +15,7 @@ static int nogauge = 0,
            tet = 1;
 static int T0=0, T=1; // start and length of timesteps
 static int span=1;
+static int nruns=256;
 
 static struct option longopts[] = {
   {"verbose", no_argument, &verbose, 1},  
@@ -29,6 +30,7 @@ static struct option longopts[] = {
   {"length", required_argument, 0, 'l'},
   {"span", required_argument, 0, 's'},
   {"concurrent", required_argument, 0, 'c'},
+  {"runs", required_argument, 0, 'r'},
   {0, 0, 0, 0} 
 };
 
@@ -38,7 +40,7 @@ static bool parse_arg(int argc, char **argv)
 
   while (1) {
     int option_index = 0;
-    c = getopt_long(argc, argv, "i:t:l:s:c", longopts, &option_index); 
+    c = getopt_long(argc, argv, "i:t:l:s:c:r:", longopts, &option_index); 
     if (c == -1) break;
 
     switch (c) {
@@ -47,6 +49,7 @@ static bool parse_arg(int argc, char **argv)
     case 'l': T = atoi(optarg); break;
     case 's': span = atoi(optarg); break;
     case 'c': nthreads = atoi(optarg); break;
+    case 'r': nruns = atoi(optarg); break;
     default: break; 
     }
   }
@@ -79,6 +82,8 @@ static void print_help(int argc, char **argv)
   fprintf(stderr, "\t--verbose   verbose output\n"); 
   fprintf(stderr, "\t--benchmark Enable benchmark\n"); 
   fprintf(stderr, "\t--nogauge   Disable gauge transformation\n"); 
+  fprintf(stderr, "\t--runs <n>  Number of stochastic runs (256)\n"); 
+  fprintf(stderr, "\t-c <n>      Number of threads\n"); 
   fprintf(stderr, "\n");
 }
 
@@ -103,9 +108,15 @@ int main(int argc, char **argv)
   ex.SetDataset(&ds);
   ex.SetExtentThreshold(1e38);
   ex.SetGPU(true);
+  ex.SetNumberOfRuns(nruns);
+  if (nthreads > 0) ex.SetNumberOfThreads(nthreads);
 
   ex.ExtractDeterministicVortices();
   ex.ExtractStochasticVortices();
+  ex.EstimateDensities();
+
+  ex.SaveVortexLines(0);
+  ex.SaveDensity();
 
   return EXIT_SUCCESS; 
 }
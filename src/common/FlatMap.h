@@ -0,0 +1,147 @@
+#ifndef _FLATMAP_H
+#define _FLATMAP_H
+
+#include <vector>
+#include <algorithm>
+#include <cstddef>
+#include <stdint.h>
+
+// map with integer keys stored as a sorted vector of (key, value) pairs.
+// lookups are binary searches; appends in ascending key order are O(1).
+template <typename K, typename V>
+class FlatMap {
+public:
+  typedef std::pair<K, V> value_type;
+  typedef typename std::vector<value_type>::iterator iterator;
+  typedef typename std::vector<value_type>::const_iterator const_iterator;
+
+  iterator begin() {return _data.begin();}
+  iterator end() {return _data.end();}
+  const_iterator begin() const {return _data.begin();}
+  const_iterator end() const {return _data.end();}
+
+  size_t size() const {return _data.size();}
+  bool empty() const {return _data.empty();}
+  void clear() {_data.clear();}
+  void reserve(size_t n) {_data.reserve(n);}
+  void swap(FlatMap& m) {_data.swap(m._data);}
+
+  const value_type& at(size_t i) const {return _data[i];} // i-th smallest key
+  size_t index(const_iterator it) const {return it - _data.begin();}
+
+  iterator find(const K& k) {
+    iterator it = lower_bound(k);
+    return (it != _data.end() && it->first == k) ? it : _data.end();
+  }
+
+  const_iterator find(const K& k) const {
+    const_iterator it = lower_bound(k);
+    return (it != _data.end() && it->first == k) ? it : _data.end();
+  }
+
+  size_t count(const K& k) const {return find(k) != end();}
+
+  V& operator[](const K& k) { // inserts a default value if not found
+    if (_data.empty() || _data.back().first < k) {
+      _data.push_back(value_type(k, V()));
+      return _data.back().second;
+    }
+    iterator it = lower_bound(k);
+    if (it == _data.end() || it->first != k)
+      it = _data.insert(it, value_type(k, V()));
+    return it->second;
+  }
+
+  // v must be sorted by key; its values replace the existing ones.  v is consumed.
+  void merge(std::vector<value_type>& v) {
+    if (_data.empty()) { // copied, not swapped, so that both keep their capacity
+      _data.assign(v.begin(), v.end());
+      unique();
+    } else if (!v.empty()) { // in place from the back, v goes after equal keys
+      size_t i = _data.size(), j = v.size(), k = i + j;
+      _data.resize(k);
+      while (j > 0) {
+        if (i > 0 && v[j-1].first < _data[i-1].first)
+          _data[--k] = _data[--i];
+        else 
+          _data[--k] = v[--j];
+      }
+      unique();
+    }
+    v.clear();
+  }
+
+private:
+  iterator lower_bound(const K& k) {
+    return std::lower_bound(_data.begin(), _data.end(), k,
+        [](const value_type& a, const K& k) {return a.first < k;});
+  }
+
+  const_iterator lower_bound(const K& k) const {
+    return std::lower_bound(_data.begin(), _data.end(), k,
+        [](const value_type& a, const K& k) {return a.first < k;});
+  }
+
+  void unique() { // keep the last of equal keys
+    size_t n = 0;
+    for (size_t i=0; i<_data.size(); i++) {
+      if (n>0 && _data[n-1].first == _data[i].first)
+        _data[n-1] = _data[i];
+      else
+        _data[n++] = _data[i];
+    }
+    _data.resize(n);
+  }
+
+private:
+  std::vector<value_type> _data;
+};
+
+// map from integer keys to lists of values in compressed (CSR) form.  keys
+// are appended in ascending order.
+template <typename K, typename V>
+class FlatListMap {
+public:
+  FlatListMap() : _offsets(1, 0) {}
+
+  size_t size() const {return _keys.size();}
+  bool empty() const {return _keys.empty();}
+  void clear() {_keys.clear(); _offsets.resize(1); _values.clear();}
+
+  void append(const K& k, const V* v, size_t n) {
+    _keys.push_back(k);
+    _values.insert(_values.end(), v, v+n);
+    _offsets.push_back(_values.size());
+  }
+
+  const K& key(size_t i) const {return _keys[i];}
+  const V* begin(size_t i) const {return _values.data() + _offsets[i];}
+  const V* end(size_t i) const {return _values.data() + _offsets[i+1];}
+
+  // index of the key, or size() if not found
+  size_t find(const K& k) const {
+    typename std::vector<K>::const_iterator it = std::lower_bound(_keys.begin(), _keys.end(), k);
+    return (it != _keys.end() && *it == k) ? it - _keys.begin() : _keys.size();
+  }
+
+private:
+  std::vector<K> _keys;
+  std::vector<size_t> _offsets;
+  std::vector<V> _values;
+};
+
+// dense bitmap over ids, e.g. all cells of a mesh
+class IdBitmap {
+public:
+  void resize(size_t n) {_bits.assign((n+63)/64, 0);}
+  size_t capacity() const {return _bits.size() * 64;}
+
+  bool test(size_t i) const {return (_bits[i>>6] >> (i&63)) & 1;}
+  void set(size_t i) {_bits[i>>6] |= (uint64_t)1 << (i&63);}
+  void reset(size_t i) {_bits[i>>6] &= ~((uint64_t)1 << (i&63));}
+
+private:
+  std::vector<uint64_t> _bits;
+};
+
+#endif
@@ -0,0 +1,57 @@
+#include "FrameArena.h"
+#include <cstdlib>
+#include <new>
+#include <algorithm>
+
+static const size_t alignment = 16;
+
+FrameArena::FrameArena(size_t block_size) :
+  _block_size(block_size), _top(0), _used(0), _nheap(0)
+{
+}
+
+FrameArena::~FrameArena()
+{
+  for (size_t i=0; i<_blocks.size(); i++) 
+    ::operator delete(_blocks[i].ptr);
+}
+
+void* FrameArena::Allocate(size_t n)
+{
+  n = (n + alignment - 1) & ~(alignment - 1);
+  if (_blocks.empty() || _top + n > _blocks.back().size) {
+    if (!_blocks.empty()) _used += _top;
+    Block b;
+    b.size = std::max(_block_size, n);
+    b.ptr = static_cast<char*>(::operator new(b.size));
+    _blocks.push_back(b);
+    _top = 0;
+    _nheap ++;
+  }
+  void *p = _blocks.back().ptr + _top;
+  _top += n;
+  return p;
+}
+
+void FrameArena::Reset()
+{
+  if (_blocks.size() > 1) { // coalesce, the next timestep fits into one block
+    const size_t size = BytesReserved();
+    for (size_t i=0; i<_blocks.size(); i++) 
+      ::operator delete(_blocks[i].ptr);
+    _blocks.resize(1);
+    _blocks[0].size = size;
+    _blocks[0].ptr = static_cast<char*>(::operator new(size));
+    _nheap ++;
+  }
+  _top = 0;
+  _used = 0;
+}
+
+size_t FrameArena::BytesReserved() const
+{
+  size_t size = 0;
+  for (size_t i=0; i<_blocks.size(); i++) 
+    size += _blocks[i].size;
+  return size;
+}
@@ -0,0 +1,73 @@
+#ifndef _FRAMEARENA_H
+#define _FRAMEARENA_H
+
+#include <vector>
+#include <cstddef>
+#include <type_traits>
+
+// bump allocator for objects that live as long as one timestep.  memory is
+// only given back as a whole by Reset(), which keeps the blocks for the next
+// timestep; after a few timesteps the arena holds a single block that is
+// large enough and no more heap allocations happen.  not thread-safe, each
+// thread owns its arenas.
+class FrameArena {
+public:
+  explicit FrameArena(size_t block_size = 1<<16);
+  ~FrameArena();
+
+  void* Allocate(size_t n);
+  void Reset();
+
+  size_t BytesUsed() const {return _used + _top;}
+  size_t BytesReserved() const;
+  size_t NumberOfHeapAllocations() const {return _nheap;} // blocks allocated so far
+
+private:
+  FrameArena(const FrameArena&);
+  FrameArena& operator=(const FrameArena&);
+
+  struct Block {char *ptr; size_t size;};
+  std::vector<Block> _blocks; // the last one is current
+  size_t _block_size;
+  size_t _top; // bytes taken from the current block
+  size_t _used; // bytes taken from the previous blocks
+  size_t _nheap;
+};
+
+// stl allocator on a FrameArena; a null arena falls back to the heap.  copies
+// of containers go to the heap, so that they can outlive the timestep; moves
+// take the arena along.
+template <typename T>
+class ArenaAllocator {
+public:
+  typedef T value_type;
+  typedef std::true_type propagate_on_container_move_assignment;
+  typedef std::true_type propagate_on_container_swap;
+
+  ArenaAllocator() : _arena(NULL) {}
+  explicit ArenaAllocator(FrameArena *arena) : _arena(arena) {}
+  template <typename U> ArenaAllocator(const ArenaAllocator<U>& a) : _arena(a.arena()) {}
+
+  T* allocate(size_t n) {
+    if (_arena) return static_cast<T*>(_arena->Allocate(n * sizeof(T)));
+    else return static_cast<T*>(::operator new(n * sizeof(T)));
+  }
+  void deallocate(T *p, size_t) {
+    if (!_arena) ::operator delete(p);
+  }
+
+  ArenaAllocator select_on_container_copy_construction() const {return ArenaAllocator();}
+
+  FrameArena* arena() const {return _arena;}
+
+private:
+  FrameArena *_arena;
+};
+
+template <typename T, typename U>
+bool operator==(const ArenaAllocator<T>& a, const ArenaAllocator<U>& b) {return a.arena() == b.arena();}
+
+template <typename T, typename U>
+bool operator!=(const ArenaAllocator<T>& a, const ArenaAllocator<U>& b) {return a.arena() != b.arena();}
+
+#endif
@@ -2,6 +2,7 @@
 #include <cassert>
 #include <climits>
 #include <cstdio>
+#include <cstdlib>
 #include <climits>
 
 #if WITH_PROTOBUF
@@ -66,6 +67,34 @@ FaceIdType4 AlternateFace(FaceIdType4 f, int rotation, ChiralityType chirality)
   return make_tuple(UINT_MAX, UINT_MAX, UINT_MAX, UINT_MAX); // make compiler happy
 }
 
+////////////////////////
+CEdge::CEdge(const CEdgeView& v) : 
+  node0(v.node0), node1(v.node1), 
+  contained_faces(v.contained_faces, v.contained_faces + v.ncontained_faces), 
+  contained_faces_chirality(v.contained_faces_chirality, v.contained_faces_chirality + v.ncontained_faces), 
+  contained_faces_eid(v.contained_faces_eid, v.contained_faces_eid + v.ncontained_faces)
+{
+}
+
+CFace::CFace(const CFaceView& v, bool nodes_only) : 
+  nodes(v.nodes, v.nodes + v.nnodes)
+{
+  if (nodes_only) return;
+  edges.assign(v.edges, v.edges + v.nnodes);
+  edges_chirality.assign(v.edges_chirality, v.edges_chirality + v.nnodes);
+  contained_cells.assign(v.contained_cells, v.contained_cells + v.ncontained_cells);
+  contained_cells_chirality.assign(v.contained_cells_chirality, v.contained_cells_chirality + v.ncontained_cells);
+  contained_cells_fid.assign(v.contained_cells_fid, v.contained_cells_fid + v.ncontained_cells);
+}
+
+CCell::CCell(const CCellView& v) : 
+  nodes(v.nodes, v.nodes + v.nnodes), 
+  faces(v.faces, v.faces + v.nfaces), 
+  faces_chirality(v.faces_chirality, v.faces_chirality + v.nfaces), 
+  neighbor_cells(v.neighbor_cells, v.neighbor_cells + v.nfaces)
+{
+}
+
 ////////////////////////
 MeshGraph::~MeshGraph()
 {
@@ -79,6 +108,67 @@ void MeshGraph::Clear()
   cells.clear();
 }
 
+// the views have fixed capacities that the extractor lays out its tables
+// by, so a mesh that exceeds them cannot be extracted
+static void check_view_capacity(const char *what, unsigned int i, size_t n, size_t max)
+{
+  if (n <= max) return;
+  fprintf(stderr, "FATAL: %s %u has %zu entries, more than the view capacity %zu.\n", what, i, n, max);
+  abort();
+}
+
+void MeshGraph::EdgeView(EdgeIdType i, CEdgeView& v, bool nodes_only) const
+{
+  const CEdge e = Edge(i, nodes_only);
+  check_view_capacity("edge", i, e.contained_faces.size(), CEdgeView::MAX_FACES);
+
+  v.node0 = e.node0; 
+  v.node1 = e.node1;
+  v.ncontained_faces = e.contained_faces.size();
+  for (int p=0; p<v.ncontained_faces; p++) {
+    v.contained_faces[p] = e.contained_faces[p];
+    v.contained_faces_chirality[p] = e.contained_faces_chirality[p];
+    v.contained_faces_eid[p] = e.contained_faces_eid[p];
+  }
+}
+
+void MeshGraph::FaceView(FaceIdType i, CFaceView& v, bool nodes_only) const
+{
+  const CFace f = Face(i, nodes_only);
+  check_view_capacity("face", i, f.nodes.size(), CFaceView::MAX_NODES);
+  check_view_capacity("face", i, f.contained_cells.size(), CFaceView::MAX_CELLS);
+
+  v.nnodes = f.nodes.size();
+  for (int p=0; p<v.nnodes; p++) {
+    v.nodes[p] = f.nodes[p];
+    v.edges[p] = p<f.edges.size() ? f.edges[p] : UINT_MAX;
+    v.edges_chirality[p] = p<f.edges_chirality.size() ? f.edges_chirality[p] : 0;
+  }
+  v.ncontained_cells = f.contained_cells.size();
+  for (int p=0; p<v.ncontained_cells; p++) {
+    v.contained_cells[p] = f.contained_cells[p];
+    v.contained_cells_chirality[p] = f.contained_cells_chirality[p];
+    v.contained_cells_fid[p] = f.contained_cells_fid[p];
+  }
+}
+
+void MeshGraph::CellView(CellIdType i, CCellView& v, bool nodes_only) const
+{
+  const CCell c = Cell(i, nodes_only);
+  check_view_capacity("cell", i, c.nodes.size(), CCellView::MAX_NODES);
+  check_view_capacity("cell", i, c.faces.size(), CCellView::MAX_FACES);
+
+  v.nnodes = c.nodes.size();
+  for (int p=0; p<v.nnodes; p++) 
+    v.nodes[p] = c.nodes[p];
+  v.nfaces = c.faces.size();
+  for (int p=0; p<v.nfaces; p++) {
+    v.faces[p] = c.faces[p];
+    v.faces_chirality[p] = c.faces_chirality[p];
+    v.neighbor_cells[p] = p<c.neighbor_cells.size() ? c.neighbor_cells[p] : UINT_MAX;
+  }
+}
+
 void MeshGraph::SerializeToString(std::string &str) const
 {
 #if WITH_PROTOBUF
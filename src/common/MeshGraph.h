@@ -20,6 +20,54 @@ EdgeIdType2 AlternateEdge(EdgeIdType2 e2, ChiralityType chirality);
 FaceIdType3 AlternateFace(FaceIdType3 f3, int rotation, ChiralityType chirality);
 FaceIdType4 AlternateFace(FaceIdType4 f4, int rotation, ChiralityType chirality);
 
+// fixed-capacity views of edges/faces/cells, filled in place without
+// touching the heap.  used by the per-face/per-edge hot paths.
+struct CEdgeView {
+  enum {MAX_FACES = 32};
+
+  NodeIdType node0, node1;
+
+  int ncontained_faces;
+  FaceIdType contained_faces[MAX_FACES];
+  ChiralityType contained_faces_chirality[MAX_FACES];
+  int contained_faces_eid[MAX_FACES];
+
+  CEdgeView() : node0(0), node1(0), ncontained_faces(0) {}
+  bool Valid() const {return node0 != node1;}
+};
+
+struct CFaceView {
+  enum {MAX_NODES = 4, MAX_CELLS = 2};
+
+  int nnodes; // also the number of edges
+  NodeIdType nodes[MAX_NODES];
+  EdgeIdType edges[MAX_NODES];
+  ChiralityType edges_chirality[MAX_NODES];
+
+  int ncontained_cells;
+  CellIdType contained_cells[MAX_CELLS];
+  ChiralityType contained_cells_chirality[MAX_CELLS];
+  int contained_cells_fid[MAX_CELLS];
+
+  CFaceView() : nnodes(0), ncontained_cells(0) {}
+  bool Valid() const {return nnodes>0;}
+};
+
+struct CCellView {
+  enum {MAX_NODES = 8, MAX_FACES = 6};
+
+  int nnodes;
+  NodeIdType nodes[MAX_NODES];
+
+  int nfaces; // also the number of neighbor cells
+  FaceIdType faces[MAX_FACES];
+  ChiralityType faces_chirality[MAX_FACES];
+  CellIdType neighbor_cells[MAX_FACES];
+
+  CCellView() : nnodes(0), nfaces(0) {}
+  bool Valid() const {return nfaces>0;}
+};
+
 struct CEdge {
   // nodes
   NodeIdType node0, node1;
@@ -34,6 +82,7 @@ struct CEdge {
     // contained_faces_chirality.reserve(12);
     // contained_faces_eid.reserve(12);
   }
+  explicit CEdge(const CEdgeView&);
 
   bool Valid() const {return node0 != node1;}
 };
@@ -62,6 +111,7 @@ struct CFace {
     // contained_cells.reserve(2);
     // contained_cells_chirality.reserve(2);
   }
+  explicit CFace(const CFaceView&, bool nodes_only=false);
 
   bool Valid() const {return nodes.size()>0;}
 };
@@ -83,6 +133,7 @@ struct CCell {
     // faces_chirality.reserve(4);
     // neighbor_cells.reserve(4);
   }
+  explicit CCell(const CCellView&);
 
   bool Valid() const {return faces.size()>0;}
 };
@@ -117,6 +168,11 @@ public:
   virtual CFace Face(FaceIdType i, bool nodes_only=false) const {return faces[i];} // second arg for acceleration
   virtual CCell Cell(CellIdType i, bool nodes_only=false) const {return cells[i];}
 
+  // allocation-free variants; the defaults convert from Edge()/Face()/Cell()
+  virtual void EdgeView(EdgeIdType i, CEdgeView&, bool nodes_only=false) const;
+  virtual void FaceView(FaceIdType i, CFaceView&, bool nodes_only=false) const;
+  virtual void CellView(CellIdType i, CCellView&, bool nodes_only=false) const;
+
   void SerializeToString(std::string &str) const;
   bool ParseFromString(const std::string &str);
 
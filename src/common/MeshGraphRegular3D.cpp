@@ -11,11 +11,32 @@ MeshGraphRegular3D::MeshGraphRegular3D(int d_[3], bool pbc_[3])
 
 CCell MeshGraphRegular3D::Cell(CellIdType id, bool nodes_only) const
 {
-  CCell cell;
+  CCellView v;
+  CellView(id, v, nodes_only);
+  return CCell(v);
+}
+
+CFace MeshGraphRegular3D::Face(FaceIdType id, bool nodes_only) const
+{
+  CFaceView v;
+  FaceView(id, v, nodes_only);
+  return CFace(v, nodes_only);
+}
+
+CEdge MeshGraphRegular3D::Edge(EdgeIdType id, bool nodes_only) const
+{
+  CEdgeView v;
+  EdgeView(id, v, nodes_only);
+  return CEdge(v);
+}
+
+void MeshGraphRegular3D::CellView(CellIdType id, CCellView& cell, bool nodes_only) const
+{
   int idx[3];
   
+  cell.nnodes = cell.nfaces = 0;
   cid2cidx(id, idx);
-  if (!valid_cidx(idx)) return cell;
+  if (!valid_cidx(idx)) return;
   const int i = idx[0], j = idx[1], k = idx[2];
 
   // nodes
@@ -23,8 +44,9 @@ CCell MeshGraphRegular3D::Cell(CellIdType id, bool nodes_only) const
     {i, j, k}, {i+1, j, k}, {i+1, j+1, k}, {i, j+1, k},
     {i, j, k+1}, {i+1, j, k+1}, {i+1, j+1, k+1}, {i, j+1, k+1}};
   for (int p=0; p<8; p++) // don't worry about modIdx here. automatically done in idx2id()
-    cell.nodes.push_back(nidx2nid(nodes_idx[p]));
-  if (nodes_only) return cell;
+    cell.nodes[p] = nidx2nid(nodes_idx[p]);
+  cell.nnodes = 8;
+  if (nodes_only) return;
 
   // faces
   const int faces_fidx[6][4] = {
@@ -36,8 +58,8 @@ CCell MeshGraphRegular3D::Cell(CellIdType id, bool nodes_only) const
     {i, j, k+1, 2}};  // type2, xy
   const ChiralityType faces_chi[6] = {-1, -1, -1, 1, 1, 1};
   for (int p=0; p<6; p++) {
-    cell.faces.push_back(fidx2fid(faces_fidx[p]));
-    cell.faces_chirality.push_back(faces_chi[p]);
+    cell.faces[p] = fidx2fid(faces_fidx[p]);
+    cell.faces_chirality[p] = faces_chi[p];
   }
 
   // neighbor cells
@@ -49,24 +71,23 @@ CCell MeshGraphRegular3D::Cell(CellIdType id, bool nodes_only) const
     {i, j+1, k},
     {i, j, k+1}};
   for (int p=0; p<6; p++)
-    cell.neighbor_cells.push_back(cidx2cid(neighbors_cidx[p]));
+    cell.neighbor_cells[p] = cidx2cid(neighbors_cidx[p]);
 #if 0
     if (valid_cidx(neighbors_cidx[p]))
       cell.neighbor_cells.push_back(cidx2cid(neighbors_cidx[p]));
     else
       cell.neighbor_cells.push_back(UINT_MAX);
 #endif
-
-  return cell;
+  cell.nfaces = 6;
 }
 
-CFace MeshGraphRegular3D::Face(FaceIdType id, bool nodes_only) const
+void MeshGraphRegular3D::FaceView(FaceIdType id, CFaceView& face, bool nodes_only) const
 {
-  CFace face;
   int fidx[4];
 
+  face.nnodes = face.ncontained_cells = 0;
   fid2fidx(id, fidx);
-  if (!valid_fidx(fidx)) return face;
+  if (!valid_fidx(fidx)) return;
   const int i = fidx[0], j = fidx[1], k = fidx[2], t = fidx[3];
 
   // nodes
@@ -75,8 +96,9 @@ CFace MeshGraphRegular3D::Face(FaceIdType id, bool nodes_only) const
     {{i, j, k}, {i, j, k+1}, {i+1, j, k+1}, {i+1, j, k}},
     {{i, j, k}, {i+1, j, k}, {i+1, j+1, k}, {i, j+1, k}}};
   for (int p=0; p<4; p++)
-    face.nodes.push_back(nidx2nid(nodes_idx[t][p]));
-  if (nodes_only) return face;
+    face.nodes[p] = nidx2nid(nodes_idx[t][p]);
+  face.nnodes = 4;
+  if (nodes_only) return;
 
   // edges
   const int edges_idx[3][4][4] = {
@@ -85,8 +107,8 @@ CFace MeshGraphRegular3D::Face(FaceIdType id, bool nodes_only) const
     {{i, j, k, 0}, {i+1, j, k, 1}, {i, j+1, k, 0}, {i, j, k, 1}}};
   const ChiralityType edges_chi[4] = {1, 1, -1, -1};
   for (int p=0; p<4; p++) {
-    face.edges.push_back(eidx2eid(edges_idx[t][p]));
-    face.edges_chirality.push_back(edges_chi[p]);
+    face.edges[p] = eidx2eid(edges_idx[t][p]);
+    face.edges_chirality[p] = edges_chi[p];
   }
 
   // contained cells
@@ -99,27 +121,27 @@ CFace MeshGraphRegular3D::Face(FaceIdType id, bool nodes_only) const
     {0, 3}, {1, 4}, {2, 5}};
   for (int p=0; p<2; p++) {
     // if (!valid_cidx(contained_cells_cidx[t][p])) continue;
-    face.contained_cells.push_back(cidx2cid(contained_cells_cidx[t][p]));
-    face.contained_cells_chirality.push_back(contained_cells_chi[p]);
-    face.contained_cells_fid.push_back(contained_cells_fid[t][p]);
+    face.contained_cells[p] = cidx2cid(contained_cells_cidx[t][p]);
+    face.contained_cells_chirality[p] = contained_cells_chi[p];
+    face.contained_cells_fid[p] = contained_cells_fid[t][p];
   }
+  face.ncontained_cells = 2;
  
 #if 0
   fprintf(stderr, "fid=%u, fidx={%d, %d, %d, %d}, contained_cell0=%u, contained_cell1=%u\n", 
       id, i, j, k, t, 
       face.contained_cells[0], face.contained_cells[1]);
 #endif
-
-  return face;
 }
 
-CEdge MeshGraphRegular3D::Edge(EdgeIdType id, bool nodes_only) const
+void MeshGraphRegular3D::EdgeView(EdgeIdType id, CEdgeView& edge, bool nodes_only) const
 {
-  CEdge edge;
   int eidx[4];
 
+  edge.node0 = edge.node1 = 0;
+  edge.ncontained_faces = 0;
   eid2eidx(id, eidx);
-  if (!valid_eidx(eidx)) return edge;
+  if (!valid_eidx(eidx)) return;
   const int i = eidx[0], j = eidx[1], k = eidx[2], t = eidx[3];
 
   // nodes
@@ -130,7 +152,7 @@ CEdge MeshGraphRegular3D::Edge(EdgeIdType id, bool nodes_only) const
 
   edge.node0 = nidx2nid(nodes_idx[t][0]);
   edge.node1 = nidx2nid(nodes_idx[t][1]);
-  if (nodes_only) return edge;
+  if (nodes_only) return;
 
   // contained faces
   const int contained_faces_fidx[3][4][4] = {
@@ -143,12 +165,11 @@ CEdge MeshGraphRegular3D::Edge(EdgeIdType id, bool nodes_only) const
     {0, 3, 2, 1}, {3, 0, 1, 2}, {0, 3, 2, 1}};
 
   for (int p=0; p<4; p++) {
-    edge.contained_faces.push_back(fidx2fid(contained_faces_fidx[t][p]));
-    edge.contained_faces_chirality.push_back(contained_faces_chi[t][p]);
-    edge.contained_faces_eid.push_back(contained_faces_eid[t][p]);
+    edge.contained_faces[p] = fidx2fid(contained_faces_fidx[t][p]);
+    edge.contained_faces_chirality[p] = contained_faces_chi[t][p];
+    edge.contained_faces_eid[p] = contained_faces_eid[t][p];
   }
-
-  return edge;
+  edge.ncontained_faces = 4;
 }
 
 EdgeIdType MeshGraphRegular3D::NEdges() const
@@ -199,6 +220,7 @@ unsigned int MeshGraphRegular3D::nidx2nid(const int idx_[3]) const
 {
   int idx[3] = {idx_[0], idx_[1], idx_[2]};
   for (int i=0; i<3; i++) {
+    if (idx[i] >= 0 && idx[i] < d[i]) continue; // no need to wrap
     idx[i] = idx[i] % d[i];
     if (idx[i] < 0)
       idx[i] += d[i];
@@ -292,6 +314,7 @@ std::vector<FaceIdType> MeshGraphRegular3D::GetBoundaryFaceIds(int type) const
           fids.push_back(fidx2fid(fidx));
         }
       }
+    break;
 
   case 1: // ZX
     for (k=0; k<d[2]; k++) 
@@ -302,6 +325,7 @@ std::vector<FaceIdType> MeshGraphRegular3D::GetBoundaryFaceIds(int type) const
           fids.push_back(fidx2fid(fidx));
         }
       }
+    break;
 
   case 2: // XY
     for (i=0; i<=d[0]; i++) 
@@ -312,6 +336,7 @@ std::vector<FaceIdType> MeshGraphRegular3D::GetBoundaryFaceIds(int type) const
           fids.push_back(fidx2fid(fidx));
         }
       }
+    break;
 
   default: 
     break;
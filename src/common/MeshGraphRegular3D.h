@@ -37,6 +37,10 @@ public:
   CFace Face(FaceIdType i, bool nodes_only=false) const;
   CCell Cell(CellIdType i, bool nodes_only=false) const;
 
+  void EdgeView(EdgeIdType i, CEdgeView&, bool nodes_only=false) const;
+  void FaceView(FaceIdType i, CFaceView&, bool nodes_only=false) const;
+  void CellView(CellIdType i, CCellView&, bool nodes_only=false) const;
+
 public:
   std::vector<FaceIdType> GetBoundaryFaceIds(int type) const; // 0: YZ, 1: ZX, 2: XY
 };
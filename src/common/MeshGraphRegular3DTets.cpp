@@ -9,11 +9,32 @@ MeshGraphRegular3DTets::MeshGraphRegular3DTets(int d[3], bool pbc[3])
 
 CCell MeshGraphRegular3DTets::Cell(CellIdType id, bool nodes_only) const
 {
-  CCell cell; 
+  CCellView v;
+  CellView(id, v, nodes_only);
+  return CCell(v);
+}
+
+CFace MeshGraphRegular3DTets::Face(FaceIdType id, bool nodes_only) const
+{
+  CFaceView v;
+  FaceView(id, v, nodes_only);
+  return CFace(v, nodes_only);
+}
+
+CEdge MeshGraphRegular3DTets::Edge(EdgeIdType id, bool nodes_only) const
+{
+  CEdgeView v;
+  EdgeView(id, v, nodes_only);
+  return CEdge(v);
+}
+
+void MeshGraphRegular3DTets::CellView(CellIdType id, CCellView& cell, bool nodes_only) const
+{
   int idx[4];
 
+  cell.nnodes = cell.nfaces = 0;
   cid2cidx(id, idx);
-  if (!valid_cidx(idx)) return cell;
+  if (!valid_cidx(idx)) return;
   const int i = idx[0], j = idx[1], k = idx[2], t = idx[3];
 
   const int nodes_idx[6][4][3] = {
@@ -26,8 +47,9 @@ CCell MeshGraphRegular3DTets::Cell(CellIdType id, bool nodes_only) const
   };
   
   for (int p=0; p<4; p++) 
-    cell.nodes.push_back(nidx2nid(nodes_idx[t][p]));
-  if (nodes_only) return cell;
+    cell.nodes[p] = nidx2nid(nodes_idx[t][p]);
+  cell.nnodes = 4;
+  if (nodes_only) return;
 
   // faces
   const int faces_fidx[6][4][4] = {
@@ -47,8 +69,8 @@ CCell MeshGraphRegular3DTets::Cell(CellIdType id, bool nodes_only) const
     {-1, 1, 1, -1}
   };
   for (int p=0; p<4; p++) {
-    cell.faces.push_back(fidx2fid(faces_fidx[t][p]));
-    cell.faces_chirality.push_back(faces_chi[t][p]);
+    cell.faces[p] = fidx2fid(faces_fidx[t][p]);
+    cell.faces_chirality[p] = faces_chi[t][p];
   }
   
   // neighbor cells
@@ -61,55 +83,58 @@ CCell MeshGraphRegular3DTets::Cell(CellIdType id, bool nodes_only) const
     {{i, j, k-1, 1}, {i, j, k, 0}, {i, j, k, 3}, {i, j, k, 2}}
   }; 
   for (int p=0; p<4; p++)
-    cell.neighbor_cells.push_back(cidx2cid(neighbors_cidx[t][p]));
-
-  return cell;
+    cell.neighbor_cells[p] = cidx2cid(neighbors_cidx[t][p]);
+  cell.nfaces = 4;
 }
 
-CFace MeshGraphRegular3DTets::Face(FaceIdType id, bool nodes_only) const
+void MeshGraphRegular3DTets::FaceView(FaceIdType id, CFaceView& face, bool nodes_only) const
 {
-  CFace face;
   int fidx[4];
 
+  face.nnodes = face.ncontained_cells = 0;
   fid2fidx(id, fidx);
-  if (!valid_fidx(fidx)) return face;
+  if (!valid_fidx(fidx)) return;
   const int i = fidx[0], j = fidx[1], k = fidx[2], t = fidx[3];
 
   // nodes
-  const int nodes_idx[12][3][3] = { // 12 types of faces
-    {{i, j, k}, {i+1, j, k}, {i+1, j+1, k}},      // ABC
-    {{i, j, k}, {i+1, j+1, k}, {i, j+1, k}},      // ACD
-    {{i, j, k}, {i+1, j, k}, {i+1, j, k+1}},      // ABF
-    {{i, j, k}, {i, j, k+1}, {i+1, j, k+1}},      // AEF
-    {{i, j, k}, {i, j+1, k}, {i, j, k+1}},        // ADE
-    {{i, j+1, k}, {i, j, k+1}, {i, j+1, k+1}},    // DEH
-    {{i, j, k}, {i, j+1, k}, {i+1, j, k+1}},      // ADF
-    {{i, j+1, k}, {i+1, j, k+1}, {i+1, j+1, k+1}},// DFG
-    {{i, j+1, k}, {i, j, k+1}, {i+1, j, k+1}},    // DEF
-    {{i+1, j+1, k}, {i, j+1, k}, {i+1, j, k+1}},  // CDF
-    {{i, j, k}, {i+1, j+1, k}, {i+1, j, k+1}},    // ACF
-    {{i, j+1, k}, {i, j, k+1}, {i+1, j+1, k+1}}   // DEG
+  static const int nodes_off[12][3][3] = { // 12 types of faces
+    {{0, 0, 0}, {1, 0, 0}, {1, 1, 0}},       // ABC
+    {{0, 0, 0}, {1, 1, 0}, {0, 1, 0}},       // ACD
+    {{0, 0, 0}, {1, 0, 0}, {1, 0, 1}},       // ABF
+    {{0, 0, 0}, {0, 0, 1}, {1, 0, 1}},       // AEF
+    {{0, 0, 0}, {0, 1, 0}, {0, 0, 1}},       // ADE
+    {{0, 1, 0}, {0, 0, 1}, {0, 1, 1}},       // DEH
+    {{0, 0, 0}, {0, 1, 0}, {1, 0, 1}},       // ADF
+    {{0, 1, 0}, {1, 0, 1}, {1, 1, 1}},       // DFG
+    {{0, 1, 0}, {0, 0, 1}, {1, 0, 1}},       // DEF
+    {{1, 1, 0}, {0, 1, 0}, {1, 0, 1}},       // CDF
+    {{0, 0, 0}, {1, 1, 0}, {1, 0, 1}},       // ACF
+    {{0, 1, 0}, {0, 0, 1}, {1, 1, 1}}        // DEG
   };
-  for (int p=0; p<3; p++)
-    face.nodes.push_back(nidx2nid(nodes_idx[t][p]));
-  if (nodes_only) return face;
+  for (int p=0; p<3; p++) {
+    const int *o = nodes_off[t][p];
+    const int nidx[3] = {i+o[0], j+o[1], k+o[2]};
+    face.nodes[p] = nidx2nid(nidx);
+  }
+  face.nnodes = 3;
+  if (nodes_only) return;
 
   // edges
-  const int edges_idx[12][3][4] = {
-    {{i, j, k, 0}, {i+1, j, k, 2}, {i, j, k, 1}}, 
-    {{i, j, k, 1}, {i, j+1, k, 0}, {i, j, k, 2}}, 
-    {{i, j, k, 0}, {i+1, j, k, 3}, {i, j, k, 4}}, 
-    {{i, j, k, 3}, {i, j, k+1, 0}, {i, j, k, 4}}, 
-    {{i, j, k, 2}, {i, j, k, 5}, {i, j, k, 3}}, 
-    {{i, j, k, 5}, {i, j, k, 2}, {i, j+1, k, 3}}, 
-    {{i, j, k, 2}, {i, j, k, 6}, {i, j, k, 4}}, 
-    {{i, j, k, 6}, {i+1, j, k+1, 2}, {i, j+1, k, 4}}, 
-    {{i, j, k, 5}, {i, j, k+1, 0}, {i, j, k, 6}}, 
-    {{i, j+1, k, 0}, {i, j, k, 6}, {i+1, j, k, 5}}, 
-    {{i, j, k, 1}, {i+1, j, k, 5}, {i, j, k, 4}}, 
-    {{i, j, k, 5}, {i, j, k+1, 1}, {i, j+1, k, 4}}
+  static const int edges_off[12][3][4] = {
+    {{0, 0, 0, 0}, {1, 0, 0, 2}, {0, 0, 0, 1}}, 
+    {{0, 0, 0, 1}, {0, 1, 0, 0}, {0, 0, 0, 2}}, 
+    {{0, 0, 0, 0}, {1, 0, 0, 3}, {0, 0, 0, 4}}, 
+    {{0, 0, 0, 3}, {0, 0, 1, 0}, {0, 0, 0, 4}}, 
+    {{0, 0, 0, 2}, {0, 0, 0, 5}, {0, 0, 0, 3}}, 
+    {{0, 0, 0, 5}, {0, 0, 1, 2}, {0, 1, 0, 3}}, 
+    {{0, 0, 0, 2}, {0, 0, 0, 6}, {0, 0, 0, 4}}, 
+    {{0, 0, 0, 6}, {1, 0, 1, 2}, {0, 1, 0, 4}}, 
+    {{0, 0, 0, 5}, {0, 0, 1, 0}, {0, 0, 0, 6}}, 
+    {{0, 1, 0, 0}, {0, 0, 0, 6}, {1, 0, 0, 5}}, 
+    {{0, 0, 0, 1}, {1, 0, 0, 5}, {0, 0, 0, 4}}, 
+    {{0, 0, 0, 5}, {0, 0, 1, 1}, {0, 1, 0, 4}}
   }; 
-  const ChiralityType edges_chi[12][3] = {
+  static const ChiralityType edges_chi[12][3] = {
     {1, 1, -1}, 
     {1, -1, -1}, 
     {1, 1, -1}, 
@@ -118,32 +143,35 @@ CFace MeshGraphRegular3DTets::Face(FaceIdType id, bool nodes_only) const
     {1, 1, -1}, 
     {1, 1, -1}, 
     {1, 1, -1}, 
-    {-1, 1, -1},
-    {1, -1, -1}, 
+    {1, 1, -1},
+    {-1, 1, -1}, 
+    {1, 1, -1},
     {1, 1, -1}
   };
     
   for (int p=0; p<3; p++) {
-    face.edges.push_back(eidx2eid(edges_idx[t][p]));
-    face.edges_chirality.push_back(edges_chi[t][p]);
+    const int *o = edges_off[t][p];
+    const int eidx[4] = {i+o[0], j+o[1], k+o[2], o[3]};
+    face.edges[p] = eidx2eid(eidx);
+    face.edges_chirality[p] = edges_chi[t][p];
   }
 
   // contained cells
-  const int contained_cells_cidx[12][2][4] = {
-    {{i, j, k, 0}, {i, j, k-1, 4}},  // ABC
-    {{i, j, k, 5}, {i, j, k-1, 1}},  // ACD
-    {{i, j, k, 0}, {i, j-1, k, 3}},  // ABF
-    {{i, j, k, 2}, {i, j-1, k, 1}},  // AEF
-    {{i, j, k, 2}, {i-1, j, k, 0}},  // ADE
-    {{i, j, k, 1}, {i-1, j, k, 3}},  // DEH
-    {{i, j, k, 2}, {i, j, k, 5}},    // ADF
-    {{i, j, k, 4}, {i, j, k, 3}},    // DFG
-    {{i, j, k, 2}, {i, j, k, 4}},    // DEF
-    {{i, j, k, 3}, {i, j, k, 5}},    // CDF
-    {{i, j, k, 0}, {i, j, k, 5}},    // ACF
-    {{i, j, k, 1}, {i, j, k, 4}}     // DEG
+  static const int contained_cells_off[12][2][4] = {
+    {{0, 0, 0, 0}, {0, 0, -1, 4}},           // ABC
+    {{0, 0, 0, 5}, {0, 0, -1, 1}},           // ACD
+    {{0, 0, 0, 0}, {0, -1, 0, 3}},           // ABF
+    {{0, 0, 0, 2}, {0, -1, 0, 1}},           // AEF
+    {{0, 0, 0, 2}, {-1, 0, 0, 0}},           // ADE
+    {{0, 0, 0, 1}, {-1, 0, 0, 3}},           // DEH
+    {{0, 0, 0, 2}, {0, 0, 0, 5}},            // ADF
+    {{0, 0, 0, 4}, {0, 0, 0, 3}},            // DFG
+    {{0, 0, 0, 2}, {0, 0, 0, 4}},            // DEF
+    {{0, 0, 0, 3}, {0, 0, 0, 5}},            // CDF
+    {{0, 0, 0, 0}, {0, 0, 0, 5}},            // ACF
+    {{0, 0, 0, 1}, {0, 0, 0, 4}}             // DEG
   }; 
-  const ChiralityType contained_cells_chi[12][2] = {
+  static const ChiralityType contained_cells_chi[12][2] = {
     {-1, 1}, 
     {-1, 1}, 
     {1, -1}, 
@@ -157,7 +185,7 @@ CFace MeshGraphRegular3DTets::Face(FaceIdType id, bool nodes_only) const
     {-1, 1}, 
     {-1, 1}
   };
-  const int contained_cells_fid[12][2] = {
+  static const int contained_cells_fid[12][2] = {
     {0, 2}, 
     {0, 2}, 
     {1, 1},
@@ -172,29 +200,31 @@ CFace MeshGraphRegular3DTets::Face(FaceIdType id, bool nodes_only) const
     {0, 1}
   };
   for (int p=0; p<2; p++) {
-    if (!valid_cidx(contained_cells_cidx[t][p])) continue;
-    face.contained_cells.push_back(cidx2cid(contained_cells_cidx[t][p]));
-    face.contained_cells_chirality.push_back(contained_cells_chi[t][p]);
-    face.contained_cells_fid.push_back(contained_cells_fid[t][p]);
+    const int *o = contained_cells_off[t][p];
+    const int cidx[4] = {i+o[0], j+o[1], k+o[2], o[3]};
+    if (!valid_cidx(cidx)) continue;
+    const int q = face.ncontained_cells ++;
+    face.contained_cells[q] = cidx2cid(cidx);
+    face.contained_cells_chirality[q] = contained_cells_chi[t][p];
+    face.contained_cells_fid[q] = contained_cells_fid[t][p];
   }
 
 #if 0
   fprintf(stderr, "fid=%u, fidx={%d, %d, %d, %d}, cid0=%u={%d, %d, %d, %d}, fid0=%d, cid1=%u={%d, %d, %d, %d}, fid1=%d\n", 
       id, i, j, k, t, 
-      face.contained_cells[0], contained_cells_cidx[t][0][0], contained_cells_cidx[t][0][1], contained_cells_cidx[t][0][2], contained_cells_cidx[t][0][3], contained_cells_fid[t][0], 
-      face.contained_cells[1], contained_cells_cidx[t][1][0], contained_cells_cidx[t][1][1], contained_cells_cidx[t][1][2], contained_cells_cidx[t][1][3], contained_cells_fid[t][1]);
+      face.contained_cells[0], i+contained_cells_off[t][0][0], j+contained_cells_off[t][0][1], k+contained_cells_off[t][0][2], contained_cells_off[t][0][3], contained_cells_fid[t][0], 
+      face.contained_cells[1], i+contained_cells_off[t][1][0], j+contained_cells_off[t][1][1], k+contained_cells_off[t][1][2], contained_cells_off[t][1][3], contained_cells_fid[t][1]);
 #endif
-
-  return face;
 }
 
-CEdge MeshGraphRegular3DTets::Edge(EdgeIdType id, bool nodes_only) const
+void MeshGraphRegular3DTets::EdgeView(EdgeIdType id, CEdgeView& edge, bool nodes_only) const
 {
-  CEdge edge;
   int eidx[4];
 
+  edge.node0 = edge.node1 = 0;
+  edge.ncontained_faces = 0;
   eid2eidx(id, eidx);
-  if (!valid_eidx(eidx)) return edge;
+  if (!valid_eidx(eidx)) return;
   const int i = eidx[0], j = eidx[1], k = eidx[2], t = eidx[3];
 
   // nodes
@@ -210,7 +240,7 @@ CEdge MeshGraphRegular3DTets::Edge(EdgeIdType id, bool nodes_only) const
 
   edge.node0 = nidx2nid(nodes_idx[t][0]);
   edge.node1 = nidx2nid(nodes_idx[t][1]);
-  if (nodes_only) return edge;
+  if (nodes_only) return;
 
   // contained faces (each edge connects to 4 or 6 faces)
   const int contained_faces_fidx[7][6][4] = {
@@ -225,7 +255,7 @@ CEdge MeshGraphRegular3DTets::Edge(EdgeIdType id, bool nodes_only) const
   const ChiralityType contained_faces_chi[7][6] = {
     {1, 1, -1, -1, 1, 1}, 
     {-1, 1, 1, 1, 0, 0}, 
-    {1, 1, 1, 1, 1, 1},
+    {-1, 1, 1, 1, 1, 1},
     {1, -1, 1, -1, 0, 0}, 
     {-1, -1, -1, -1, -1, -1}, 
     {1, 1, 1, 1, 1, -1}, 
@@ -233,7 +263,7 @@ CEdge MeshGraphRegular3DTets::Edge(EdgeIdType id, bool nodes_only) const
   };
   const int contained_faces_eid[7][6] = {
     {0, 0, 0, 1, 1, 1}, 
-    {0, 0, 0, 1, -1, -1}, 
+    {2, 0, 0, 1, -1, -1}, 
     {2, 0, 0, 1, 1, 1}, 
     {0, 2, 1, 2, -1, -1}, 
     {2, 2, 2, 2, 2, 2}, 
@@ -243,28 +273,27 @@ CEdge MeshGraphRegular3DTets::Edge(EdgeIdType id, bool nodes_only) const
 
   for (int p=0; p<6; p++) {
     if (contained_faces_chi[t][p] != 0) {
-      edge.contained_faces.push_back(fidx2fid(contained_faces_fidx[t][p]));
-      edge.contained_faces_chirality.push_back(contained_faces_chi[t][p]);
-      edge.contained_faces_eid.push_back(contained_faces_eid[t][p]);
+      const int q = edge.ncontained_faces ++;
+      edge.contained_faces[q] = fidx2fid(contained_faces_fidx[t][p]);
+      edge.contained_faces_chirality[q] = contained_faces_chi[t][p];
+      edge.contained_faces_eid[q] = contained_faces_eid[t][p];
     }
   }
-
-  return edge;
 }
 
 EdgeIdType MeshGraphRegular3DTets::NEdges() const
 {
-  return NCells()*7;
+  return d[0]*d[1]*d[2]*7;
 }
 
 EdgeIdType MeshGraphRegular3DTets::NFaces() const
 {
-  return NCells()*12;
+  return d[0]*d[1]*d[2]*12;
 }
 
 EdgeIdType MeshGraphRegular3DTets::NCells() const
 {
-  return d[0]*d[1]*d[2];
+  return d[0]*d[1]*d[2]*6;
 }
 
 void MeshGraphRegular3DTets::eid2eidx(unsigned int id, int idx[4]) const
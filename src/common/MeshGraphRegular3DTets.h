@@ -28,6 +28,10 @@ public:
   CEdge Edge(EdgeIdType i, bool nodes_only=false) const;
   CFace Face(FaceIdType i, bool nodes_only=false) const;
   CCell Cell(CellIdType i, bool nodes_only=false) const;
+
+  void EdgeView(EdgeIdType i, CEdgeView&, bool nodes_only=false) const;
+  void FaceView(FaceIdType i, CFaceView&, bool nodes_only=false) const;
+  void CellView(CellIdType i, CCellView&, bool nodes_only=false) const;
 };
 
 #endif
@@ -2,8 +2,9 @@
 #define _PUNCTURE_H
 
 #include <map>
-#include <bitset>
+#include <string>
 #include "def.h"
+#include "common/FlatMap.h"
 
 struct PuncturedFace
 {
@@ -19,26 +20,30 @@ struct PuncturedEdge
 
 struct PuncturedCell
 {
+  PuncturedCell() : p(0), c(0) {}
+
   ChiralityType Chirality(int face) const {
-    if (!p[face]) return 0; 
-    else return c[face] ? 1 : -1;
+    if (!(p & (1<<face))) return 0; 
+    else return (c & (1<<face)) ? 1 : -1;
   }
 
   void SetChirality(int face, ChiralityType chirality) {
-    p[face] = 1;
-    if (chirality>0) c[face] = 1;
+    p |= 1<<face;
+    if (chirality>0) c |= 1<<face;
   }
 
   bool IsSpecial() const {return Degree()>2;}
   // bool IsSpecial() const {return Degree() > 0 && Degree() != 2;}
-  int Degree() const {return p.count();}
+  int Degree() const {return __builtin_popcount(p);}
 
 private:
-  std::bitset<8> p, c;
-  // std::bitset<16> bits;
-  // int chiralities[6]; // chiralities on faces
+  unsigned char p, c; // punctured and chirality bits of up to 8 faces
 };
 
+typedef FlatMap<FaceIdType, PuncturedFace> PuncturedFaceMap; // 20 bytes per face
+typedef FlatMap<EdgeIdType, PuncturedEdge> PuncturedEdgeMap;
+typedef FlatMap<CellIdType, PuncturedCell> PuncturedCellMap;
+
 //////// I/O for faces
 bool SerializePuncturedFaces(const std::map<FaceIdType, PuncturedFace> m, std::string &buf);
 bool UnserializePuncturedFaces(std::map<FaceIdType, PuncturedFace> &m, const std::string &buf);
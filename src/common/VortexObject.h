@@ -3,19 +3,110 @@
 
 #include <set>
 #include <list>
+#include <vector>
+#include <algorithm>
 #include <climits>
 #include "def.h"
+#include "FrameArena.h"
+#include "common/diy-ext.hpp"
 
+// a vortex object is a set of traces, i.e. lines of punctured faces.  the
+// faces of all traces are stored back to back in trace_faces, trace i being
+// [trace_offsets[i], trace_offsets[i+1]); faces holds the same faces sorted
+// and unique for the membership tests.
 struct VortexObject {
+  // arrays are allocated on the arena of the timestep if given, copies of
+  // the object are on the heap
+  typedef std::vector<FaceIdType, ArenaAllocator<FaceIdType> > FaceArray;
+  typedef std::vector<unsigned int, ArenaAllocator<unsigned int> > OffsetArray;
+
   int gid, id; // gid: global id; id: local (time) id
   int timestep;
   bool loop;
 
-  // std::map<FaceIdType, PuncturedFace> faces;
-  std::set<FaceIdType> faces;
-  std::vector<std::list<FaceIdType> > traces;
+  FaceArray faces; // sorted, unique
+  FaceArray trace_faces;
+  OffsetArray trace_offsets; // NumberOfTraces()+1 entries starting with 0, or empty
 
   VortexObject() : id(INT_MAX), gid(INT_MAX), loop(false) {}
+  explicit VortexObject(FrameArena *arena) :
+    id(INT_MAX), gid(INT_MAX), loop(false),
+    faces(ArenaAllocator<FaceIdType>(arena)),
+    trace_faces(ArenaAllocator<FaceIdType>(arena)),
+    trace_offsets(ArenaAllocator<unsigned int>(arena)) {}
+
+  size_t NumberOfTraces() const {return trace_offsets.empty() ? 0 : trace_offsets.size() - 1;}
+  const FaceIdType* TraceBegin(size_t i) const {return trace_faces.data() + trace_offsets[i];}
+  const FaceIdType* TraceEnd(size_t i) const {return trace_faces.data() + trace_offsets[i+1];}
+
+  bool HasFace(FaceIdType f) const {return std::binary_search(faces.begin(), faces.end(), f);}
+
+  // appends a trace, faces are updated by UpdateFaces() after the last one
+  void AddTrace(const FaceIdType *begin, const FaceIdType *end) {
+    if (trace_offsets.empty()) trace_offsets.push_back(0);
+    trace_faces.insert(trace_faces.end(), begin, end);
+    trace_offsets.push_back(trace_faces.size());
+  }
+  void UpdateFaces() {
+    faces.assign(trace_faces.begin(), trace_faces.end());
+    std::sort(faces.begin(), faces.end());
+    faces.erase(std::unique(faces.begin(), faces.end()), faces.end());
+  }
+
+  // conversions from/to the node-based layout
+  void SetTraces(const std::vector<std::list<FaceIdType> >& traces) {
+    trace_faces.clear();
+    trace_offsets.assign(1, 0);
+    for (size_t i=0; i<traces.size(); i++) {
+      trace_faces.insert(trace_faces.end(), traces[i].begin(), traces[i].end());
+      trace_offsets.push_back(trace_faces.size());
+    }
+    UpdateFaces();
+  }
+  std::vector<std::list<FaceIdType> > Traces() const {
+    std::vector<std::list<FaceIdType> > traces(NumberOfTraces());
+    for (size_t i=0; i<traces.size(); i++)
+      traces[i].assign(TraceBegin(i), TraceEnd(i));
+    return traces;
+  }
+  std::set<FaceIdType> FaceSet() const {return std::set<FaceIdType>(faces.begin(), faces.end());}
 };
 
+namespace diy {
+  template <> struct Serialization<VortexObject> {
+    template <typename V> static void save_array(diy::BinaryBuffer& bb, const V& v) {
+      const size_t n = v.size();
+      diy::save(bb, n);
+      if (n > 0) bb.save_binary((const char*)v.data(), n * sizeof(typename V::value_type));
+    }
+
+    template <typename V> static void load_array(diy::BinaryBuffer& bb, V& v) {
+      size_t n;
+      diy::load(bb, n);
+      v.resize(n);
+      if (n > 0) bb.load_binary((char*)v.data(), n * sizeof(typename V::value_type));
+    }
+
+    static void save(diy::BinaryBuffer& bb, const VortexObject& m) {
+      diy::save(bb, m.gid);
+      diy::save(bb, m.id);
+      diy::save(bb, m.timestep);
+      diy::save(bb, m.loop);
+      save_array(bb, m.faces);
+      save_array(bb, m.trace_faces);
+      save_array(bb, m.trace_offsets);
+    }
+
+    static void load(diy::BinaryBuffer& bb, VortexObject& m) {
+      diy::load(bb, m.gid);
+      diy::load(bb, m.id);
+      diy::load(bb, m.timestep);
+      diy::load(bb, m.loop);
+      load_array(bb, m.faces);
+      load_array(bb, m.trace_faces);
+      load_array(bb, m.trace_offsets);
+    }
+  };
+}
+
 #endif
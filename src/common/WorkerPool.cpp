@@ -0,0 +1,141 @@
+#include "WorkerPool.h"
+#include <algorithm>
+
+static inline unsigned long long pack_range(unsigned int lo, unsigned int hi)
+{
+  return ((unsigned long long)hi << 32) | lo;
+}
+
+static inline void unpack_range(unsigned long long r, unsigned int &lo, unsigned int &hi)
+{
+  lo = r & 0xffffffffu;
+  hi = r >> 32;
+}
+
+WorkerPool::WorkerPool(int nthreads) :
+  _nthreads(std::max(nthreads, 1)),
+  _generation(0),
+  _nbusy(0),
+  _quit(false),
+  _func(NULL),
+  _n(0), _chunk_size(1),
+  _ranges(_nthreads * RANGE_STRIDE)
+{
+  for (int i=1; i<_nthreads; i++)
+    _threads.push_back(std::thread(&WorkerPool::worker, this, i));
+}
+
+WorkerPool::~WorkerPool()
+{
+  {
+    std::unique_lock<std::mutex> lock(_mutex);
+    _quit = true;
+  }
+  _cond_start.notify_all();
+
+  for (size_t i=0; i<_threads.size(); i++)
+    _threads[i].join();
+}
+
+void WorkerPool::ParallelFor(size_t n, size_t chunk_size, const Func& f)
+{
+  if (n == 0) return;
+  if (chunk_size == 0) chunk_size = 1;
+
+  const size_t nchunks = (n + chunk_size - 1) / chunk_size;
+  if (_nthreads == 1 || nchunks == 1) {
+    for (size_t i=0; i<n; i+=chunk_size)
+      f(0, i, std::min(n, i+chunk_size));
+    return;
+  }
+
+  {
+    std::unique_lock<std::mutex> lock(_mutex);
+    _func = &f;
+    _n = n;
+    _chunk_size = chunk_size;
+    for (int i=0; i<_nthreads; i++) { // contiguous initial partition
+      const unsigned int lo = nchunks * i / _nthreads,
+                         hi = nchunks * (i+1) / _nthreads;
+      _ranges[i*RANGE_STRIDE].store(pack_range(lo, hi));
+    }
+    _nbusy = _nthreads - 1;
+    _generation ++;
+  }
+  _cond_start.notify_all();
+
+  run(0);
+
+  std::unique_lock<std::mutex> lock(_mutex);
+  while (_nbusy > 0)
+    _cond_done.wait(lock);
+  _func = NULL;
+}
+
+void WorkerPool::worker(int tid)
+{
+  unsigned long generation = 0;
+
+  while (1) {
+    {
+      std::unique_lock<std::mutex> lock(_mutex);
+      while (_generation == generation && !_quit)
+        _cond_start.wait(lock);
+      if (_quit) return;
+      generation = _generation;
+    }
+
+    run(tid);
+
+    {
+      std::unique_lock<std::mutex> lock(_mutex);
+      if (--_nbusy == 0)
+        _cond_done.notify_one();
+    }
+  }
+}
+
+void WorkerPool::run(int tid)
+{
+  unsigned int chunk;
+  while (take(tid, chunk) || steal(tid, chunk)) {
+    const size_t i0 = chunk * _chunk_size,
+                 i1 = std::min(_n, i0 + _chunk_size);
+    (*_func)(tid, i0, i1);
+  }
+}
+
+bool WorkerPool::take(int tid, unsigned int &chunk)
+{
+  std::atomic<unsigned long long> &r = _ranges[tid*RANGE_STRIDE];
+  unsigned long long v = r.load();
+  unsigned int lo, hi;
+
+  while (1) {
+    unpack_range(v, lo, hi);
+    if (lo >= hi) return false;
+    if (r.compare_exchange_weak(v, pack_range(lo+1, hi))) {
+      chunk = lo;
+      return true;
+    }
+  }
+}
+
+bool WorkerPool::steal(int tid, unsigned int &chunk)
+{
+  for (int k=1; k<_nthreads; k++) {
+    std::atomic<unsigned long long> &r = _ranges[((tid+k) % _nthreads) * RANGE_STRIDE];
+    unsigned long long v = r.load();
+    unsigned int lo, hi;
+
+    while (1) {
+      unpack_range(v, lo, hi);
+      if (lo >= hi) break;
+      if (r.compare_exchange_weak(v, pack_range(lo, hi-1))) {
+        chunk = hi-1;
+        return true;
+      }
+    }
+  }
+  return false;
+}
@@ -0,0 +1,49 @@
+#ifndef _WORKERPOOL_H
+#define _WORKERPOOL_H
+
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+
+// persistent pool of worker threads.  a parallel loop is cut into chunks;
+// each worker owns a contiguous range of chunks and takes them from the
+// front, idle workers steal from the back of the others' ranges.
+class WorkerPool {
+public:
+  explicit WorkerPool(int nthreads);
+  ~WorkerPool();
+
+  int NumberOfThreads() const {return _nthreads;}
+
+  // calls f(tid, i0, i1) on chunks of [0, n) and returns when all are done.
+  // the calling thread works as tid 0.
+  typedef std::function<void(int tid, size_t i0, size_t i1)> Func;
+  void ParallelFor(size_t n, size_t chunk_size, const Func& f);
+
+private:
+  void worker(int tid);
+  void run(int tid);
+  bool take(int tid, unsigned int &chunk);
+  bool steal(int tid, unsigned int &chunk);
+
+private:
+  const int _nthreads;
+  std::vector<std::thread> _threads;
+
+  std::mutex _mutex;
+  std::condition_variable _cond_start, _cond_done;
+  unsigned long _generation;
+  int _nbusy;
+  bool _quit;
+
+  // current loop
+  const Func *_func;
+  size_t _n, _chunk_size;
+  enum {RANGE_STRIDE = 8}; // one cache line per worker
+  std::vector<std::atomic<unsigned long long> > _ranges; // packed [lo, hi) of chunk ids
+};
+
+#endif
@@ -0,0 +1,106 @@
+#include "BrickScreen.h"
+#include <cmath>
+#include <algorithm>
+
+// margin to the classification thresholds, covers the rounding differences
+// to the scalar face check
+static const float margin = 1e-2f;
+static const int max_face_edges = 4;
+
+static inline void node_A(const brick_screen_hdr_t &h, const float X[3], float A[3])
+{
+  // see GLGPUDataset::A()
+  if (h.B[1]>0) {
+    A[0] = -h.Kx;
+    A[1] = X[0] * h.B[2];
+    A[2] = -X[0] * h.B[1];
+  } else {
+    A[0] = -X[1] * h.B[2] - h.Kx;
+    A[1] = 0;
+    A[2] = X[1] * h.B[0];
+  }
+}
+
+// the phases are transformed with chi(X) = Ac.(X - Xc), Ac being the vector
+// potential at the brick center.  the gauge-corrected jump of an edge is then
+// mod2pi1(theta1 - theta0 + r), where r = (Ac - (A0+A1)/2).dX is bounded by G
+// as A is affine.  if all theta lie within an arc of width pi-G, no jump
+// wraps around, the jumps of a face sum up to the sum of its r, and the face
+// is not punctured as long as max_face_edges*G < pi.
+bool brick_may_be_punctured(
+    const brick_screen_hdr_t &h,
+    const int lo[3], const int hi[3],
+    std::vector<float> &scratch)
+{
+  const int n[3] = {hi[0]-lo[0]+1, hi[1]-lo[1]+1, hi[2]-lo[2]+1};
+
+  float Xc[3], Ac[3] = {0, 0, 0}, G = 0;
+  for (int q=0; q<3; q++)
+    Xc[q] = 0.5f * (lo[q] + hi[q]) * h.cell_lengths[q] + h.origins[q];
+
+  if (h.gauge) {
+    node_A(h, Xc, Ac);
+    float dA[3] = {0, 0, 0};
+    for (int c=0; c<8; c++) {
+      float X[3], A[3];
+      for (int q=0; q<3; q++)
+        X[q] = ((c >> q) & 1 ? hi[q] : lo[q]) * h.cell_lengths[q] + h.origins[q];
+      node_A(h, X, A);
+      for (int q=0; q<3; q++)
+        dA[q] = std::max(dA[q], fabsf(A[q] - Ac[q]));
+    }
+    for (int q=0; q<3; q++)
+      G += dA[q] * h.cell_lengths[q];
+  }
+  if (!(max_face_edges * G < (float)M_PI - margin)) return true;
+
+  // max. angle between a node and the mean direction
+  const float cos_lim = cosf(0.5f * ((float)M_PI - margin - G));
+
+  // exp(-i*chi) separated by axis
+  scratch.resize(2*(n[0]+n[1]+n[2]) + 2*n[0]*n[1]*n[2]);
+  float *ph[3] = {&scratch[0], &scratch[2*n[0]], &scratch[2*(n[0]+n[1])]},
+        *u = &scratch[2*(n[0]+n[1]+n[2])];
+  for (int q=0; q<3; q++)
+    for (int i=0; i<n[q]; i++) {
+      const float chi = Ac[q] * ((lo[q]+i) * h.cell_lengths[q] + h.origins[q] - Xc[q]);
+      ph[q][2*i] = cosf(chi);
+      ph[q][2*i+1] = -sinf(chi);
+    }
+
+  // transformed and normalized values, and their mean direction
+  float sr = 0, si = 0;
+  size_t m = 0;
+  for (int k=0; k<n[2]; k++)
+    for (int j=0; j<n[1]; j++) {
+      const float *a = &ph[1][2*j], *b = &ph[2][2*k];
+      const float wr = a[0]*b[0] - a[1]*b[1],
+                  wi = a[0]*b[1] + a[1]*b[0];
+      const size_t off = lo[0] + h.d[0] * ((size_t)(lo[1]+j) + h.d[1] * (size_t)(lo[2]+k));
+      for (int i=0; i<n[0]; i++, m++) {
+        const float *c = &ph[0][2*i];
+        const float zr = wr*c[0] - wi*c[1],
+                    zi = wr*c[1] + wi*c[0];
+        const float R = h.re[off+i], I = h.im[off+i];
+        const float pr = R*zr - I*zi,
+                    pi = R*zi + I*zr;
+        const float r2 = pr*pr + pi*pi;
+        if (!(r2 > 0)) return true; // rho vanishes, phase undefined
+        const float s = 1.f / sqrtf(r2);
+        u[2*m] = pr * s;
+        u[2*m+1] = pi * s;
+        sr += u[2*m];
+        si += u[2*m+1];
+      }
+    }
+
+  const float norm = sqrtf(sr*sr + si*si);
+  if (!(norm > 0)) return true;
+  sr /= norm;
+  si /= norm;
+
+  for (size_t p=0; p<m; p++)
+    if (!(u[2*p]*sr + u[2*p+1]*si >= cos_lim)) return true;
+
+  return false;
+}
@@ -0,0 +1,31 @@
+#ifndef _BRICKSCREEN_H
+#define _BRICKSCREEN_H
+
+#include <vector>
+
+// coarse screening of bricks of a regular grid (GLGPU3DDataset, no pbc)
+// before the face checks.  after a gauge transformation that is linear over
+// the brick, the phases of all nodes must lie within an arc that is narrow
+// enough that no face with nodes in the brick can wind.  the test is
+// conservative: a rejected brick provably contains no punctured face, for
+// both meshes and for phi- and re/im-based phase jumps.  bricks around
+// vortex cores, where rho is small and the phase spreads, are kept.
+
+typedef struct {
+  int d[3]; // all >= 3
+  float origins[3];
+  float cell_lengths[3];
+  float B[3];
+  float Kx;
+  bool gauge;
+  const float *re, *im;
+} brick_screen_hdr_t;
+
+// whether a face with all its nodes in [lo, hi] (node indices, inclusive)
+// may be punctured
+bool brick_may_be_punctured(
+    const brick_screen_hdr_t &h,
+    const int lo[3], const int hi[3],
+    std::vector<float> &scratch);
+
+#endif
@@ -2,30 +2,107 @@
 #include "common/Utils.hpp"
 #include "common/VortexTransition.h"
 #include "common/MeshGraphRegular3DTets.h"
+#include "common/WorkerPool.h"
 #include "io/GLDataset.h"
 #include "io/GLGPU3DDataset.h"
+#include "FaceKernel.h"
+#include "BrickScreen.h"
 #include <pthread.h>
 #include <set>
+#include <algorithm>
 #include <climits>
 #include <cstdio>
 #include <cstdlib>
 #include <cassert>
 #include <cstring>
 
-#if WITH_CUDA
 #include "vfgpu/vfgpu.h"
-#endif
 
 #include <thread>
 #include <chrono>
 
-typedef struct {
-  VortexExtractor *extractor;
-  int nthreads; 
-  int tid;
-  int type; // 0: face; 1: edge
-  int slot;
-} extractor_thread_t;
+// chunk sizes of the parallel loops, in number of elements 
+static const size_t face_chunk_size = 4096, 
+                    edge_chunk_size = 4096,
+                    cell_chunk_size = 1024,
+                    edge_phase_chunk_size = 8192,
+                    face_row_chunk_size = 16,
+                    relation_chunk_size = 1024,
+                    component_chunk_size = 16,
+                    brick_chunk_size = 4;
+
+// pruned edge extraction falls back to the full sweep if the neighborhood
+// of the punctured faces covers more than this fraction of the cells
+static const float edge_pruning_max_density = 0.25f;
+
+// arg(psi1 * conj(psi0) * exp(-i*g)), i.e. mod2pi1(phi1 - phi0 - g)
+static inline float phase_jump(float re0, float im0, float re1, float im1, float g)
+{
+  const float zr = re1*re0 + im1*im0, 
+              zi = im1*re0 - re1*im0;
+  return mod2pi1(atan2(zi, zr) - g);
+}
+
+// lock-free union-find.  the larger root is linked to the smaller one, so
+// the root of a set is its smallest element regardless of the order of the
+// unions.
+static unsigned int uf_find(unsigned int *parent, unsigned int x)
+{
+  for (;;) {
+    unsigned int y = __atomic_load_n(&parent[x], __ATOMIC_RELAXED);
+    if (y == x) return x;
+    unsigned int z = __atomic_load_n(&parent[y], __ATOMIC_RELAXED);
+    if (z != y) // path halving, z is an ancestor of y
+      __atomic_compare_exchange_n(&parent[x], &y, z, false, __ATOMIC_RELAXED, __ATOMIC_RELAXED);
+    x = z;
+  }
+}
+
+static void uf_union(unsigned int *parent, unsigned int a, unsigned int b)
+{
+  for (;;) {
+    a = uf_find(parent, a);
+    b = uf_find(parent, b);
+    if (a == b) return;
+    if (a < b) std::swap(a, b);
+    if (__atomic_compare_exchange_n(&parent[a], &a, b, false, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+      return;
+  }
+}
+
+struct SpaceTraceScratch { // per-thread buffers of the space tracing, kept across timesteps
+  PuncturedCellMap ordinary_pcells, special_pcells;
+  std::vector<bool> ordinary_erased; // already traced
+  std::vector<char> ordinary_visited; // visited by the current trace
+  std::vector<size_t> visited_cells; // indices of ordinary_pcells
+  std::vector<char> state; // of the cells of a component, 0: remaining; 1: visited; 2: assigned to an object
+  std::vector<unsigned int> to_visit;
+  std::vector<FaceIdType> trace_fwd, trace_bwd; // faces of the current trace, forward and backward from the seed
+  std::vector<FaceIdType> trace_faces; // traces of the current object
+  std::vector<unsigned int> trace_offsets;
+};
+
+// appends the per-thread lists to all and clears them.  each list keeps the
+// capacity of the whole, so that later frames with no more items do not
+// allocate, however the chunks fall on the threads
+template <typename T>
+static void gather_thread_lists(std::vector<std::vector<T> > &lists, std::vector<T> &all)
+{
+  for (size_t i=0; i<lists.size(); i++) {
+    all.insert(all.end(), lists[i].begin(), lists[i].end());
+    lists[i].clear();
+  }
+  for (size_t i=0; i<lists.size(); i++) 
+    if (lists[i].capacity() < all.size())
+      lists[i].reserve(all.size());
+}
+
+// vortex objects in the arenas must have been cleared
+static void reset_arenas(std::vector<FrameArena*> &arenas)
+{
+  for (size_t i=0; i<arenas.size(); i++) 
+    arenas[i]->Reset();
+}
 
 VortexExtractor::VortexExtractor() :
   _dataset(NULL), 
@@ -33,9 +110,17 @@ VortexExtractor::VortexExtractor() :
   _vfgpu_ctx(NULL),
   _archive(false), 
   _gpu(false),
+  _edge_centric(false),
+  _simd(false),
+  _edge_pruning(-1),
+  _complex_phase(false),
+  _brick_size(0),
+  _hybrid(false),
   _pertubation(0),
+  _pertubation_seed(1234),
   _extent_threshold(0),
-  _interpolation_mode(INTERPOLATION_TRI_BARYCENTRIC | INTERPOLATION_QUAD_BILINEAR)
+  _interpolation_mode(INTERPOLATION_TRI_BARYCENTRIC | INTERPOLATION_QUAD_BILINEAR),
+  _pool(NULL)
 {
   pthread_mutex_init(&_mutex, NULL);
 
@@ -48,17 +133,37 @@ VortexExtractor::VortexExtractor() :
 VortexExtractor::~VortexExtractor()
 {
   pthread_mutex_destroy(&_mutex);
+  delete _pool;
+
+  _vortex_objects.clear(); // before their arenas
+  _vortex_objects1.clear();
+  _thread_vobjs.clear();
+  for (size_t i=0; i<_vobj_arenas.size(); i++) delete _vobj_arenas[i];
+  for (size_t i=0; i<_vobj_arenas1.size(); i++) delete _vobj_arenas1[i];
+  for (size_t i=0; i<_thread_sts.size(); i++) delete _thread_sts[i];
 
-#ifdef WITH_CUDA
-  if (_gpu && _vfgpu_ctx)
+  if (_vfgpu_ctx) // also made by the multi extraction without SetGPU()
     vfgpu_destroy_ctx(_vfgpu_ctx);
-#endif
+}
+
+size_t VortexExtractor::NumberOfArenaAllocations() const
+{
+  size_t n = 0;
+  for (size_t i=0; i<_vobj_arenas.size(); i++) n += _vobj_arenas[i]->NumberOfHeapAllocations();
+  for (size_t i=0; i<_vobj_arenas1.size(); i++) n += _vobj_arenas1[i]->NumberOfHeapAllocations();
+  return n;
 }
 
 void VortexExtractor::SetNumberOfThreads(int n)
 {
-  if (n<1) _nthreads = 1;
-  else _nthreads = n;
+  if (n<1) n = 1;
+  if (_pool && _pool->NumberOfThreads() != n) {
+    delete _pool;
+    _pool = NULL;
+  }
+  _nthreads = n;
+  if (_vfgpu_ctx)
+    vfgpu_set_number_of_threads(_vfgpu_ctx, n);
 }
 
 void VortexExtractor::SetDataset(const GLDatasetBase* ds)
@@ -81,11 +186,48 @@ void VortexExtractor::SetGPU(bool g)
   _gpu = g;
 }
 
+void VortexExtractor::SetEdgeCentric(bool e)
+{
+  _edge_centric = e;
+}
+
+void VortexExtractor::SetSIMD(bool s)
+{
+  _simd = s;
+}
+
+void VortexExtractor::SetEdgePruning(int k)
+{
+  _edge_pruning = k;
+}
+
+void VortexExtractor::SetComplexPhase(bool c)
+{
+  _complex_phase = c;
+}
+
+void VortexExtractor::SetBrickScreening(int size)
+{
+  _brick_size = size;
+}
+
+void VortexExtractor::SetHybrid(bool h)
+{
+  _hybrid = h;
+}
+
 void VortexExtractor::SetPertubation(float p)
 {
   _pertubation = p;
 }
 
+void VortexExtractor::SetPertubationSeed(unsigned int s)
+{
+  _pertubation_seed = s;
+  if (_vfgpu_ctx)
+    vfgpu_set_seed(_vfgpu_ctx, s);
+}
+
 void VortexExtractor::SetExtentThreshold(float threshold)
 {
   _extent_threshold = threshold;
@@ -101,7 +243,7 @@ void VortexExtractor::SaveVortexLines(int slot)
     slot == 0 ? _vortex_objects : _vortex_objects1;
   std::vector<VortexLine> &vlines = 
     slot == 0 ? _vortex_lines : _vortex_lines1;
-  std::map<FaceIdType, PuncturedFace> &pfs =
+  PuncturedFaceMap &pfs =
     slot == 0 ? _punctured_faces : _punctured_faces1;
 
   VortexObjectsToVortexLines(pfs, vobjs, vlines);
@@ -121,7 +263,7 @@ std::vector<VortexLine> VortexExtractor::GetVortexLines(int slot)
   
   std::vector<VortexObject> &vobjs = 
     slot == 0 ? _vortex_objects : _vortex_objects1;
-  std::map<FaceIdType, PuncturedFace> &pfs =
+  PuncturedFaceMap &pfs =
     slot == 0 ? _punctured_faces : _punctured_faces1;
 
   VortexObjectsToVortexLines(pfs, vobjs, vlines);
@@ -134,7 +276,7 @@ void VortexExtractor::VortexObjectsToVortexLines(int slot)
     slot == 0 ? _vortex_objects : _vortex_objects1;
   std::vector<VortexLine> &vlines = 
     slot == 0 ? _vortex_lines : _vortex_lines1;
-  std::map<FaceIdType, PuncturedFace> &pfs =
+  PuncturedFaceMap &pfs =
     slot == 0 ? _punctured_faces : _punctured_faces1;
 
   VortexObjectsToVortexLines(pfs, vobjs, vlines);
@@ -153,6 +295,8 @@ void VortexExtractor::Clear()
 
   _vortex_objects.clear();
   _vortex_objects1.clear();
+  reset_arenas(_vobj_arenas);
+  reset_arenas(_vobj_arenas1);
   _vortex_lines.clear();
   _vortex_lines1.clear();
 }
@@ -162,7 +306,8 @@ bool VortexExtractor::SavePuncturedEdges() const
   const GLDatasetBase *ds = _dataset;
   std::ostringstream os; 
   os << ds->DataName() << ".pe." << ds->TimeStep(0) << "." << ds->TimeStep(1);
-  return ::SavePuncturedEdges(_punctured_edges, os.str());
+  std::map<EdgeIdType, PuncturedEdge> m(_punctured_edges.begin(), _punctured_edges.end());
+  return ::SavePuncturedEdges(m, os.str());
 }
 
 bool VortexExtractor::SavePuncturedFaces(int slot) const
@@ -170,8 +315,9 @@ bool VortexExtractor::SavePuncturedFaces(int slot) const
   const GLDatasetBase *ds = _dataset;
   std::ostringstream os; 
   os << ds->DataName() << ".pf." << ds->TimeStep(slot);
-  bool succ = ::SavePuncturedFaces(
-      slot == 0 ? _punctured_faces : _punctured_faces1, os.str());
+  const PuncturedFaceMap &pfs = slot == 0 ? _punctured_faces : _punctured_faces1;
+  std::map<FaceIdType, PuncturedFace> m(pfs.begin(), pfs.end());
+  bool succ = ::SavePuncturedFaces(m, os.str());
 
   if (!succ) 
     fprintf(stderr, "failed to read punctured faces from file %s\n", os.str().c_str());
@@ -180,6 +326,8 @@ bool VortexExtractor::SavePuncturedFaces(int slot) const
 
 bool VortexExtractor::LoadPuncturedEdges()
 {
+  if (!_archive) return false;
+
   const GLDatasetBase *ds = _dataset;
   std::ostringstream os; 
   os << ds->DataName() << ".pe." << ds->TimeStep(0) << "." << ds->TimeStep(1);
@@ -187,14 +335,16 @@ bool VortexExtractor::LoadPuncturedEdges()
   std::map<EdgeIdType, PuncturedEdge> m;
   if (!::LoadPuncturedEdges(m, os.str())) return false;
   
-  for (std::map<EdgeIdType, PuncturedEdge>::iterator it = m.begin(); it != m.end(); it ++) 
-    AddPuncturedEdge(it->first, it->second.chirality, it->second.t);
+  std::vector<std::pair<EdgeIdType, PuncturedEdge> > all(m.begin(), m.end());
+  _punctured_edges.merge(all);
   
   return true;
 }
 
 bool VortexExtractor::LoadPuncturedFaces(int slot)
 {
+  if (!_archive) return false;
+
   const GLDatasetBase *ds = _dataset;
   std::ostringstream os; 
   os << ds->DataName() << ".pf." << ds->TimeStep(slot);
@@ -203,9 +353,9 @@ bool VortexExtractor::LoadPuncturedFaces(int slot)
 
   if (!::LoadPuncturedFaces(m, os.str())) return false;
 
-  for (std::map<FaceIdType, PuncturedFace>::iterator it = m.begin(); it != m.end(); it ++) {
-    AddPuncturedFace(it->first, slot, it->second.chirality, it->second.pos);
-  }
+  std::vector<std::pair<FaceIdType, PuncturedFace> > all(m.begin(), m.end());
+  (slot == 0 ? _punctured_faces : _punctured_faces1).merge(all);
+  BuildPuncturedCells(slot);
 
   return true;
 }
@@ -232,8 +382,9 @@ void VortexExtractor::AddPuncturedFace(FaceIdType id, int slot, ChiralityType ch
 
   // cell
   const MeshGraph *mg = _dataset->MeshGraph();
-  const CFace &face = mg->Face(id);
-  for (int i=0; i<face.contained_cells.size(); i++) {
+  CFaceView face;
+  mg->FaceView(id, face);
+  for (int i=0; i<face.ncontained_cells; i++) {
     CellIdType cid = face.contained_cells[i];
     if (cid == UINT_MAX) continue;
 
@@ -302,128 +453,93 @@ void VortexExtractor::RelateOverTime()
 {
   // fprintf(stderr, "Relating over time, #pf0=%ld, #pf1=%ld, #pe=%ld\n", 
   //     _punctured_faces.size(), _punctured_faces1.size(), _punctured_edges.size());
+  
+  // the space-time puncture graph connects faces to the punctured edges they
+  // contain.  a slot-0 face can only reach faces of its own component, so the
+  // graph is built once, labeled with a union-find, and the traversal from
+  // each slot-0 face only touches its component.  the traversal is the same
+  // depth-first search as before, which keeps the results identical.
   const MeshGraph *mg = _dataset->MeshGraph();
+  RelationGraph &g = _rel;
 
   _related_faces.clear();
 
-  for (std::map<FaceIdType, PuncturedFace>::iterator it = _punctured_faces.begin(); 
-       it != _punctured_faces.end(); it ++) 
-  {
-    // fprintf(stderr, "fid=%u\n", it->first);
-
-    std::vector<FaceIdType> related;
-    
-    std::list<FaceIdType> faces_to_visit;
-    std::list<int> faces_to_visit_chirality; // face chirality
-    std::list<float> faces_to_visit_time;
-    std::set<FaceIdType> faces_visited;
-    std::set<EdgeIdType> edges_visited;
-    
-    faces_to_visit.push_back(it->first);
-    faces_to_visit_chirality.push_back(it->second.chirality);
-    faces_to_visit_time.push_back(0);
-      
-    std::map<FaceIdType, FaceIdType> parent_map;
-    std::map<FaceIdType, std::pair<EdgeIdType, float> > parent_edge_map;
-
-    while (!faces_to_visit.empty()) {
-      FaceIdType current = faces_to_visit.front();
-      int current_chirality = faces_to_visit_chirality.front();
-      float current_time = faces_to_visit_time.front();
-
-      faces_to_visit.pop_front();
-      faces_to_visit_chirality.pop_front();
-      faces_to_visit_time.pop_front();
-
-      faces_visited.insert(current);
-           
-      // if (_punctured_faces1[current].chirality != 0 && _punctured_faces1[current].chirality != current_chirality)
-      //   fprintf(stderr, "chi not match: current_chi=%d, face_chi=%d\n", current_chirality, _punctured_faces1[current].chirality);
-
-      if (_punctured_faces1.find(current) != _punctured_faces1.end() && 
-          _punctured_faces1[current].chirality == current_chirality) 
-      {
-        related.push_back(current);
-#if 0 // for debug purposes, print traverse history
-        std::list<FaceIdType> history_faces;
-        std::list<std::tuple<EdgeIdType, float> > history_edges;
-
-        history_faces.push_back(current);
-        std::map<FaceIdType, FaceIdType>::iterator it = parent_map.find(current);
-        while (it != parent_map.end()) {
-          history_edges.push_front(parent_edge_map[it->first]);
-          history_faces.push_front(it->second);
-          it = parent_map.find(it->second);
-        }
-
-        if (history_faces.size() > 1) {
-          int i=0;
-          std::list<std::tuple<EdgeIdType, float> >::iterator it1 = history_edges.begin();
-          for (std::list<FaceIdType>::iterator it = history_faces.begin(); 
-               it != history_faces.end(); it ++) 
-          {
-            if (i<history_faces.size()-1) 
-              fprintf(stderr, "%u->(%u, %.2f)->", *it, std::get<0>(*it1), std::get<1>(*it1));
-            else 
-              fprintf(stderr, "%u\n", *it);
-            i++;
-            it1++;
-          }
-        }
-#endif
-      }
-
-      // add neighbors
-      const CFace &face = mg->Face(current);
-      for (int i=0; i<face.edges.size(); i++) {
-        // find punctured edges
-        EdgeIdType e = face.edges[i];
-        if (_punctured_edges.find(e) != _punctured_edges.end() && 
-            edges_visited.find(e) == edges_visited.end())
-        {
-          edges_visited.insert(e);
-          
-          const CEdge &edge = mg->Edge(e);
-          const PuncturedEdge& pe = _punctured_edges[e];
-          // if (current_time >= pe.t) continue; // time ascending order
-            
-          int echirality = face.edges_chirality[i] * pe.chirality;
-          if (current_chirality == echirality) { // this check is right
-            /// find neighbor faces who chontain this edge
-            for (int j=0; j<edge.contained_faces.size(); j++) {
-              if (faces_visited.find(edge.contained_faces[j]) == faces_visited.end()) { // not found in visited faces
-                // fprintf(stderr, "fid0=%u, chi=%d, found edge eid=%u, face_edge_chi=%d, edge_chi=%d, edge_contained_face=%u, edge_contained_face_chi=%d\n", 
-                //     current, current_chirality, e, face.edges_chirality[i], pe.chirality,  
-                //     edge.contained_faces[j], edge.contained_faces_chirality[j]);
-                faces_to_visit.push_front(edge.contained_faces[j]);
-                // faces_to_visit_chirality.push_front(-edge.contained_faces_chirality[j] * current_chirality);
-                faces_to_visit_chirality.push_front(-edge.contained_faces_chirality[j] * pe.chirality); 
-                // faces_to_visit_chirality.push_front(edge.contained_faces_chirality[j]);
-                faces_to_visit_time.push_front(pe.t);
-                parent_map[edge.contained_faces[j]] = current;
-                parent_edge_map[edge.contained_faces[j]] = std::make_pair(e, pe.t);
-              }
-            }
-          }
-        }
-      }
+  // faces around punctured edges
+  const size_t ne = _punctured_edges.size();
+  std::vector<FaceIdType> &edge_fids = g.edge_fids;
+  edge_fids.clear();
+  g.edge_off.assign(1, 0);
+  g.edge_fchi.clear();
+  CEdgeView edge;
+  for (size_t i=0; i<ne; i++) {
+    mg->EdgeView(_punctured_edges.at(i).first, edge);
+    for (int j=0; j<edge.ncontained_faces; j++) {
+      edge_fids.push_back(edge.contained_faces[j]);
+      g.edge_fchi.push_back(edge.contained_faces_chirality[j]);
     }
+    g.edge_off.push_back(edge_fids.size());
+  }
 
-    _related_faces[it->first] = related;
+  g.faces = edge_fids;
+  for (PuncturedFaceMap::const_iterator it = _punctured_faces.begin(); it != _punctured_faces.end(); it ++)
+    g.faces.push_back(it->first);
+  std::sort(g.faces.begin(), g.faces.end());
+  g.faces.erase(std::unique(g.faces.begin(), g.faces.end()), g.faces.end());
+  const size_t nf = g.faces.size();
+
+  g.edge_faces.resize(edge_fids.size());
+  for (size_t i=0; i<edge_fids.size(); i++)
+    g.edge_faces[i] = std::lower_bound(g.faces.begin(), g.faces.end(), edge_fids[i]) - g.faces.begin();
+
+  g.chi0.assign(nf, 0);
+  g.chi1.assign(nf, 0);
+  g.seed_face.clear();
+  for (size_t i=0, j=0; i<nf && j<_punctured_faces.size(); i++) 
+    if (g.faces[i] == _punctured_faces.at(j).first) {
+      g.chi0[i] = _punctured_faces.at(j++).second.chirality;
+      g.seed_face.push_back(i);
+    }
+  for (size_t i=0, j=0; i<nf && j<_punctured_faces1.size(); ) {
+    if (g.faces[i] < _punctured_faces1.at(j).first) i++;
+    else if (_punctured_faces1.at(j).first < g.faces[i]) j++;
+    else g.chi1[i++] = _punctured_faces1.at(j++).second.chirality;
+  }
 
-#if 0
-    // if (1) {
-    if (!(related.size() == 1 && it->first == related[0])) { // non-ordinary
-      fprintf(stderr, "fid=%u, related={", it->first);
-      for (int i=0; i<related.size(); i++)
-        if (i<related.size()-1)
-          fprintf(stderr, "%u, ", related[i]);
-        else 
-          fprintf(stderr, "%u", related[i]);
-      fprintf(stderr, "}\n");
+  // punctured edges of the faces and components
+  g.face_nedges.resize(nf);
+  g.face_edges.resize(nf * CFaceView::MAX_NODES);
+  g.face_echi.resize(nf * CFaceView::MAX_NODES);
+  g.parent.resize(nf + ne);
+  for (size_t i=0; i<nf+ne; i++)
+    g.parent[i] = i;
+  execute_threads(5, 0);
+
+  // slot-0 faces by component, components ordered by their smallest face
+  std::vector<unsigned int> &count = g.count;
+  count.assign(nf, 0);
+  for (size_t k=0; k<g.seed_face.size(); k++)
+    count[uf_find(g.parent.data(), g.seed_face[k])] ++;
+  g.comp_off.assign(1, 0);
+  for (size_t i=0; i<nf; i++)
+    if (count[i] > 0) {
+      g.comp_off.push_back(g.comp_off.back() + count[i]);
+      count[i] = g.comp_off[g.comp_off.size()-2];
     }
-#endif
+  g.comp_seeds.resize(g.seed_face.size());
+  for (size_t k=0; k<g.seed_face.size(); k++)
+    g.comp_seeds[count[uf_find(g.parent.data(), g.seed_face[k])] ++] = k;
+
+  g.face_stamp.assign(nf, 0);
+  g.edge_stamp.assign(ne, 0);
+  g.results.resize(g.seed_face.size());
+  execute_threads(6, 0);
+
+  for (size_t k=0; k<g.seed_face.size(); k++) {
+    const RelationGraph::Result &r = g.results[k];
+    _related_faces.append(_punctured_faces.at(k).first, _thread_related[r.tid].data() + r.off, r.cnt);
   }
+  for (size_t i=0; i<_thread_related.size(); i++)
+    _thread_related[i].clear();
 }
 
 #if 0
@@ -462,16 +578,24 @@ void VortexExtractor::TraceOverSpace(int slot)
     slot == 0 ? _vortex_objects : _vortex_objects1;
   std::vector<VortexLine> &vlines = 
     slot == 0 ? _vortex_lines : _vortex_lines1;
-  std::map<CellIdType, PuncturedCell> &pcs = 
+  const PuncturedCellMap &pcs = 
     slot == 0 ? _punctured_cells : _punctured_cells1;
-  std::map<FaceIdType, PuncturedFace> &pfs =
+  PuncturedFaceMap &pfs =
     slot == 0 ? _punctured_faces : _punctured_faces1;
   const MeshGraph *mg = _dataset->MeshGraph();
   
+  typedef std::chrono::high_resolution_clock clock;
+  auto t0 = clock::now();
+  const size_t a0 = NumberOfArenaAllocations();
+
   // fprintf(stderr, "tracing over space, #pcs=%ld, #pfs=%ld.\n", pcs.size(), pfs.size());
+
+  // faces and traces of the new objects go to the per-thread arenas of the slot
+  vobjs.clear();
+  reset_arenas(slot == 0 ? _vobj_arenas : _vobj_arenas1);
  
 #if 0
-  for (std::map<CellIdType, PuncturedCell>::iterator it = pcs.begin(); it != pcs.end(); it ++) {
+  for (PuncturedCellMap::const_iterator it = pcs.begin(); it != pcs.end(); it ++) {
     if (it->second.Degree() != 2) {
       const int cid = it->first;
       int cidx[4];
@@ -483,157 +607,234 @@ void VortexExtractor::TraceOverSpace(int slot)
   }
 #endif
 
+  // punctured cells are linked to the neighbors across their punctured
+  // faces.  links are not always mutual (e.g. across the boundary), so the
+  // serial search, which collects the cells reachable from the smallest
+  // remaining cell, depends on the order.  it never leaves a weakly connected
+  // component though: these are labeled with a union-find, and the search
+  // and the tracing run independently per component on the worker pool.
+  // objects are ordered by their seed cell, as in the serial search.
+  const CellIdType ncells = mg->NCells();
+  if (_cell_bits.capacity() < ncells) 
+    _cell_bits.resize(ncells);
+  for (PuncturedCellMap::const_iterator it = pcs.begin(); it != pcs.end(); it ++)
+    _cell_bits.set(it->first);
+
+  SpaceComponents &sc = _space;
+  sc.parent.resize(pcs.size());
+  for (size_t i=0; i<pcs.size(); i++)
+    sc.parent[i] = i;
+  sc.links.resize(pcs.size() * CCellView::MAX_FACES);
+  execute_threads(7, slot);
+
+  for (PuncturedCellMap::const_iterator it = pcs.begin(); it != pcs.end(); it ++)
+    _cell_bits.reset(it->first);
+
+  // cells by component, in ascending order
+  std::vector<unsigned int> &count = sc.count;
+  count.assign(pcs.size(), 0);
+  for (size_t i=0; i<pcs.size(); i++) 
+    count[uf_find(sc.parent.data(), i)] ++;
+  sc.comp_off.assign(1, 0);
+  for (size_t i=0; i<pcs.size(); i++) 
+    if (count[i] > 0) {
+      sc.comp_off.push_back(sc.comp_off.back() + count[i]);
+      count[i] = sc.comp_off[sc.comp_off.size()-2];
+    }
+  sc.comp_cells.resize(pcs.size());
+  for (size_t i=0; i<pcs.size(); i++)
+    sc.comp_cells[count[uf_find(sc.parent.data(), i)] ++] = i;
+  sc.local.resize(pcs.size());
+
+  execute_threads(8, slot);
+
+  // gather objects in the order of their seeds
+  std::vector<std::pair<unsigned int, std::pair<int, size_t> > > &order = sc.order;
+  order.clear();
+  for (size_t i=0; i<_thread_vobjs.size(); i++)
+    for (size_t j=0; j<_thread_vobjs[i].size(); j++)
+      order.push_back(std::make_pair(_thread_vobjs[i][j].first, std::make_pair(i, j)));
+  std::sort(order.begin(), order.end());
+
   vobjs.clear();
-  while (!pcs.empty()) {
-    /// 1. sort punctured cells into connected ordinary/special ones
-    std::list<CellIdType> to_visit;
-    std::set<CellIdType> visited;
-    
-    to_visit.push_back(pcs.begin()->first); 
-    std::map<CellIdType, PuncturedCell> ordinary_pcells, special_pcells;
+  vobjs.resize(order.size());
+  for (size_t i=0; i<order.size(); i++) {
+    vobjs[i] = std::move(_thread_vobjs[order[i].second.first][order[i].second.second].second);
+    // vobj.id = NewVortexId();
+    vobjs[i].id = i;  // local (time) id
+  }
+  for (size_t i=0; i<_thread_vobjs.size(); i++)
+    _thread_vobjs[i].clear();
 
-    while (!to_visit.empty()) { // depth-first search
-      CellIdType c = to_visit.front();
-      to_visit.pop_front();
-    
-      const PuncturedCell &pcell = pcs[c];
-      const CCell &cell = mg->Cell(c);
+  // fprintf(stderr, "#vortex_objs=%ld\n", vobjs.size());
 
-      if (pcell.IsSpecial()) {
-        // fprintf(stderr, "cid=%d, deg=%d\n", c, pcell.Degree());
-        special_pcells[c] = pcell;
-      }
-      else 
-        ordinary_pcells[c] = pcell;
-      visited.insert(c);
-
-      for (int i=0; i<cell.neighbor_cells.size(); i++) {
-        CellIdType c1 = cell.neighbor_cells[i];
-        if (c1 != UINT_MAX                            // valid neighbor cell
-            && pcell.Chirality(i) != 0                // corresponding face punctured
-            && pcs.find(c1) != pcs.end()              // neighbor cell punctured
-            && visited.find(c1) == visited.end())     // not visited
-        {
-          to_visit.push_back(c1);
-        }
-      }
-    }
-  
-    for (std::set<CellIdType>::iterator it = visited.begin(); it != visited.end(); it ++)
-      pcs.erase(*it);
-    visited.clear();
+  auto t1 = clock::now();
+  float elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(t1 - t0).count() / 1000000000.0; 
+  fprintf(stderr, "t_space=%f, n_arena=%zu\n", elapsed, NumberOfArenaAllocations() - a0);
+}
 
-    // fprintf(stderr, "#ordinary=%ld, #special=%ld\n", ordinary_pcells.size(), special_pcells.size());
-    // if (special_pcells.size()>0) 
-    //   fprintf(stderr, "SPECIAL\n");
+// traces the lines of connected punctured cells, cells are indices of pcs in
+// ascending order
+static void trace_component(
+    const MeshGraph *mg, const PuncturedCellMap &pcs, 
+    const unsigned int *cells, size_t n, 
+    SpaceTraceScratch &sts, VortexObject &vobj)
+{
+  PuncturedCellMap &ordinary_pcells = sts.ordinary_pcells, 
+                   &special_pcells = sts.special_pcells;
+  std::vector<bool> &ordinary_erased = sts.ordinary_erased;
+  std::vector<char> &ordinary_visited = sts.ordinary_visited;
+  std::vector<size_t> &visited_cells = sts.visited_cells;
+  std::vector<FaceIdType> &trace_fwd = sts.trace_fwd, &trace_bwd = sts.trace_bwd;
+  CCellView cell;
+
+  // traces are collected in the scratch and copied to the object at once
+  sts.trace_faces.clear();
+  sts.trace_offsets.assign(1, 0);
+
+  /// sort punctured cells into ordinary/special ones
+  ordinary_pcells.clear();
+  special_pcells.clear();
+  for (size_t q=0; q<n; q++) {
+    const PuncturedCellMap::value_type &p = pcs.at(cells[q]);
+    if (p.second.IsSpecial()) 
+      special_pcells[p.first] = p.second;
+    else 
+      ordinary_pcells[p.first] = p.second;
+  }
+  ordinary_erased.assign(ordinary_pcells.size(), false);
+  ordinary_visited.assign(ordinary_pcells.size(), 0);
+
+  // fprintf(stderr, "#ordinary=%ld, #special=%ld\n", ordinary_pcells.size(), special_pcells.size());
+  // if (special_pcells.size()>0) 
+  //   fprintf(stderr, "SPECIAL\n");
+
+  // punctured, ordinary, and not yet traced
+  auto find_ordinary = [&](CellIdType c) -> PuncturedCellMap::const_iterator {
+    PuncturedCellMap::const_iterator it = ordinary_pcells.find(c);
+    if (it == ordinary_pcells.end() || ordinary_erased[ordinary_pcells.index(it)]) return ordinary_pcells.end();
+    else return it;
+  };
+  // only ordinary cells of the component are ever visited
+  auto is_visited = [&](CellIdType c) {
+    PuncturedCellMap::const_iterator it = ordinary_pcells.find(c);
+    return it != ordinary_pcells.end() && ordinary_visited[ordinary_pcells.index(it)];
+  };
+  auto visit = [&](CellIdType c) {
+    const size_t i = ordinary_pcells.index(ordinary_pcells.find(c));
+    if (ordinary_visited[i]) return;
+    ordinary_visited[i] = 1;
+    visited_cells.push_back(i);
+  };
 
-    /// 2. trace vortex lines
-    VortexObject vobj; 
+  /// 2. trace vortex lines
+  /// 2.2 trace backward and forward
+  for (size_t s=0; s<ordinary_pcells.size(); s++) {
+    if (ordinary_erased[s]) continue;
+    trace_fwd.clear();
+    trace_bwd.clear();
+    CellIdType seed = ordinary_pcells.at(s).first;
     
-    /// 2.2 trace backward and forward
-    while (!ordinary_pcells.empty()) {
-      std::list<FaceIdType> trace;
-      CellIdType seed = ordinary_pcells.begin()->first;
-      
-      visited.clear();
-
-      // trace forward (chirality == 1)
-      CellIdType c = seed;
-      bool traced; 
-      while (1) {
-        traced = false;
-        if (ordinary_pcells.find(c) == ordinary_pcells.end() 
-            || visited.find(c) != visited.end())
-          break;
-
-        const PuncturedCell &pcell = ordinary_pcells[c];
-        const CCell &cell = mg->Cell(c);
-
-        // std::vector<ElemIdType> neighbors = _dataset->GetNeighborIds(it->first); 
-        for (int i=0; i<cell.neighbor_cells.size(); i++) {
-          if (pcell.Chirality(i) == 1) {
-            visited.insert(c);
-            // if (cell.neighbor_cells[i] != UINT_MAX  // not boundary
-            //     && special_pcells.find(cell.neighbor_cells[i]) == special_pcells.end()) // not special
-            if (special_pcells.find(cell.neighbor_cells[i]) == special_pcells.end()) // not special
-            {
-              FaceIdType f = cell.faces[i];
-              vobj.faces.insert(f);
-              trace.push_back(f);
-              c = cell.neighbor_cells[i]; 
-              traced = true;
-            } 
-          }
+    visited_cells.clear();
+
+    // trace forward (chirality == 1)
+    CellIdType c = seed;
+    bool traced; 
+    while (1) {
+      traced = false;
+      PuncturedCellMap::const_iterator it = find_ordinary(c);
+      if (it == ordinary_pcells.end() || is_visited(c))
+        break;
+
+      const PuncturedCell &pcell = it->second;
+      mg->CellView(c, cell);
+
+      // std::vector<ElemIdType> neighbors = _dataset->GetNeighborIds(it->first); 
+      for (int i=0; i<cell.nfaces; i++) {
+        if (pcell.Chirality(i) == 1) {
+          visit(c);
+          // if (cell.neighbor_cells[i] != UINT_MAX  // not boundary
+          //     && special_pcells.find(cell.neighbor_cells[i]) == special_pcells.end()) // not special
+          if (special_pcells.find(cell.neighbor_cells[i]) == special_pcells.end()) // not special
+          {
+            FaceIdType f = cell.faces[i];
+            trace_fwd.push_back(f);
+            c = cell.neighbor_cells[i]; 
+            traced = true;
+          } 
         }
-        if (!traced) break;
       }
+      if (!traced) break;
+    }
 
-      // loop detection
-      {
-        const PuncturedCell &pcell = ordinary_pcells[seed];
-        const CCell &cell = mg->Cell(c);
-        for (int i=0; i<cell.neighbor_cells.size(); i++) {
-          if (pcell.Chirality(i) == -1 && visited.find(cell.neighbor_cells[i]) != visited.end()) {
-            vobj.loop = true;
-            // fprintf(stderr, "LOOP\n");
-          }
+    // loop detection
+    {
+      const PuncturedCell &pcell = ordinary_pcells.at(s).second;
+      mg->CellView(c, cell);
+      for (int i=0; i<cell.nfaces; i++) {
+        if (pcell.Chirality(i) == -1 && is_visited(cell.neighbor_cells[i])) {
+          vobj.loop = true;
+          // fprintf(stderr, "LOOP\n");
         }
       }
+    }
 
-      // trace backward (chirality == -1)
-      visited.erase(seed);
-      c = seed;
-      while (1) {
-        traced = false;
-        if (ordinary_pcells.find(c) == ordinary_pcells.end() // the cell is punctured
-            || visited.find(c) != visited.end()) // the cell has not been visited
-          break;
-
-        const PuncturedCell &pcell = ordinary_pcells[c];
-        const CCell &cell = mg->Cell(c);
-
-        // std::vector<ElemIdType> neighbors = _dataset->GetNeighborIds(it->first); 
-        for (int i=0; i<cell.neighbor_cells.size(); i++) {
-          if (pcell.Chirality(i) == -1) {
-            visited.insert(c);
-            // if (cell.neighbor_cells[i] != UINT_MAX  // not boundary
-            //     && special_pcells.find(cell.neighbor_cells[i]) == special_pcells.end()) // not special
-            if (special_pcells.find(cell.neighbor_cells[i]) == special_pcells.end()) // not special
-            {
-              FaceIdType f = cell.faces[i];
-              vobj.faces.insert(f);
-              trace.push_front(f);
-              c = cell.neighbor_cells[i]; 
-              traced = true; 
-            }
+    // trace backward (chirality == -1)
+    ordinary_visited[s] = 0;
+    c = seed;
+    while (1) {
+      traced = false;
+      PuncturedCellMap::const_iterator it = find_ordinary(c);
+      if (it == ordinary_pcells.end() // the cell is punctured
+          || is_visited(c)) // the cell has not been visited
+        break;
+
+      const PuncturedCell &pcell = it->second;
+      mg->CellView(c, cell);
+
+      // std::vector<ElemIdType> neighbors = _dataset->GetNeighborIds(it->first); 
+      for (int i=0; i<cell.nfaces; i++) {
+        if (pcell.Chirality(i) == -1) {
+          visit(c);
+          // if (cell.neighbor_cells[i] != UINT_MAX  // not boundary
+          //     && special_pcells.find(cell.neighbor_cells[i]) == special_pcells.end()) // not special
+          if (special_pcells.find(cell.neighbor_cells[i]) == special_pcells.end()) // not special
+          {
+            FaceIdType f = cell.faces[i];
+            trace_bwd.push_back(f);
+            c = cell.neighbor_cells[i]; 
+            traced = true; 
           }
         }
-        if (!traced) break;
       }
-      
-      visited.insert(seed);
-      
-      for (std::set<CellIdType>::iterator it = visited.begin(); it != visited.end(); it ++)
-        ordinary_pcells.erase(*it);
-      visited.clear();
-
-      vobj.traces.push_back(trace);
+      if (!traced) break;
+    }
+    
+    visit(seed);
+    
+    for (size_t q=0; q<visited_cells.size(); q++) {
+      const size_t i = visited_cells[q];
+      if (!ordinary_visited[i]) continue;
+      ordinary_erased[i] = true;
+      ordinary_visited[i] = 0;
     }
 
-    // vobj.id = NewVortexId();
-    vobj.id = vobjs.size();  // local (time) id
-    vobjs.push_back(vobj);
+    sts.trace_faces.insert(sts.trace_faces.end(), trace_bwd.rbegin(), trace_bwd.rend());
+    sts.trace_faces.insert(sts.trace_faces.end(), trace_fwd.begin(), trace_fwd.end());
+    sts.trace_offsets.push_back(sts.trace_faces.size());
   }
 
-  // fprintf(stderr, "#vortex_objs=%ld\n", vobjs.size());
+  vobj.trace_faces.assign(sts.trace_faces.begin(), sts.trace_faces.end());
+  vobj.trace_offsets.assign(sts.trace_offsets.begin(), sts.trace_offsets.end());
+  vobj.UpdateFaces();
 }
 
 void VortexExtractor::VortexObjectsToVortexLines(
-    const std::map<FaceIdType, PuncturedFace>& pfs, 
+    const PuncturedFaceMap& pfs, 
     const std::vector<VortexObject>& vobjs, 
     std::vector<VortexLine>& vlines, bool bezier)
 {
-  for (int i=0; i<vobjs.size(); i++) {
+  for (size_t i=0; i<vobjs.size(); i++) {
     const VortexObject& vobj = vobjs[i];
     VortexLine line;
     line.id = vobj.id;
@@ -641,10 +842,9 @@ void VortexExtractor::VortexObjectsToVortexLines(
     line.timestep = vobj.timestep;
     // line.time = vobj.time; // FIXME
     
-    for (int j=0; j<vobj.traces.size(); j++) {
-      const std::list<FaceIdType> &trace = vobj.traces[j];
-      for (std::list<FaceIdType>::const_iterator it = trace.begin(); it != trace.end(); it ++) {
-        const std::map<FaceIdType, PuncturedFace>::const_iterator it1 = pfs.find(*it);
+    for (size_t j=0; j<vobj.NumberOfTraces(); j++) {
+      for (const FaceIdType *it = vobj.TraceBegin(j); it != vobj.TraceEnd(j); it ++) {
+        const PuncturedFaceMap::const_iterator it1 = pfs.find(*it);
         assert(it1 != pfs.end());
         // if (it1 == pfs.end()) continue;
         const PuncturedFace& pf = it1->second;
@@ -688,23 +888,28 @@ VortexTransitionMatrix VortexExtractor::TraceOverTime()
 
   RelateOverTime();
 
+  // index of slot-1 faces to the objects containing them, sorted by face
+  std::vector<std::pair<FaceIdType, int> > &index = _face_objects1;
+  index.clear();
+  for (int j=0; j<n1; j++) 
+    for (VortexObject::FaceArray::const_iterator it = _vortex_objects1[j].faces.begin(); 
+        it != _vortex_objects1[j].faces.end(); it ++) 
+      index.push_back(std::make_pair(*it, j));
+  std::sort(index.begin(), index.end());
+
+  // i and j are related if any face of i is related to any face of j
   for (int i=0; i<n0; i++) {
-    for (int j=0; j<n1; j++) {
-      for (std::set<FaceIdType>::iterator it = _vortex_objects[i].faces.begin(); 
-          it != _vortex_objects[i].faces.end(); it ++) 
-      {
-        const std::vector<FaceIdType> &related = _related_faces[*it];
-        for (int k=0; k<related.size(); k++) {
-          if (_vortex_objects1[j].faces.find(related[k]) != _vortex_objects1[j].faces.end()) {
-            // if (i != j)
-            //   fprintf(stderr, "vid=%d --> vid=%d, fid0=%u, fid1=%u\n", i, j, *it, related[k]);
-            tm(i, j) ++;
-            goto next;
-          }
-        }
+    for (VortexObject::FaceArray::const_iterator it = _vortex_objects[i].faces.begin(); 
+        it != _vortex_objects[i].faces.end(); it ++) 
+    {
+      const size_t r = _related_faces.find(*it);
+      if (r == _related_faces.size()) continue;
+      for (const FaceIdType *f = _related_faces.begin(r); f != _related_faces.end(r); f ++) {
+        std::vector<std::pair<FaceIdType, int> >::const_iterator it1 = std::lower_bound(
+            index.begin(), index.end(), std::make_pair(*f, INT_MIN));
+        for (; it1 != index.end() && it1->first == *f; it1 ++) 
+          tm(i, it1->second) = 1;
       }
-next: 
-      continue;
     }
   }
 
@@ -772,6 +977,7 @@ void VortexExtractor::RotateTimeSteps()
   _punctured_faces.clear();
   _punctured_cells.clear();
   _vortex_objects.clear();
+  reset_arenas(_vobj_arenas);
   _vortex_lines.clear();
 
   _punctured_edges.clear();
@@ -781,23 +987,33 @@ void VortexExtractor::RotateTimeSteps()
   _punctured_faces.swap( _punctured_faces1 );
   _punctured_cells.swap( _punctured_cells1 );
   _vortex_objects.swap( _vortex_objects1 );
+  _vobj_arenas.swap( _vobj_arenas1 );
   _vortex_lines.swap( _vortex_lines1 );
 
-#if WITH_CUDA
-  if (_gpu)
+  if (_vfgpu_ctx)
     vfgpu_rotate_timesteps(_vfgpu_ctx);
-#endif
 }
 
-void VortexExtractor::ExtractFaces_GPU(int slot)
+static void append_vfgpu_faces(int n, const vfgpu_pf_t *pf, std::vector<std::pair<FaceIdType, PuncturedFace> > &pfs)
+{
+  for (int i=0; i<n; i++) {
+    PuncturedFace f;
+    f.chirality = pf[i].chirality;
+    memcpy(f.pos, pf[i].pos, sizeof(float)*3);
+    pfs.push_back(std::make_pair(pf[i].fid, f));
+  }
+}
+
+void VortexExtractor::UploadData_GPU(int slot)
 {
-#if WITH_CUDA
   GLGPU3DDataset *ds = (GLGPU3DDataset*)_dataset;
   const int meshtype = ds->MeshType();
 
   if (_vfgpu_ctx == NULL) {
     _vfgpu_ctx = vfgpu_create_ctx();
     vfgpu_set_meshtype(_vfgpu_ctx, meshtype);
+    vfgpu_set_number_of_threads(_vfgpu_ctx, _nthreads);
+    vfgpu_set_seed(_vfgpu_ctx, _pertubation_seed);
     vfgpu_set_enable_count_lines_in_cell(_vfgpu_ctx, true); // FIXME
   }
 
@@ -820,6 +1036,11 @@ void VortexExtractor::ExtractFaces_GPU(int slot)
   gh.Kx = h.Kex;
 
   vfgpu_upload_data(_vfgpu_ctx, slot, gh, re, im);
+}
+
+void VortexExtractor::ExtractFaces_GPU(int slot)
+{
+  UploadData_GPU(slot);
  
   typedef std::chrono::high_resolution_clock clock;
   auto t0 = clock::now();
@@ -842,6 +1063,7 @@ void VortexExtractor::ExtractFaces_GPU(int slot)
   vfgpu_extract_faces(_vfgpu_ctx, slot);
   vfgpu_get_pflist(_vfgpu_ctx, &pfcount, &pf);
 #else
+  vfgpu_set_pertubation(_vfgpu_ctx, _pertubation);
   vfgpu_extract_faces(_vfgpu_ctx, slot);
   vfgpu_get_pflist(_vfgpu_ctx, &pfcount, &pf);
 #endif
@@ -850,34 +1072,41 @@ void VortexExtractor::ExtractFaces_GPU(int slot)
   float elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(t1 - t0).count() / 1000000000.0; 
   fprintf(stderr, "t_fgpu=%f\n", elapsed);
 
-  for (int i=0; i<pfcount; i++) {
-    float pos[3] = {pf[i].pos[0], pf[i].pos[1], pf[i].pos[2]};
-    AddPuncturedFace(pf[i].fid, slot, pf[i].chirality, pos);
-  }
-#endif
+  _thread_pfs.resize(1);
+  append_vfgpu_faces(pfcount, pf, _thread_pfs[0]);
+  MergePuncturedFaces(slot);
+  BuildPuncturedCells(slot);
 }
 
-void VortexExtractor::ExtractEdges_GPU()
+void VortexExtractor::ExtractFacesMulti_GPU(const std::vector<float>& pertubations, const std::vector<unsigned int>& seeds, int slot)
 {
-#if WITH_CUDA
-  GLGPU3DDataset *ds = (GLGPU3DDataset*)_dataset;
+  UploadData_GPU(slot);
+ 
+  typedef std::chrono::high_resolution_clock clock;
+  auto t0 = clock::now();
 
-  GLHeader h;
-  float *rho[2], *phi[2], *re[2], *im[2], *J[2];
-  for (int i=0; i<2; i++) 
-    ds->GetDataArray(h, &rho[i], &phi[i], &re[i], &im[i], &J[i], i);
+  vfgpu_extract_faces_multi(_vfgpu_ctx, slot, pertubations.size(), pertubations.data(), seeds.data());
+  
+  auto t1 = clock::now();
+  float elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(t1 - t0).count() / 1000000000.0; 
+  fprintf(stderr, "t_fgpu_multi=%f, K=%zu\n", elapsed, pertubations.size());
+}
 
-  float origins[3], lengths[3], cell_lengths[3], B[3], Kx;
-  for (int i=0; i<3; i++) {
-    origins[i] = h.origins[i];
-    lengths[i] = h.lengths[i]; 
-    cell_lengths[i] = h.cell_lengths[i];
-    B[i] = h.B[i];
-    Kx = h.Kex;
-  }
+void VortexExtractor::SelectFacesMulti_GPU(int k, int slot)
+{
+  int pfcount; 
+  vfgpu_pf_t *pf; 
+  vfgpu_get_pflist_multi(_vfgpu_ctx, k, &pfcount, &pf);
 
-  const int count = h.dims[0] * h.dims[1] * h.dims[2];
- 
+  _thread_pfs.resize(1);
+  append_vfgpu_faces(pfcount, pf, _thread_pfs[0]);
+  MergePuncturedFaces(slot);
+  BuildPuncturedCells(slot);
+}
+
+void VortexExtractor::ExtractEdges_GPU()
+{
+  // both timesteps are already on the vfgpu context, see ExtractFaces_GPU()
   typedef std::chrono::high_resolution_clock clock;
   auto t0 = clock::now();
 
@@ -890,40 +1119,55 @@ void VortexExtractor::ExtractEdges_GPU()
   float elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(t1 - t0).count() / 1000000000.0; 
   fprintf(stderr, "t_egpu=%f\n", elapsed);
 
+  _thread_pes.resize(1);
   for (int i=0; i<pecount; i++) {
-    AddPuncturedEdge(pe[i].eid, pe[i].chirality, 0);
+    PuncturedEdge e;
+    e.chirality = pe[i].chirality;
+    e.t = 0;
+    _thread_pes[0].push_back(std::make_pair(pe[i].eid, e));
   }
-#endif
+  MergePuncturedEdges();
 }
 
 void VortexExtractor::ExtractFaces(int slot) 
 {
   typedef std::chrono::high_resolution_clock clock;
   auto t0 = clock::now();
+  const size_t a0 = NumberOfArenaAllocations();
+  float r_skip = -1; // fraction of screened out bricks or cubes, reported with t_f
 
   if (!LoadPuncturedFaces(slot)) {
     if (_gpu) {
       ExtractFaces_GPU(slot);
     } else {
       // running in threads
-      const int nthreads = _nthreads; 
-      pthread_t threads[nthreads-1]; 
-      extractor_thread_t ctx[nthreads];
-     
-      for (int i=0; i<nthreads-1; i++) {
-        ctx[i].extractor = this;
-        ctx[i].nthreads = nthreads;
-        ctx[i].tid = i+1;
-        ctx[i].type = 0; // faces
-        ctx[i].slot = slot;
-
-        pthread_create(&threads[i], NULL, &VortexExtractor::execute_thread_helper, &ctx[i]);
+      if (_simd && UseFaceKernel()) 
+        execute_threads(4, slot); // only the candidates are checked by CheckFace()
+      else if (_brick_size > 0 && UseBrickScreen()) {
+        execute_threads(10, slot); // faces of the remaining bricks are checked by CheckFace()
+        const int *d = ((const GLGPU3DDataset*)_dataset)->dims();
+        size_t nbricks = 1, skipped = 0;
+        for (int i=0; i<3; i++) 
+          nbricks *= (d[i] + _brick_size - 1) / _brick_size;
+        for (size_t i=0; i<_thread_skipped.size(); i++)
+          skipped += _thread_skipped[i];
+        r_skip = (float)skipped / nbricks;
+      } else if (_hybrid && UseHybrid()) {
+        execute_threads(11, slot);
+        execute_threads(12, slot); // tet faces of the remaining cubes are checked by CheckFace()
+        size_t skipped = 0;
+        for (size_t i=0; i<_thread_skipped.size(); i++)
+          skipped += _thread_skipped[i];
+        r_skip = (float)skipped / (_dataset->MeshGraph()->NFaces() / 12);
+      } else {
+        if (_edge_centric) {
+          _edge_phase.resize(_dataset->MeshGraph()->NEdges());
+          execute_threads(3, slot);
+        }
+        execute_threads(0, slot); 
       }
-
-      execute_thread(nthreads, 0, 0, slot); // main thread
-
-      for (int i=0; i<nthreads-1; i++) 
-        pthread_join(threads[i], NULL);
+      MergePuncturedFaces(slot);
+      BuildPuncturedCells(slot);
    
 #if 0 // serial version
       for (FaceIdType i=0; i<mg->NFaces(); i++) 
@@ -935,18 +1179,22 @@ void VortexExtractor::ExtractFaces(int slot)
  
   auto t1 = clock::now();
   float elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(t1 - t0).count() / 1000000000.0; 
-  fprintf(stderr, "t_f=%f\n", elapsed);
+  const size_t n_arena = NumberOfArenaAllocations() - a0;
+  if (r_skip >= 0)
+    fprintf(stderr, "t_f=%f, n_arena=%zu, r_skip=%f\n", elapsed, n_arena, r_skip);
+  else 
+    fprintf(stderr, "t_f=%f, n_arena=%zu\n", elapsed, n_arena);
 }
 
 void VortexExtractor::ExtractFaces(std::vector<FaceIdType> faces, int slot, int &positive, int &negative)
 {
-  for (int i=0; i<faces.size(); i++) 
+  for (size_t i=0; i<faces.size(); i++) 
     ExtractFace(faces[i], slot);
 
-  const std::map<FaceIdType, PuncturedFace> &pfs = slot==0 ? _punctured_faces : _punctured_faces1;
+  const PuncturedFaceMap &pfs = slot==0 ? _punctured_faces : _punctured_faces1;
 
   positive=0, negative=0; 
-  for (std::map<FaceIdType, PuncturedFace>::const_iterator it = pfs.begin(); it != pfs.end(); it ++) {
+  for (PuncturedFaceMap::const_iterator it = pfs.begin(); it != pfs.end(); it ++) {
     if (it->second.chirality>0) positive ++; 
     else if (it->second.chirality<0) negative ++;
   }
@@ -960,30 +1208,18 @@ void VortexExtractor::ExtractEdges()
 {
   typedef std::chrono::high_resolution_clock clock;
   auto t0 = clock::now();
+  const size_t a0 = NumberOfArenaAllocations();
 
   if (!LoadPuncturedEdges()) {
     if (_gpu) {
       ExtractEdges_GPU();
     } else {
       // running in threads
-      const int nthreads = _nthreads; 
-      pthread_t threads[nthreads-1]; 
-      extractor_thread_t ctx[nthreads];
-     
-      for (int i=0; i<nthreads-1; i++) {
-        ctx[i].extractor = this;
-        ctx[i].nthreads = nthreads;
-        ctx[i].tid = i+1;
-        ctx[i].type = 1; // edges
-        ctx[i].slot = 0;
-
-        pthread_create(&threads[i], NULL, &VortexExtractor::execute_thread_helper, &ctx[i]);
-      }
-
-      execute_thread(nthreads, 0, 1, 0); // main thread
-      
-      for (int i=0; i<nthreads-1; i++) 
-        pthread_join(threads[i], NULL);
+      if (_edge_pruning >= 0 && FindCandidateEdges())
+        execute_threads(9, 0);
+      else 
+        execute_threads(1, 0);
+      MergePuncturedEdges();
       
 #if 0 // serial version
       for (EdgeIdType i=0; i<mg->NEdges(); i++) 
@@ -995,22 +1231,113 @@ void VortexExtractor::ExtractEdges()
   
   auto t1 = clock::now();
   float elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(t1 - t0).count() / 1000000000.0; 
-  fprintf(stderr, "t_e=%f\n", elapsed);
+  fprintf(stderr, "t_e=%f, n_arena=%zu\n", elapsed, NumberOfArenaAllocations() - a0);
+}
+
+bool VortexExtractor::FindCandidateEdges()
+{
+  const MeshGraph *mg = _dataset->MeshGraph();
+  const CellIdType ncells = mg->NCells();
+  const EdgeIdType nedges = mg->NEdges();
+  const size_t max_cells = edge_pruning_max_density * ncells;
+  if (_cell_bits.capacity() < ncells) 
+    _cell_bits.resize(ncells);
+  if (_edge_bits.capacity() < nedges) 
+    _edge_bits.resize(nedges);
+
+  // cells of the punctured faces in either slot, and k rings of neighbors
+  std::vector<CellIdType> cells;
+  CFaceView face;
+  CCellView cell;
+  for (int slot=0; slot<2; slot++) {
+    const PuncturedFaceMap &pfs = slot == 0 ? _punctured_faces : _punctured_faces1;
+    for (PuncturedFaceMap::const_iterator it = pfs.begin(); it != pfs.end(); it ++) {
+      mg->FaceView(it->first, face);
+      for (int j=0; j<face.ncontained_cells; j++) {
+        const CellIdType c = face.contained_cells[j];
+        if (c < ncells && !_cell_bits.test(c)) {
+          _cell_bits.set(c);
+          cells.push_back(c);
+        }
+      }
+    }
+  }
+
+  for (size_t r=0, begin=0; r<(size_t)_edge_pruning && cells.size() <= max_cells; r++) {
+    const size_t end = cells.size();
+    for (size_t q=begin; q<end; q++) {
+      mg->CellView(cells[q], cell);
+      for (int j=0; j<cell.nfaces; j++) {
+        const CellIdType c = cell.neighbor_cells[j];
+        if (c < ncells && !_cell_bits.test(c)) {
+          _cell_bits.set(c);
+          cells.push_back(c);
+        }
+      }
+    }
+    begin = end;
+  }
+
+  for (size_t q=0; q<cells.size(); q++)
+    _cell_bits.reset(cells[q]);
+  if (cells.size() > max_cells) 
+    return false;
+
+  // edges of the cells
+  _candidate_edges.clear();
+  for (size_t q=0; q<cells.size(); q++) {
+    mg->CellView(cells[q], cell);
+    for (int i=0; i<cell.nfaces; i++) {
+      mg->FaceView(cell.faces[i], face);
+      for (int j=0; j<face.nnodes; j++) {
+        const EdgeIdType e = face.edges[j];
+        if (e < nedges && !_edge_bits.test(e)) {
+          _edge_bits.set(e);
+          _candidate_edges.push_back(e);
+        }
+      }
+    }
+  }
+
+  for (size_t q=0; q<_candidate_edges.size(); q++)
+    _edge_bits.reset(_candidate_edges[q]);
+  std::sort(_candidate_edges.begin(), _candidate_edges.end());
+
+  // fprintf(stderr, "#cells=%zu, #candidate_edges=%zu\n", cells.size(), _candidate_edges.size());
+  return true;
 }
 
 void VortexExtractor::ExtractSpaceTimeEdge(EdgeIdType id)
+{
+  float t;
+  ChiralityType chirality = CheckSpaceTimeEdge(id, t);
+  if (chirality != 0) 
+    AddPuncturedEdge(id, chirality, t);
+}
+
+ChiralityType VortexExtractor::CheckSpaceTimeEdge(EdgeIdType id, float &t) const
 {
   const GLDataset *ds = (GLDataset*)_dataset;
-  const CEdge& e = _dataset->MeshGraph()->Edge(id, true);
+  CEdgeView e;
+  _dataset->MeshGraph()->EdgeView(id, e, true);
 
   if (!e.Valid()) {
     // fprintf(stderr, "invalid edge\n");
-    return;
+    return 0;
   }
 
   float X[4][3], A[4][3];
   float rho[4], phi[4], re[4], im[4];
-  ds->GetSpaceTimeEdgeValues(e, X, A, rho, phi, re, im);
+  if (_complex_phase) { // rho and phi are not used
+    const NodeIdType nodes[4] = {e.node0, e.node1, e.node1, e.node0};
+    ds->Pos(e.node0, X[0]);
+    ds->Pos(e.node1, X[1]);
+    for (int i=0; i<4; i++) {
+      ds->A(nodes[i], A[i], i/2);
+      ds->ReIm(nodes[i], re[i], im[i], i/2);
+    }
+  } else
+    ds->GetSpaceTimeEdgeValues(e, X, A, rho, phi, re, im);
 
   const float dt = ds->Time(1) - ds->Time(0);
   float li[4] = {
@@ -1021,18 +1348,24 @@ void VortexExtractor::ExtractSpaceTimeEdge(EdgeIdType id)
     0}; 
     // -0.5 * (ds->Kex(1) + ds->Kex(0)) * dt};
   float qp[4] = {
-    ds->QP(X[0], X[1]), 0, 
-    ds->QP(X[1], X[0]), 0};
-  float delta[4] = {
-    phi[1] - phi[0],
-    phi[2] - phi[1],
-    phi[3] - phi[2],
-    phi[0] - phi[3]
-  };
-
-  for (int i=0; i<4; i++) 
-    if (_gauge) delta[i] = mod2pi1(delta[i] - li[i] + qp[i]);
-    else delta[i] = mod2pi1(delta[i] + qp[i]);
+    ds->QP(X[0], X[1], 0), 0, 
+    ds->QP(X[1], X[0], 1), 0};
+  float delta[4];
+  if (_complex_phase) {
+    for (int i=0; i<4; i++) {
+      const int j = (i+1) % 4;
+      delta[i] = phase_jump(re[i], im[i], re[j], im[j], _gauge ? li[i] - qp[i] : -qp[i]);
+    }
+  } else {
+    delta[0] = phi[1] - phi[0];
+    delta[1] = phi[2] - phi[1];
+    delta[2] = phi[3] - phi[2];
+    delta[3] = phi[0] - phi[3];
+
+    for (int i=0; i<4; i++) 
+      if (_gauge) delta[i] = mod2pi1(delta[i] - li[i] + qp[i]);
+      else delta[i] = mod2pi1(delta[i] + qp[i]);
+  }
 
   float phase_shift = -(delta[0] + delta[1] + delta[2] + delta[3]);
   float critera = phase_shift / (2*M_PI);
@@ -1040,10 +1373,15 @@ void VortexExtractor::ExtractSpaceTimeEdge(EdgeIdType id)
   ChiralityType chirality;
   if (critera > 0.5) chirality = 1; 
   else if (critera < -0.5) chirality = -1;
-  else return;
+  else return 0;
 
   // gauge transformation
   if (_gauge) {
+    if (_complex_phase) {
+      for (int i=0; i<4; i++)
+        rho[i] = sqrt(re[i]*re[i] + im[i]*im[i]);
+      phi[0] = atan2(im[0], re[0]);
+    }
     for (int i=0; i<4; i++) {
       if (i!=0) phi[i] = phi[i-1] + delta[i-1];
       re[i] = rho[i] * cos(phi[i]); 
@@ -1052,41 +1390,62 @@ void VortexExtractor::ExtractSpaceTimeEdge(EdgeIdType id)
   }
 
   // find zero
-  float t = 0;
-  if (FindSpaceTimeEdgeZero(re, im, t)) {
-    // fprintf(stderr, "punctured edge: eid=%u, chirality=%d, t=%f\n", 
-    //     id, chirality, t);
-    AddPuncturedEdge(id, chirality, t);
-  } else {
+  t = 0;
+  if (!FindSpaceTimeEdgeZero(re, im, t)) {
     fprintf(stderr, "WARNING: zero time not found.\n");
-    AddPuncturedEdge(id, chirality, NAN);
+    t = NAN;
   }
+  // fprintf(stderr, "punctured edge: eid=%u, chirality=%d, t=%f\n", 
+  //     id, chirality, t);
+
+  return chirality;
 }
 
 int VortexExtractor::ExtractFace(FaceIdType id, int slot)
+{
+  float pos[3];
+  ChiralityType chirality = CheckFace(id, slot, pos);
+  if (chirality != 0)
+    AddPuncturedFace(id, slot, chirality, pos);
+  return chirality;
+}
+
+ChiralityType VortexExtractor::CheckFace(FaceIdType id, int slot, float pos[3]) const
 {
   const GLDataset *ds = (GLDataset*)_dataset;
-  const CFace& f = ds->MeshGraph()->Face(id, true);
-  const int nnodes = f.nodes.size();
+  CFaceView f;
+  ds->MeshGraph()->FaceView(id, f, true);
+  const int nnodes = f.nnodes;
 
   if (!f.Valid()) return 0;
 
-  float X[nnodes][3], A[nnodes][3];
-  float rho[nnodes], phi[nnodes], re[nnodes], im[nnodes];
-  ds->GetFaceValues(f, slot, X, A, rho, phi, re, im);
+  float X[CFaceView::MAX_NODES][3], A[CFaceView::MAX_NODES][3];
+  float rho[CFaceView::MAX_NODES], phi[CFaceView::MAX_NODES], re[CFaceView::MAX_NODES], im[CFaceView::MAX_NODES];
+  if (_complex_phase) { // rho and phi are not used
+    for (int i=0; i<nnodes; i++) {
+      ds->Pos(f.nodes[i], X[i]);
+      ds->A(f.nodes[i], A[i], slot);
+      ds->ReIm(f.nodes[i], re[i], im[i], slot);
+    }
+  } else 
+    ds->GetFaceValues(f, slot, X, A, rho, phi, re, im);
 
   // calculating phase shift
-  float delta[nnodes], phase_shift = 0;
+  float delta[CFaceView::MAX_NODES], phase_shift = 0;
   for (int i=0; i<nnodes; i++) {
     int j = (i+1) % nnodes;
-    delta[i] = phi[j] - phi[i]; 
     float li = ds->LineIntegral(X[i], X[j], A[i], A[j]), 
-           qp = ds->QP(X[i], X[j]);
-    if (_gauge) 
-      // delta[i] = mod2pi1(delta[i] - li + qp);
-      delta[i] = mod2pi1(delta[i] - li + qp);
-    else 
-      delta[i] = mod2pi1(delta[i] + qp);
+           qp = ds->QP(X[i], X[j], slot);
+    if (_complex_phase) 
+      delta[i] = phase_jump(re[i], im[i], re[j], im[j], _gauge ? li - qp : -qp);
+    else {
+      delta[i] = phi[j] - phi[i]; 
+      if (_gauge) 
+        // delta[i] = mod2pi1(delta[i] - li + qp);
+        delta[i] = mod2pi1(delta[i] - li + qp);
+      else 
+        delta[i] = mod2pi1(delta[i] + qp);
+    }
     phase_shift -= delta[i];
   }
 
@@ -1099,6 +1458,11 @@ int VortexExtractor::ExtractFace(FaceIdType id, int slot)
 
   // gauge transformation
   if (_gauge) {
+    if (_complex_phase) {
+      for (int i=0; i<nnodes; i++)
+        rho[i] = sqrt(re[i]*re[i] + im[i]*im[i]);
+      phi[0] = atan2(im[0], re[0]);
+    }
     for (int i=0; i<nnodes; i++) {
       if (i!=0) phi[i] = phi[i-1] + delta[i-1];
       re[i] = rho[i] * cos(phi[i]); 
@@ -1107,41 +1471,584 @@ int VortexExtractor::ExtractFace(FaceIdType id, int slot)
   }
 
   // find zero
-  float pos[3];
-  if (FindFaceZero(nnodes, X, re, im, pos)) {
-    AddPuncturedFace(id, slot, chirality, pos);
-    // fprintf(stderr, "pos={%f, %f, %f}, chi=%d\n", pos[0], pos[1], pos[2], chirality);
-  } else {
+  if (!FindFaceZero(nnodes, X, re, im, pos)) {
+    fprintf(stderr, "WARNING: punctured but singularity not found.\n");
+    pos[0] = pos[1] = pos[2] = NAN;
+  }
+  // fprintf(stderr, "pos={%f, %f, %f}, chi=%d\n", pos[0], pos[1], pos[2], chirality);
+
+  return chirality;
+}
+
+float VortexExtractor::EdgePhaseJump(EdgeIdType id, int slot) const
+{
+  const GLDataset *ds = (GLDataset*)_dataset;
+  CEdgeView e;
+  ds->MeshGraph()->EdgeView(id, e, true);
+  if (!e.Valid()) return NAN; // e.g. edges on the upper boundaries
+
+  return NodePhaseJump(e.node0, e.node1, slot);
+}
+
+float VortexExtractor::NodePhaseJump(NodeIdType n0, NodeIdType n1, int slot) const
+{
+  const GLDataset *ds = (GLDataset*)_dataset;
+  float X[2][3], A[2][3];
+  ds->Pos(n0, X[0]);
+  ds->Pos(n1, X[1]);
+  ds->A(n0, A[0], slot);
+  ds->A(n1, A[1], slot);
+
+  const float qp = ds->QP(X[0], X[1], slot);
+  if (_complex_phase) {
+    float re[2], im[2];
+    ds->ReIm(n0, re[0], im[0], slot);
+    ds->ReIm(n1, re[1], im[1], slot);
+    return phase_jump(re[0], im[0], re[1], im[1], 
+        _gauge ? ds->LineIntegral(X[0], X[1], A[0], A[1]) - qp : -qp);
+  }
+
+  const float delta = ds->Phi(n1, slot) - ds->Phi(n0, slot);
+  if (_gauge)
+    return mod2pi1(delta - ds->LineIntegral(X[0], X[1], A[0], A[1]) + qp);
+  else 
+    return mod2pi1(delta + qp);
+}
+
+ChiralityType VortexExtractor::CheckFaceByEdges(FaceIdType id, int slot, float pos[3]) const
+{
+  const GLDataset *ds = (GLDataset*)_dataset;
+  CFaceView f;
+  ds->MeshGraph()->FaceView(id, f);
+  const int nnodes = f.nnodes;
+
+  if (!f.Valid()) return 0;
+
+  // signed sum of the edge phase jumps
+  float delta[CFaceView::MAX_NODES], phase_shift = 0;
+  for (int i=0; i<nnodes; i++) {
+    delta[i] = f.edges_chirality[i] * _edge_phase[f.edges[i]];
+    if (std::isnan(delta[i])) // the face has edges that are not in the edge table
+      return CheckFace(id, slot, pos);
+    phase_shift -= delta[i];
+  }
+
+  float critera = phase_shift / (2*M_PI);
+  if (fabs(critera)<0.5) return 0; // not punctured
+
+  ChiralityType chirality = critera>0 ? 1 : -1;
+
+  float X[CFaceView::MAX_NODES][3], A[CFaceView::MAX_NODES][3];
+  float rho[CFaceView::MAX_NODES], phi[CFaceView::MAX_NODES], re[CFaceView::MAX_NODES], im[CFaceView::MAX_NODES];
+  if (_complex_phase) {
+    for (int i=0; i<nnodes; i++) {
+      ds->Pos(f.nodes[i], X[i]);
+      ds->ReIm(f.nodes[i], re[i], im[i], slot);
+    }
+  } else
+    ds->GetFaceValues(f, slot, X, A, rho, phi, re, im);
+
+  // gauge transformation
+  if (_gauge) {
+    if (_complex_phase) {
+      for (int i=0; i<nnodes; i++)
+        rho[i] = sqrt(re[i]*re[i] + im[i]*im[i]);
+      phi[0] = atan2(im[0], re[0]);
+    }
+    for (int i=0; i<nnodes; i++) {
+      if (i!=0) phi[i] = phi[i-1] + delta[i-1];
+      re[i] = rho[i] * cos(phi[i]); 
+      im[i] = rho[i] * sin(phi[i]);
+    }
+  }
+
+  // find zero
+  if (!FindFaceZero(nnodes, X, re, im, pos)) {
     fprintf(stderr, "WARNING: punctured but singularity not found.\n");
     pos[0] = pos[1] = pos[2] = NAN;
-    AddPuncturedFace(id, slot, chirality, pos);
   }
 
   return chirality;
 }
 
-void *VortexExtractor::execute_thread_helper(void *ctx_)
+bool VortexExtractor::UseFaceKernel() const
+{
+  // the face kernel knows the hex mesh and the vector potential of GLGPU3DDataset
+  // and works on phi
+  if (_complex_phase) return false;
+  const GLDataset *ds = (GLDataset*)_dataset;
+  if (ds->Dimensions() != 3) return false;
+
+  const GLGPU3DDataset *ds3 = (const GLGPU3DDataset*)_dataset;
+  if (ds3->MeshType() != GLGPU3D_MESH_HEX) return false;
+  for (int i=0; i<3; i++) // no wrap-around of face edges in LineIntegral()
+    if (ds3->dims()[i] < 3) return false;
+  return true;
+}
+
+bool VortexExtractor::UseBrickScreen() const
+{
+  // the brick screening knows the vector potential of GLGPU3DDataset.  faces of
+  // both meshes are numbered nid*k+t and lie in the cube spanned from node nid
+  const GLDataset *ds = (GLDataset*)_dataset;
+  if (ds->Dimensions() != 3) return false;
+
+  const GLGPU3DDataset *ds3 = (const GLGPU3DDataset*)_dataset;
+  for (int i=0; i<3; i++) // no wrap-around of face edges in LineIntegral()
+    if (ds3->dims()[i] < 3) return false;
+  return true;
+}
+
+bool VortexExtractor::UseHybrid() const
+{
+  const GLDataset *ds = (GLDataset*)_dataset;
+  if (ds->Dimensions() != 3) return false;
+
+  const GLGPU3DDataset *ds3 = (const GLGPU3DDataset*)_dataset;
+  if (ds3->MeshType() != GLGPU3D_MESH_TET) return false;
+  for (int i=0; i<3; i++) // no wrap-around of face edges in LineIntegral()
+    if (ds3->dims()[i] < 3) return false;
+  return true;
+}
+
+// whether no tet face of the cube spanned from node n can be punctured,
+// given the phase jumps of the 12 cube edges (ap, 3 per node).  if none of
+// the 6 quads of the cube winds, the jumps along any cycle of cube edges sum
+// up to minus its line integral.  the jump of a face/body diagonal then
+// equals the sum along a path of at most 3 cube edges plus the flux
+// through the loop they form, as long as that stays below pi, and a tet
+// face sums up to minus the flux through it, which is less than pi.
+static bool cube_ruled_out(const float *ap, const size_t s[3], size_t n, float max_jump, float max_quad)
 {
-  extractor_thread_t *ctx = (extractor_thread_t*)ctx_;
-  ctx->extractor->execute_thread(ctx->nthreads, ctx->tid, ctx->type, ctx->slot);
-  return NULL;
+  for (int t=0; t<3; t++) {
+    const int a = (t+1) % 3, b = (t+2) % 3;
+    const size_t nodes[4] = {n, n+s[a], n+s[b], n+s[a]+s[b]};
+    for (int q=0; q<4; q++) 
+      if (!(fabs(ap[nodes[q]*3+t]) <= max_jump)) return false;
+  }
+
+  for (int t=0; t<3; t++) {
+    const int a = (t+1) % 3, b = (t+2) % 3;
+    for (int q=0; q<2; q++) {
+      const size_t p = n + q*s[t];
+      const float sum = ap[p*3+a] + ap[(p+s[a])*3+b] - ap[(p+s[b])*3+a] - ap[p*3+b];
+      if (!(fabs(sum) < max_quad)) return false;
+    }
+  }
+  return true;
+}
+
+void VortexExtractor::execute_threads(int type, int slot)
+{
+  const MeshGraph *mg = _dataset->MeshGraph();
+  if (_pool == NULL) 
+    _pool = new WorkerPool(_nthreads);
+  const int nthreads = _pool->NumberOfThreads();
+
+  size_t n, chunk_size; 
+  if (type == 0) {
+    _thread_pfs.resize(nthreads);
+    n = mg->NFaces();
+    chunk_size = face_chunk_size;
+  } else if (type == 1) {
+    _thread_pes.resize(nthreads);
+    n = mg->NEdges(); 
+    chunk_size = edge_chunk_size;
+  } else if (type == 2) {
+    _thread_pcs.resize(nthreads);
+    n = _pf_list.size();
+    chunk_size = cell_chunk_size;
+  } else if (type == 3) {
+    n = _edge_phase.size();
+    chunk_size = edge_phase_chunk_size;
+  } else if (type == 4) {
+    const int *d = ((const GLGPU3DDataset*)_dataset)->dims();
+    _thread_pfs.resize(nthreads);
+    n = 3 * d[1] * d[2]; // rows of faces along x
+    chunk_size = face_row_chunk_size;
+  } else if (type == 5) {
+    n = _rel.faces.size() + _punctured_edges.size();
+    chunk_size = relation_chunk_size;
+  } else if (type == 6) {
+    _thread_related.resize(nthreads);
+    _rel.stacks.resize(nthreads);
+    n = _rel.comp_off.size() - 1;
+    chunk_size = component_chunk_size;
+  } else if (type == 7) {
+    n = _space.parent.size();
+    chunk_size = cell_chunk_size;
+  } else if (type == 8) {
+    _thread_vobjs.resize(nthreads);
+    while (_thread_sts.size() < (size_t)nthreads) _thread_sts.push_back(new SpaceTraceScratch);
+    while (_vobj_arenas.size() < (size_t)nthreads) _vobj_arenas.push_back(new FrameArena);
+    while (_vobj_arenas1.size() < (size_t)nthreads) _vobj_arenas1.push_back(new FrameArena);
+    n = _space.comp_off.size() - 1;
+    chunk_size = component_chunk_size;
+  } else if (type == 9) {
+    _thread_pes.resize(nthreads);
+    n = _candidate_edges.size();
+    chunk_size = edge_chunk_size;
+  } else if (type == 10) {
+    const int *d = ((const GLGPU3DDataset*)_dataset)->dims();
+    _thread_pfs.resize(nthreads);
+    _thread_skipped.assign(nthreads, 0);
+    n = 1;
+    for (int i=0; i<3; i++) 
+      n *= (d[i] + _brick_size - 1) / _brick_size;
+    chunk_size = brick_chunk_size;
+  } else if (type == 11) {
+    const int *d = ((const GLGPU3DDataset*)_dataset)->dims();
+    n = (size_t)d[0] * d[1] * d[2];
+    _axis_phase.resize(n*3);
+    chunk_size = edge_phase_chunk_size;
+  } else if (type == 12) {
+    const int *d = ((const GLGPU3DDataset*)_dataset)->dims();
+    _thread_pfs.resize(nthreads);
+    _thread_skipped.assign(nthreads, 0);
+    n = (size_t)d[0] * d[1] * d[2];
+    chunk_size = cell_chunk_size;
+  } else assert(false);
+
+  _pool->ParallelFor(n, chunk_size, 
+      [this, type, slot](int tid, size_t i0, size_t i1) {execute_chunk(tid, i0, i1, type, slot);});
 }
 
-void VortexExtractor::execute_thread(int nthreads, int tid, int type, int slot)
+void VortexExtractor::execute_chunk(int tid, size_t i0, size_t i1, int type, int slot)
 {
   const MeshGraph *mg = _dataset->MeshGraph();
 
-  // fprintf(stderr, "nthreads=%d, tid=%d, type=%d\n", nthreads, tid, type);
   if (type == 0) {
-    for (FaceIdType i=tid; i<mg->NFaces(); i+=nthreads) {
-      ExtractFace(i, slot);
+    std::vector<std::pair<FaceIdType, PuncturedFace> > &pfs = _thread_pfs[tid];
+    PuncturedFace pf;
+    for (FaceIdType i=i0; i<i1; i++) {
+      pf.chirality = _edge_centric ? CheckFaceByEdges(i, slot, pf.pos) : CheckFace(i, slot, pf.pos);
+      if (pf.chirality != 0) 
+        pfs.push_back(std::make_pair(i, pf));
+    }
+  } else if (type == 1) {
+    std::vector<std::pair<EdgeIdType, PuncturedEdge> > &pes = _thread_pes[tid];
+    PuncturedEdge pe;
+    for (EdgeIdType i=i0; i<i1; i++) {
+      pe.chirality = CheckSpaceTimeEdge(i, pe.t);
+      if (pe.chirality != 0) 
+        pes.push_back(std::make_pair(i, pe));
+    }
+  } else if (type == 2) {
+    std::vector<PuncturedCellRecord> &pcs = _thread_pcs[tid];
+    CFaceView face;
+    PuncturedCellRecord r;
+    for (size_t i=i0; i<i1; i++) {
+      mg->FaceView(_pf_list[i].first, face);
+      for (int j=0; j<face.ncontained_cells; j++) {
+        if (face.contained_cells[j] == UINT_MAX) continue;
+        r.cid = face.contained_cells[j];
+        r.fid = face.contained_cells_fid[j];
+        r.chirality = _pf_list[i].second * face.contained_cells_chirality[j];
+        pcs.push_back(r);
+      }
+    }
+  } else if (type == 3) {
+    for (EdgeIdType i=i0; i<i1; i++) 
+      _edge_phase[i] = EdgePhaseJump(i, slot);
+  } else if (type == 4) {
+    GLGPU3DDataset *ds = (GLGPU3DDataset*)_dataset;
+    GLHeader h;
+    float *rho, *phi, *re, *im, *J;
+    ds->GetDataArray(h, &rho, &phi, &re, &im, &J, slot);
+
+    face_kernel_hdr_t kh;
+    for (int i=0; i<3; i++) {
+      kh.d[i] = ds->dims()[i];
+      kh.origins[i] = ds->Origins()[i];
+      kh.cell_lengths[i] = ds->CellLengths()[i];
+      kh.B[i] = ds->B(slot)[i];
+    }
+    kh.Kx = ds->Kex(slot);
+    kh.gauge = _gauge;
+    kh.phi = phi;
+
+    const bool simd = face_kernel_simd_supported();
+    std::vector<FaceIdType> candidates;
+    std::vector<std::pair<FaceIdType, PuncturedFace> > &pfs = _thread_pfs[tid];
+    PuncturedFace pf;
+    for (size_t r=i0; r<i1; r++) {
+      const int t = r % 3, j = (r/3) % kh.d[1], k = r / (3*kh.d[1]);
+      candidates.clear();
+      face_kernel_screen_row(kh, t, j, k, simd, candidates);
+      for (size_t q=0; q<candidates.size(); q++) {
+        pf.chirality = CheckFace(candidates[q], slot, pf.pos);
+        if (pf.chirality != 0) 
+          pfs.push_back(std::make_pair(candidates[q], pf));
+      }
+    }
+  } else if (type == 5) {
+    RelationGraph &g = _rel;
+    const size_t nf = g.faces.size();
+    CFaceView face;
+    for (size_t i=i0; i<i1; i++) {
+      if (i < nf) {
+        mg->FaceView(g.faces[i], face);
+        unsigned int *edges = &g.face_edges[i * CFaceView::MAX_NODES];
+        ChiralityType *echi = &g.face_echi[i * CFaceView::MAX_NODES];
+        int n = 0;
+        for (int j=0; j<face.nnodes; j++) {
+          PuncturedEdgeMap::const_iterator it = _punctured_edges.find(face.edges[j]);
+          if (it == _punctured_edges.end()) continue;
+          edges[n] = _punctured_edges.index(it);
+          echi[n++] = face.edges_chirality[j];
+          uf_union(g.parent.data(), i, nf + edges[n-1]);
+        }
+        g.face_nedges[i] = n;
+      } else {
+        const size_t e = i - nf;
+        for (unsigned int j=g.edge_off[e]; j<g.edge_off[e+1]; j++)
+          uf_union(g.parent.data(), i, g.edge_faces[j]);
+      }
+    }
+  } else if (type == 6) {
+    // same traversal as the original per-face search: a stack of (face,
+    // chirality), faces are marked visited when popped and edges when first
+    // examined.  stamps are unique per slot-0 face, and components are
+    // disjoint, so no two threads touch the same marks.
+    RelationGraph &g = _rel;
+    std::vector<FaceIdType> &related = _thread_related[tid];
+    std::vector<std::pair<unsigned int, int> > &stack = g.stacks[tid];
+    for (size_t c=i0; c<i1; c++) {
+      for (unsigned int q=g.comp_off[c]; q<g.comp_off[c+1]; q++) {
+        const unsigned int k = g.comp_seeds[q], stamp = k+1;
+        RelationGraph::Result &r = g.results[k];
+        r.tid = tid;
+        r.off = related.size();
+
+        stack.clear();
+        stack.push_back(std::make_pair(g.seed_face[k], (int)g.chi0[g.seed_face[k]]));
+        while (!stack.empty()) {
+          const unsigned int current = stack.back().first;
+          const int current_chirality = stack.back().second;
+          stack.pop_back();
+          g.face_stamp[current] = stamp;
+
+          if (g.chi1[current] != 0 && g.chi1[current] == current_chirality)
+            related.push_back(g.faces[current]);
+
+          for (unsigned int i=0; i<g.face_nedges[current]; i++) {
+            const unsigned int e = g.face_edges[current * CFaceView::MAX_NODES + i];
+            if (g.edge_stamp[e] == stamp) continue;
+            g.edge_stamp[e] = stamp;
+
+            const PuncturedEdge &pe = _punctured_edges.at(e).second;
+            const int echirality = g.face_echi[current * CFaceView::MAX_NODES + i] * pe.chirality;
+            if (current_chirality != echirality) continue;
+            for (unsigned int j=g.edge_off[e]; j<g.edge_off[e+1]; j++) 
+              if (g.face_stamp[g.edge_faces[j]] != stamp)
+                stack.push_back(std::make_pair(g.edge_faces[j], -g.edge_fchi[j] * pe.chirality));
+          }
+        }
+        r.cnt = related.size() - r.off;
+      }
+    }
+  } else if (type == 7) {
+    const PuncturedCellMap &pcs = slot == 0 ? _punctured_cells : _punctured_cells1;
+    const CellIdType ncells = mg->NCells();
+    CCellView cell;
+    for (size_t i=i0; i<i1; i++) {
+      const PuncturedCell &pcell = pcs.at(i).second;
+      unsigned int *links = &_space.links[i * CCellView::MAX_FACES];
+      mg->CellView(pcs.at(i).first, cell);
+      for (int j=0; j<CCellView::MAX_FACES; j++) {
+        const CellIdType c1 = j < cell.nfaces ? cell.neighbor_cells[j] : UINT_MAX;
+        if (c1 < ncells                 // valid neighbor cell
+            && pcell.Chirality(j) != 0  // corresponding face punctured
+            && _cell_bits.test(c1))     // neighbor cell punctured
+        {
+          links[j] = pcs.index(pcs.find(c1));
+          uf_union(_space.parent.data(), i, links[j]);
+        } else 
+          links[j] = UINT_MAX;
+      }
+    }
+  } else if (type == 8) {
+    const PuncturedCellMap &pcs = slot == 0 ? _punctured_cells : _punctured_cells1;
+    std::vector<std::pair<unsigned int, VortexObject> > &vobjs = _thread_vobjs[tid];
+    FrameArena *arena = (slot == 0 ? _vobj_arenas : _vobj_arenas1)[tid];
+    SpaceTraceScratch &sts = *_thread_sts[tid];
+    std::vector<char> &state = sts.state;
+    std::vector<unsigned int> &to_visit = sts.to_visit;
+    for (size_t k=i0; k<i1; k++) {
+      const unsigned int *cells = &_space.comp_cells[_space.comp_off[k]];
+      const size_t n = _space.comp_off[k+1] - _space.comp_off[k];
+      for (size_t q=0; q<n; q++) 
+        _space.local[cells[q]] = q;
+      state.assign(n, 0);
+
+      for (size_t q0=0; q0<n; q0++) {
+        if (state[q0] != 0) continue;
+
+        /// 1. connected punctured cells, breadth-first search
+        to_visit.clear();
+        to_visit.push_back(cells[q0]);
+        state[q0] = 1;
+        for (size_t q=0; q<to_visit.size(); q++) {
+          const unsigned int *links = &_space.links[to_visit[q] * CCellView::MAX_FACES];
+          for (int j=0; j<CCellView::MAX_FACES; j++) 
+            if (links[j] != UINT_MAX && state[_space.local[links[j]]] == 0) {
+              state[_space.local[links[j]]] = 1;
+              to_visit.push_back(links[j]);
+            }
+        }
+        std::sort(to_visit.begin(), to_visit.end());
+        for (size_t q=0; q<to_visit.size(); q++) 
+          state[_space.local[to_visit[q]]] = 2;
+
+        /// 2. trace vortex lines
+        vobjs.push_back(std::make_pair(cells[q0], VortexObject(arena)));
+        trace_component(mg, pcs, to_visit.data(), to_visit.size(), sts, vobjs.back().second);
+      }
+    }
+  } else if (type == 9) {
+    std::vector<std::pair<EdgeIdType, PuncturedEdge> > &pes = _thread_pes[tid];
+    PuncturedEdge pe;
+    for (size_t i=i0; i<i1; i++) {
+      pe.chirality = CheckSpaceTimeEdge(_candidate_edges[i], pe.t);
+      if (pe.chirality != 0) 
+        pes.push_back(std::make_pair(_candidate_edges[i], pe));
+    }
+  } else if (type == 10) {
+    GLGPU3DDataset *ds = (GLGPU3DDataset*)_dataset;
+    GLHeader h;
+    float *rho, *phi, *re, *im, *J;
+    ds->GetDataArray(h, &rho, &phi, &re, &im, &J, slot);
+
+    brick_screen_hdr_t bh;
+    for (int i=0; i<3; i++) {
+      bh.d[i] = ds->dims()[i];
+      bh.origins[i] = ds->Origins()[i];
+      bh.cell_lengths[i] = ds->CellLengths()[i];
+      bh.B[i] = ds->B(slot)[i];
+    }
+    bh.Kx = ds->Kex(slot);
+    bh.gauge = _gauge;
+    bh.re = re;
+    bh.im = im;
+
+    const int *d = bh.d, bs = _brick_size, 
+              nb[2] = {(d[0] + bs - 1) / bs, (d[1] + bs - 1) / bs};
+    const size_t nfaces_per_node = mg->NFaces() / ((size_t)d[0] * d[1] * d[2]);
+    std::vector<float> scratch;
+    std::vector<std::pair<FaceIdType, PuncturedFace> > &pfs = _thread_pfs[tid];
+    PuncturedFace pf;
+    for (size_t b=i0; b<i1; b++) {
+      const int bidx[3] = {(int)(b % nb[0]), (int)((b / nb[0]) % nb[1]), (int)(b / nb[0] / nb[1])};
+      int lo[3], hi[3], hi_node[3];
+      for (int i=0; i<3; i++) {
+        lo[i] = bidx[i] * bs;
+        hi[i] = std::min(lo[i] + bs, d[i]); // faces of the nodes in [lo, hi)
+        hi_node[i] = std::min(lo[i] + bs, d[i] - 1); // have their nodes in [lo, hi_node]
+      }
+      if (!brick_may_be_punctured(bh, lo, hi_node, scratch)) {
+        _thread_skipped[tid] ++;
+        continue;
+      }
+
+      for (int k=lo[2]; k<hi[2]; k++) 
+        for (int j=lo[1]; j<hi[1]; j++) 
+          for (int i=lo[0]; i<hi[0]; i++) {
+            const size_t nid = i + d[0] * ((size_t)j + d[1] * (size_t)k);
+            for (size_t t=0; t<nfaces_per_node; t++) {
+              const FaceIdType fid = nid * nfaces_per_node + t;
+              pf.chirality = CheckFace(fid, slot, pf.pos);
+              if (pf.chirality != 0) 
+                pfs.push_back(std::make_pair(fid, pf));
+            }
+          }
+    }
+  } else if (type == 11) {
+    const int *d = ((const GLGPU3DDataset*)_dataset)->dims();
+    const size_t s[3] = {1, (size_t)d[0], (size_t)d[0]*d[1]};
+    for (size_t i=i0; i<i1; i++) {
+      const int idx[3] = {(int)(i % d[0]), (int)((i / d[0]) % d[1]), (int)(i / s[2])};
+      for (int t=0; t<3; t++) 
+        _axis_phase[i*3+t] = idx[t] < d[t]-1 ? NodePhaseJump(i, i+s[t], slot) : NAN;
+    }
+  } else if (type == 12) {
+    const GLGPU3DDataset *ds = (const GLGPU3DDataset*)_dataset;
+    const int *d = ds->dims();
+    const float *B = ds->B(slot), *cl = ds->CellLengths();
+    const size_t s[3] = {1, (size_t)d[0], (size_t)d[0]*d[1]};
+
+    // bound of the flux through loops within a cube
+    const float margin = 1e-2f;
+    float flux = 0;
+    if (_gauge) 
+      for (int t=0; t<3; t++) 
+        flux += fabs(B[t]) * cl[(t+1)%3] * cl[(t+2)%3];
+    const float max_jump = ((float)M_PI - margin - flux) / 3, 
+                max_quad = (float)M_PI - margin;
+
+    std::vector<std::pair<FaceIdType, PuncturedFace> > &pfs = _thread_pfs[tid];
+    PuncturedFace pf;
+    for (size_t i=i0; i<i1; i++) {
+      const int idx[3] = {(int)(i % d[0]), (int)((i / d[0]) % d[1]), (int)(i / s[2])};
+      if (idx[0] < d[0]-1 && idx[1] < d[1]-1 && idx[2] < d[2]-1 && 
+          cube_ruled_out(_axis_phase.data(), s, i, max_jump, max_quad)) {
+        _thread_skipped[tid] ++;
+        continue;
+      }
+      for (int t=0; t<12; t++) {
+        const FaceIdType fid = i*12 + t;
+        pf.chirality = CheckFace(fid, slot, pf.pos);
+        if (pf.chirality != 0) 
+          pfs.push_back(std::make_pair(fid, pf));
+      }
     }
-  } else if (type == 1) { // TODO
-    for (EdgeIdType i=tid; i<mg->NEdges(); i+=nthreads) 
-      ExtractSpaceTimeEdge(i);
   } else assert(false);
 }
 
+void VortexExtractor::MergePuncturedFaces(int slot)
+{
+  PuncturedFaceMap &pfs = slot == 0 ? _punctured_faces : _punctured_faces1;
+  std::vector<std::pair<FaceIdType, PuncturedFace> > &all = _merged_pfs;
+
+  gather_thread_lists(_thread_pfs, all);
+  std::sort(all.begin(), all.end(), 
+      [](const std::pair<FaceIdType, PuncturedFace>& a, const std::pair<FaceIdType, PuncturedFace>& b) {return a.first < b.first;});
+  
+  pfs.merge(all);
+}
+
+void VortexExtractor::MergePuncturedEdges()
+{
+  std::vector<std::pair<EdgeIdType, PuncturedEdge> > &all = _merged_pes;
+  
+  gather_thread_lists(_thread_pes, all);
+  std::sort(all.begin(), all.end(), 
+      [](const std::pair<EdgeIdType, PuncturedEdge>& a, const std::pair<EdgeIdType, PuncturedEdge>& b) {return a.first < b.first;});
+
+  _punctured_edges.merge(all);
+}
+
+void VortexExtractor::BuildPuncturedCells(int slot)
+{
+  const PuncturedFaceMap &pfs = slot == 0 ? _punctured_faces : _punctured_faces1;
+  PuncturedCellMap &pcs = slot == 0 ? _punctured_cells : _punctured_cells1;
+
+  _pf_list.clear();
+  for (PuncturedFaceMap::const_iterator it = pfs.begin(); it != pfs.end(); it ++) 
+    _pf_list.push_back(std::make_pair(it->first, it->second.chirality));
+
+  execute_threads(2, slot);
+  
+  std::vector<PuncturedCellRecord> &all = _merged_pcs;
+  all.clear();
+  gather_thread_lists(_thread_pcs, all);
+  std::sort(all.begin(), all.end());
+
+  // the chirality bits are order-independent
+  pcs.clear();
+  for (size_t i=0; i<all.size(); i++) 
+    pcs[all[i].cid].SetChirality(all[i].fid, all[i].chirality); // appended in ascending order
+}
+
 bool VortexExtractor::FindFaceZero(int n, const float X_[][3], const float re[], const float im[], float pos[3]) const
 {
   const float epsilon = 0.05;
@@ -10,6 +10,7 @@
 
 class GLDataset;
 class GLDatasetBase;
+struct SpaceTraceScratch;
 
 enum {
   INTERPOLATION_TRI_CENTER = 0x1,
@@ -23,16 +24,25 @@ enum {
 class VortexExtractor {
 public: 
   VortexExtractor(); 
-  ~VortexExtractor(); 
+  virtual ~VortexExtractor(); 
 
   void SetNumberOfThreads(int);
+  int NumberOfThreads() const {return _nthreads;}
+  size_t NumberOfArenaAllocations() const; // heap blocks taken by the vortex object arenas so far, see the n_arena of the stage timings
   void SetInterpolationMode(unsigned int);
 
   void SetGaugeTransformation(bool);
   void SetArchive(bool); // archive intermediate results for data reuse
   void SetExtentThreshold(float);
   void SetGPU(bool);
-  void SetPertubation(float);
+  void SetPertubation(float); // noise added to re/im before the extraction, gpu path only
+  void SetPertubationSeed(unsigned int); // the k-th perturbed extraction after this draws noise stream k of the seed
+  void SetEdgeCentric(bool); // compute phase jumps once per edge, faces sum them up
+  void SetSIMD(bool); // vectorized face screening, GLGPU3DDataset hex mesh only
+  void SetEdgePruning(int k); // only check space-time edges within k cells of punctured faces, <0 disables
+  void SetComplexPhase(bool); // phase jumps from complex products of re/im, rho/phi are not needed
+  void SetBrickScreening(int size); // skip bricks of size^3 cells that provably have no punctured face, 0 disables
+  void SetHybrid(bool); // tet mesh: check tet faces only in cubes that the hex edges/faces cannot rule out
   
   virtual void SetDataset(const GLDatasetBase* ds);
   const GLDataset* Dataset() const {return (GLDataset*)_dataset;}
@@ -44,6 +54,13 @@ public:
   void ExtractFaces_GPU(int slot=0);
   void ExtractEdges_GPU();
 
+  // one sweep over the faces for K (pertubation, seed) pairs, the k-th face
+  // set equals ExtractFaces_GPU() after SetPertubation(pertubations[k]) and
+  // SetPertubationSeed(seeds[k]).  SelectFacesMulti_GPU(k) takes the k-th set
+  // as the punctured faces of the slot.
+  void ExtractFacesMulti_GPU(const std::vector<float>& pertubations, const std::vector<unsigned int>& seeds, int slot=0);
+  void SelectFacesMulti_GPU(int k, int slot=0);
+
   bool SavePuncturedEdges() const;
   bool LoadPuncturedEdges();
   bool SavePuncturedFaces(int slot=0) const; 
@@ -69,9 +86,19 @@ public:
   int ExtractFace(FaceIdType, int slot=0); // returns chirality
   void ExtractSpaceTimeEdge(EdgeIdType);
 
+protected: // thread-safe checks, nothing is recorded
+  ChiralityType CheckFace(FaceIdType, int slot, float pos[3]) const;
+  ChiralityType CheckSpaceTimeEdge(EdgeIdType, float &t) const;
+  ChiralityType CheckFaceByEdges(FaceIdType, int slot, float pos[3]) const; // uses _edge_phase
+  float EdgePhaseJump(EdgeIdType, int slot) const; // gauge-corrected phase jump from node0 to node1
+  float NodePhaseJump(NodeIdType n0, NodeIdType n1, int slot) const; // same for any pair of nodes
+  bool UseFaceKernel() const; // whether the dataset/mesh is supported by the simd face screening
+  bool UseBrickScreen() const; // whether the dataset is supported by the brick screening
+  bool UseHybrid() const; // whether the dataset/mesh is supported by the hybrid mode
+
 protected:
   void VortexObjectsToVortexLines(int slot=0);
-  void VortexObjectsToVortexLines(const std::map<FaceIdType, PuncturedFace>& pfs, const std::vector<VortexObject>& vobjs, std::vector<VortexLine>& vlines, bool bezier=false);
+  void VortexObjectsToVortexLines(const PuncturedFaceMap& pfs, const std::vector<VortexObject>& vobjs, std::vector<VortexLine>& vlines, bool bezier=false);
   int NewGlobalVortexId();
   void ResetGlobalVortexId();
 
@@ -79,16 +106,79 @@ public:
   void AddPuncturedFace(FaceIdType, int slot, ChiralityType chirality, const float pos[3]);
   void AddPuncturedEdge(EdgeIdType, ChiralityType chirality, float t);
 
+protected:
+  void MergePuncturedFaces(int slot); // merge per-thread buffers
+  void MergePuncturedEdges();
+  void BuildPuncturedCells(int slot); // derive punctured cells from punctured faces
+  bool FindCandidateEdges(); // edges near punctured faces, false if the full sweep is cheaper
+  void UploadData_GPU(int slot);
+
 protected:
   bool FindFaceZero(int n, const float X[][3], const float re[], const float im[], float pos[3]) const;
   bool FindSpaceTimeEdgeZero(const float re[], const float im[], float &t) const;
 
 protected:
-  std::map<FaceIdType, PuncturedFace> _punctured_faces, _punctured_faces1; 
-  std::map<CellIdType, PuncturedCell> _punctured_cells, _punctured_cells1;
-  std::map<EdgeIdType, PuncturedEdge> _punctured_edges;
+  PuncturedFaceMap _punctured_faces, _punctured_faces1; 
+  PuncturedCellMap _punctured_cells, _punctured_cells1;
+  PuncturedEdgeMap _punctured_edges;
   // std::map<FaceIdType, PuncturedCell> _punctured_vcells;
-  std::map<FaceIdType, std::vector<FaceIdType> > _related_faces;
+  FlatListMap<FaceIdType, FaceIdType> _related_faces;
+  IdBitmap _cell_bits; // scratch bitmap over cell ids, all clear between uses
+
+  // per-thread output buffers, merged after each parallel pass
+  struct PuncturedCellRecord {
+    CellIdType cid;
+    int fid; // face index in the cell
+    ChiralityType chirality;
+    bool operator<(const PuncturedCellRecord& r) const {return cid < r.cid;}
+  };
+  std::vector<std::vector<std::pair<FaceIdType, PuncturedFace> > > _thread_pfs;
+  std::vector<std::vector<std::pair<EdgeIdType, PuncturedEdge> > > _thread_pes;
+  std::vector<std::vector<PuncturedCellRecord> > _thread_pcs;
+  std::vector<std::pair<FaceIdType, ChiralityType> > _pf_list; // input of the cell pass
+  std::vector<std::pair<FaceIdType, PuncturedFace> > _merged_pfs; // scratch of the merges, kept across timesteps
+  std::vector<std::pair<EdgeIdType, PuncturedEdge> > _merged_pes;
+  std::vector<PuncturedCellRecord> _merged_pcs;
+  std::vector<float> _edge_phase; // per-edge phase jumps of the current slot, edge-centric mode
+  std::vector<EdgeIdType> _candidate_edges; // input of the pruned edge pass
+  IdBitmap _edge_bits; // scratch bitmap over edge ids, all clear between uses
+  std::vector<float> _axis_phase; // phase jumps along x, y, z from each node, hybrid mode
+  std::vector<size_t> _thread_skipped; // bricks or cubes ruled out by the screening
+
+  // space-time puncture graph of RelateOverTime().  faces are numbered by
+  // their rank in faces, punctured edges by their rank in _punctured_edges.
+  struct RelationGraph {
+    std::vector<FaceIdType> faces; // slot-0 faces and faces around punctured edges, sorted
+    std::vector<FaceIdType> edge_fids; // faces around punctured edges, by edge
+    std::vector<ChiralityType> chi0, chi1; // face chirality in slot 0/1, 0 if not punctured
+    std::vector<unsigned int> face_nedges, face_edges; // punctured edges of faces, MAX_NODES per face
+    std::vector<ChiralityType> face_echi;
+    std::vector<unsigned int> edge_off, edge_faces; // faces around punctured edges, CSR
+    std::vector<ChiralityType> edge_fchi;
+    std::vector<unsigned int> parent; // union-find over faces and edges (edges after faces)
+    std::vector<unsigned int> seed_face; // face of the i-th slot-0 punctured face
+    std::vector<unsigned int> comp_off, comp_seeds; // slot-0 faces by component, CSR
+    std::vector<unsigned int> count; // slot-0 faces per component
+    std::vector<unsigned int> face_stamp, edge_stamp; // visited marks of the traversals
+    struct Result {int tid; size_t off, cnt;};
+    std::vector<Result> results; // related faces of the i-th slot-0 face in _thread_related
+    std::vector<std::vector<std::pair<unsigned int, int> > > stacks; // per-thread, (face, chirality) of the traversals
+  } _rel;
+  std::vector<std::vector<FaceIdType> > _thread_related;
+  // weakly connected components of punctured cells in TraceOverSpace(),
+  // cells are numbered by their rank in the punctured cell map
+  struct SpaceComponents {
+    std::vector<unsigned int> links; // linked neighbor cells, MAX_FACES per cell, UINT_MAX if none
+    std::vector<unsigned int> parent; // union-find
+    std::vector<unsigned int> comp_off, comp_cells; // cells by component, CSR
+    std::vector<unsigned int> local; // index of cells in their component
+    std::vector<unsigned int> count; // cells per component
+    std::vector<std::pair<unsigned int, std::pair<int, size_t> > > order; // (seed cell, (tid, index)) of the objects
+  } _space;
+  std::vector<std::vector<std::pair<unsigned int, VortexObject> > > _thread_vobjs; // (seed cell, object)
+  std::vector<SpaceTraceScratch*> _thread_sts; // per-thread buffers of the space tracing
+  std::vector<FrameArena*> _vobj_arenas, _vobj_arenas1; // per-thread, faces and traces of the objects in slot 0/1
+  std::vector<std::pair<FaceIdType, int> > _face_objects1; // (face, slot-1 object), sorted
 
   std::vector<VortexObject> _vortex_objects, _vortex_objects1;
   std::vector<VortexLine> _vortex_lines, _vortex_lines1;
@@ -100,17 +190,28 @@ protected:
   bool _gauge; 
   bool _archive;
   bool _gpu;
+  bool _edge_centric;
+  bool _simd;
+  int _edge_pruning;
+  bool _complex_phase;
+  int _brick_size;
+  bool _hybrid;
   unsigned int _interpolation_mode;
   float _pertubation; // used for stochastic analysis
+  unsigned int _pertubation_seed;
   float _extent_threshold;
 
   struct vfgpu_ctx_t *_vfgpu_ctx;
 
 private:
-  static void *execute_thread_helper(void *ctx);
-  void execute_thread(int nthreads, int tid, int type, int slot);
+  void execute_threads(int type, int slot); // 0: faces; 1: edges; 2: cells; 3: edge phase jumps; 4: face rows (simd);
+                                            // 5: relation graph; 6: relation components;
+                                            // 7: space components; 8: space tracing; 9: candidate edges;
+                                            // 10: bricks of faces; 11: axis phase jumps; 12: cubes of tet faces
+  void execute_chunk(int tid, size_t i0, size_t i1, int type, int slot);
 
   int _nthreads;
+  class WorkerPool *_pool; // persistent, created on first use
   pthread_mutex_t _mutex;
 }; 
 
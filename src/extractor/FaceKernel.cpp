@@ -0,0 +1,179 @@
+#include "FaceKernel.h"
+#include <cmath>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define FACE_KERNEL_AVX2 1
+#include <immintrin.h>
+#endif
+
+// node offsets of the three face types, same order as MeshGraphRegular3D::FaceView
+static const int nodes_off[3][4][3] = {
+  {{0, 0, 0}, {0, 1, 0}, {0, 1, 1}, {0, 0, 1}},
+  {{0, 0, 0}, {0, 0, 1}, {1, 0, 1}, {1, 0, 0}},
+  {{0, 0, 0}, {1, 0, 0}, {1, 1, 0}, {0, 1, 0}}};
+
+// a face is only rejected if all its phase jumps are further than the margin
+// from the branch cut at +-pi and the winding number is further than the
+// margin from 0.5, so rounding differences to the scalar path (mod2pi1 in
+// double, fmod) cannot change the classification.  the scalar rounding error
+// grows with the magnitude of the jump, hence the bound on it.
+static const float margin = 1e-2f,
+                   max_jump = 1024.f;
+
+// 2pi in two parts for the range reduction; n*twopi_hi is exact for |n|<2^16
+static const float twopi_hi = 6.28125f,
+                   twopi_lo = 1.9353071795864769e-3f,
+                   inv_twopi = 0.15915494309189535f;
+
+static inline void node_A(const face_kernel_hdr_t &h, const float X[3], float A[3])
+{
+  // see GLGPUDataset::A()
+  if (h.B[1]>0) {
+    A[0] = -h.Kx;
+    A[1] = X[0] * h.B[2];
+    A[2] = -X[0] * h.B[1];
+  } else {
+    A[0] = -X[1] * h.B[2] - h.Kx;
+    A[1] = 0;
+    A[2] = X[1] * h.B[0];
+  }
+}
+
+static bool may_be_punctured(const face_kernel_hdr_t &h, int t, int i, int j, int k)
+{
+  float X[4][3], A[4][3], phi[4];
+  for (int p=0; p<4; p++) {
+    const int *o = nodes_off[t][p];
+    const int idx[3] = {i+o[0], j+o[1], k+o[2]};
+    for (int q=0; q<3; q++)
+      X[p][q] = idx[q] * h.cell_lengths[q] + h.origins[q];
+    node_A(h, X[p], A[p]);
+    phi[p] = h.phi[idx[0] + h.d[0] * (idx[1] + h.d[1] * idx[2])];
+  }
+
+  float sum = 0;
+  for (int p=0; p<4; p++) {
+    const int q = (p+1) % 4;
+    float x = phi[q] - phi[p];
+    if (h.gauge)
+      x -= 0.5f * ((A[p][0] + A[q][0]) * (X[q][0] - X[p][0])
+                 + (A[p][1] + A[q][1]) * (X[q][1] - X[p][1])
+                 + (A[p][2] + A[q][2]) * (X[q][2] - X[p][2]));
+    if (!(fabsf(x) < max_jump)) return true;
+
+    const float n = nearbyintf(x * inv_twopi),
+                r = (x - n * twopi_hi) - n * twopi_lo;
+    if (!(fabsf(r) < (float)M_PI - margin)) return true;
+    sum += r;
+  }
+
+  return !(fabsf(sum) < (float)(2*M_PI) * (0.5f - margin));
+}
+
+#if FACE_KERNEL_AVX2
+bool face_kernel_simd_supported()
+{
+  return __builtin_cpu_supports("avx2");
+}
+
+// same as may_be_punctured() for faces i0..i0+7, returns a bit mask
+__attribute__((target("avx2")))
+static int may_be_punctured_avx2(const face_kernel_hdr_t &h, int t, int i0, int j, int k)
+{
+  const __m256 sign = _mm256_set1_ps(-0.f),
+               half = _mm256_set1_ps(0.5f);
+  const __m256 ii = _mm256_cvtepi32_ps(_mm256_add_epi32(_mm256_set1_epi32(i0), _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7)));
+
+  __m256 X[4][3], A[4][3], phi[4];
+  for (int p=0; p<4; p++) {
+    const int *o = nodes_off[t][p];
+    const int idx[3] = {i0+o[0], j+o[1], k+o[2]};
+    X[p][0] = _mm256_add_ps(
+        _mm256_mul_ps(_mm256_add_ps(ii, _mm256_set1_ps(o[0])), _mm256_set1_ps(h.cell_lengths[0])),
+        _mm256_set1_ps(h.origins[0]));
+    X[p][1] = _mm256_set1_ps(idx[1] * h.cell_lengths[1] + h.origins[1]);
+    X[p][2] = _mm256_set1_ps(idx[2] * h.cell_lengths[2] + h.origins[2]);
+    if (h.B[1]>0) {
+      A[p][0] = _mm256_set1_ps(-h.Kx);
+      A[p][1] = _mm256_mul_ps(X[p][0], _mm256_set1_ps(h.B[2]));
+      A[p][2] = _mm256_mul_ps(_mm256_xor_ps(X[p][0], sign), _mm256_set1_ps(h.B[1]));
+    } else {
+      float a[3], x[3] = {0, idx[1] * h.cell_lengths[1] + h.origins[1], 0};
+      node_A(h, x, a);
+      A[p][0] = _mm256_set1_ps(a[0]);
+      A[p][1] = _mm256_set1_ps(a[1]);
+      A[p][2] = _mm256_set1_ps(a[2]);
+    }
+    phi[p] = _mm256_loadu_ps(h.phi + idx[0] + h.d[0] * (idx[1] + h.d[1] * idx[2]));
+  }
+
+  __m256 sum = _mm256_setzero_ps(),
+         ok = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+  for (int p=0; p<4; p++) {
+    const int q = (p+1) % 4;
+    __m256 x = _mm256_sub_ps(phi[q], phi[p]);
+    if (h.gauge) {
+      __m256 li = _mm256_mul_ps(_mm256_add_ps(A[p][0], A[q][0]), _mm256_sub_ps(X[q][0], X[p][0]));
+      li = _mm256_add_ps(li, _mm256_mul_ps(_mm256_add_ps(A[p][1], A[q][1]), _mm256_sub_ps(X[q][1], X[p][1])));
+      li = _mm256_add_ps(li, _mm256_mul_ps(_mm256_add_ps(A[p][2], A[q][2]), _mm256_sub_ps(X[q][2], X[p][2])));
+      x = _mm256_sub_ps(x, _mm256_mul_ps(half, li));
+    }
+    ok = _mm256_and_ps(ok, _mm256_cmp_ps(_mm256_andnot_ps(sign, x), _mm256_set1_ps(max_jump), _CMP_LT_OQ));
+
+    const __m256 n = _mm256_round_ps(_mm256_mul_ps(x, _mm256_set1_ps(inv_twopi)), _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC);
+    const __m256 r = _mm256_sub_ps(
+        _mm256_sub_ps(x, _mm256_mul_ps(n, _mm256_set1_ps(twopi_hi))),
+        _mm256_mul_ps(n, _mm256_set1_ps(twopi_lo)));
+    ok = _mm256_and_ps(ok, _mm256_cmp_ps(_mm256_andnot_ps(sign, r), _mm256_set1_ps((float)M_PI - margin), _CMP_LT_OQ));
+    sum = _mm256_add_ps(sum, r);
+  }
+  ok = _mm256_and_ps(ok, _mm256_cmp_ps(_mm256_andnot_ps(sign, sum), _mm256_set1_ps((float)(2*M_PI) * (0.5f - margin)), _CMP_LT_OQ));
+
+  return ~_mm256_movemask_ps(ok) & 0xff;
+}
+#else
+bool face_kernel_simd_supported()
+{
+  return false;
+}
+#endif
+
+void face_kernel_screen_row(
+    const face_kernel_hdr_t &h,
+    int t, int j, int k,
+    bool simd,
+    std::vector<FaceIdType> &candidates)
+{
+  // valid faces of the row, see MeshGraphRegular3D::valid_fidx()
+  int n;
+  if (t == 0) {
+    if (j >= h.d[1]-1 || k >= h.d[2]-1) return;
+    n = h.d[0];
+  } else if (t == 1) {
+    if (k >= h.d[2]-1) return;
+    n = h.d[0]-1;
+  } else {
+    if (j >= h.d[1]-1) return;
+    n = h.d[0]-1;
+  }
+
+  const FaceIdType fid0 = (j * h.d[0] + k * h.d[0] * h.d[1]) * 3 + t;
+  int i = 0;
+
+#if FACE_KERNEL_AVX2
+  if (simd) {
+    for (; i+8<=n; i+=8) {
+      int mask = may_be_punctured_avx2(h, t, i, j, k);
+      while (mask) {
+        const int lane = __builtin_ctz(mask);
+        candidates.push_back(fid0 + (i+lane)*3);
+        mask &= mask-1;
+      }
+    }
+  }
+#endif
+
+  for (; i<n; i++)
+    if (may_be_punctured(h, t, i, j, k))
+      candidates.push_back(fid0 + i*3);
+}
@@ -0,0 +1,32 @@
+#ifndef _FACEKERNEL_H
+#define _FACEKERNEL_H
+
+#include "def.h"
+#include <vector>
+
+// vectorized screening of the faces of a regular hex mesh (GLGPU3DDataset,
+// no pbc).  faces are processed in rows of the same type along x.  the
+// screening is conservative: every face that the scalar check could find
+// punctured is reported as a candidate, and only the candidates need to go
+// through VortexExtractor::CheckFace.
+
+typedef struct {
+  int d[3]; // all >= 3
+  float origins[3];
+  float cell_lengths[3];
+  float B[3];
+  float Kx;
+  bool gauge;
+  const float *phi;
+} face_kernel_hdr_t;
+
+bool face_kernel_simd_supported(); // AVX2 available at runtime
+
+// appends candidate fids of the row (type, j, k)
+void face_kernel_screen_row(
+    const face_kernel_hdr_t &h,
+    int type, int j, int k,
+    bool simd,
+    std::vector<FaceIdType> &candidates);
+
+#endif
@@ -1,10 +1,21 @@
 #include "StochasticExtractor.h"
+#include "common/WorkerPool.h"
+#include "io/GLGPUDataset.h"
 #include "vfgpu/vfgpu.h"
+#include <cmath>
+#include <sstream>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+
+static const size_t batch_size = 8; // runs per sweep over the faces
+static const size_t density_parts = 8; // partial grids of the point binning
 
 StochasticVortexExtractor::StochasticVortexExtractor() :
   _nruns(256),
   _kernel_size(0.5),
   _pertubation(0.04),
+  _seed(1234),
   _density(NULL)
 {
 
@@ -31,6 +42,11 @@ void StochasticVortexExtractor::SetPertubation(float p)
   _pertubation = p;
 }
 
+void StochasticVortexExtractor::SetSeed(unsigned int s)
+{
+  _seed = s;
+}
+
 void StochasticVortexExtractor::ExtractDeterministicVortices()
 {
   Clear();
@@ -41,32 +57,213 @@ void StochasticVortexExtractor::ExtractDeterministicVortices()
 
 void StochasticVortexExtractor::ExtractStochasticVortices()
 {
-  std::vector<float> pts;
-  std::vector<int> acc;
-  int count = 0;
-
-  for (int i=0; i<_nruns; i++) {
-    Clear();
-    VortexExtractor::SetPertubation(_pertubation);
-    ExtractFaces(0);
-    TraceOverSpace(0);
-    VortexObjectsToVortexLines(0);
-
-    for (int i=0; i<_vortex_lines.size(); i++) {
-      const VortexLine& l = _vortex_lines[i];
-      count += l.size();
-      for (int j=0; j<l.size(); j++)
-        pts.push_back(l[j]);
-      acc.push_back(count);
+  typedef std::chrono::high_resolution_clock clock;
+  auto t0 = clock::now();
+
+  // batches of runs are distributed over threads, each with its own
+  // extractor that shares the read-only dataset and mesh graph.  the faces of
+  // a batch are extracted in one sweep.  the noise of run i only depends on
+  // _seed+i (counter-based), so the ensemble does not depend on the
+  // scheduling.  the runners take the settings of this extractor; the
+  // perturbed faces always go through the vfgpu api (cuda or host backend),
+  // whether or not SetGPU() is on.
+  const int nbatches = (_nruns + batch_size - 1) / batch_size;
+  const int nthreads = std::max(1, std::min(NumberOfThreads(), nbatches));
+  std::vector<StochasticVortexExtractor*> runners(nthreads, (StochasticVortexExtractor*)NULL);
+
+  // each runner appends its runs to its own buffer; the runs are then laid
+  // out in the point arena in run order by a prefix sum over their sizes
+  if (_thread_pts.size() < (size_t)nthreads) _thread_pts.resize(nthreads);
+  for (int i=0; i<nthreads; i++)
+    _thread_pts[i].clear();
+
+  std::vector<int> run_tid(_nruns);
+  std::vector<size_t> run_src(_nruns), run_n(_nruns), run_off(_nruns);
+  std::vector<std::vector<size_t> > run_npts(_nruns); // points per line
+
+  WorkerPool pool(nthreads);
+  pool.ParallelFor(nbatches, 1, [&](int tid, size_t b0, size_t b1) {
+    if (runners[tid] == NULL) {
+      StochasticVortexExtractor *ex = new StochasticVortexExtractor;
+      ex->SetDataset(_dataset);
+      ex->SetGaugeTransformation(_gauge);
+      ex->_interpolation_mode = _interpolation_mode;
+      ex->SetExtentThreshold(_extent_threshold);
+      ex->SetGPU(_gpu);
+      ex->SetNumberOfThreads(1);
+      runners[tid] = ex;
+    }
+    StochasticVortexExtractor &ex = *runners[tid];
+    std::vector<float> &buf = _thread_pts[tid];
+
+    for (size_t b=b0; b<b1; b++) {
+      const size_t r0 = b*batch_size, r1 = std::min(r0 + batch_size, (size_t)_nruns);
+      std::vector<float> pertubations(r1 - r0, _pertubation);
+      std::vector<unsigned int> seeds(r1 - r0);
+      for (size_t r=r0; r<r1; r++)
+        seeds[r-r0] = _seed + r;
+      ex.ExtractFacesMulti_GPU(pertubations, seeds, 0);
+
+      for (size_t r=r0; r<r1; r++) {
+        ex.Clear();
+        ex.SelectFacesMulti_GPU(r-r0, 0);
+        ex.TraceOverSpace(0);
+        ex.VortexObjectsToVortexLines(0);
+
+        run_tid[r] = tid;
+        run_src[r] = buf.size();
+        for (size_t i=0; i<ex._vortex_lines.size(); i++) {
+          const VortexLine& l = ex._vortex_lines[i];
+          buf.insert(buf.end(), l.begin(), l.end());
+          run_npts[r].push_back(l.size() / 3);
+        }
+        run_n[r] = buf.size() - run_src[r];
+      }
+    }
+  });
+
+  for (int i=0; i<nthreads; i++)
+    delete runners[i];
+
+  size_t npts = 0;
+  for (int r=0; r<_nruns; r++) {
+    run_off[r] = npts;
+    npts += run_n[r];
+  }
+  _pts.resize(npts); // the capacity is kept across ensembles
+
+  pool.ParallelFor(_nruns, 16, [&](int, size_t r0, size_t r1) {
+    for (size_t r=r0; r<r1; r++)
+      if (run_n[r] > 0)
+        memcpy(_pts.data() + run_off[r], _thread_pts[run_tid[r]].data() + run_src[r], sizeof(float)*run_n[r]);
+  });
+
+  _lines.clear();
+  for (int r=0; r<_nruns; r++) {
+    size_t off = run_off[r];
+    for (size_t i=0; i<run_npts[r].size(); i++) {
+      EnsembleLine l = {r, off, run_npts[r][i]};
+      _lines.push_back(l);
+      off += run_npts[r][i] * 3;
     }
   }
 
+  auto t1 = clock::now();
+  double elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(t1 - t0).count() / 1000000000.0;
+  fprintf(stderr, "t_ensemble=%f, nruns=%d, nlines=%zu, npts=%zu\n", elapsed, _nruns, _lines.size(), _pts.size()/3);
+}
+
+void StochasticVortexExtractor::EstimateDensities()
+{
   typedef std::chrono::high_resolution_clock clock;
   auto t0 = clock::now();
 
-  // vfgpu_density_estimate(pts.size()/3, acc.size(), pts.data(), acc.data());
+  const GLGPUDataset *ds = (const GLGPUDataset*)_dataset;
+  const int *d = ds->dims();
+  const float *O = ds->Origins(), *cl = ds->CellLengths();
+  const size_t count = (size_t)d[0] * d[1] * d[2];
+  const size_t npts = _pts.size() / 3;
+  const float *pts = _pts.data();
+
+  // linear binning over fixed ranges of points, each into its own grid.  the
+  // ranges and the order of the reduction do not depend on the number of
+  // threads, so neither does the density
+  const size_t nparts = std::min(density_parts, (npts + 65535) / 65536);
+  WorkerPool pool(NumberOfThreads());
+  std::vector<std::vector<float> > bins(nparts);
+
+  pool.ParallelFor(nparts, 1, [&](int, size_t p0, size_t p1) {
+    for (size_t p=p0; p<p1; p++) {
+      std::vector<float> &b = bins[p];
+      b.assign(count, 0.f);
+      for (size_t i=npts*p/nparts; i<npts*(p+1)/nparts; i++) {
+        int n[3];
+        float f[3];
+        bool inside = true;
+        for (int q=0; q<3; q++) {
+          const float u = (pts[i*3+q] - O[q]) / cl[q];
+          if (!(u >= 0 && u <= d[q]-1)) {inside = false; break;}
+          n[q] = std::min((int)u, d[q]-2);
+          f[q] = u - n[q];
+        }
+        if (!inside) continue;
+
+        const size_t off = n[0] + d[0] * ((size_t)n[1] + d[1] * (size_t)n[2]);
+        const size_t sy = d[0], sz = (size_t)d[0] * d[1];
+        const float wx[2] = {1-f[0], f[0]}, wy[2] = {1-f[1], f[1]}, wz[2] = {1-f[2], f[2]};
+        for (int k=0; k<2; k++)
+          for (int j=0; j<2; j++) {
+            float *v = &b[off + j*sy + k*sz];
+            const float w = wy[j] * wz[k];
+            v[0] += wx[0] * w;
+            v[1] += wx[1] * w;
+          }
+      }
+    }
+  });
+
+  _density = (float*)realloc(_density, sizeof(float)*count);
+  std::vector<float> tmp(count);
+
+  // reduction of the partial grids in part order
+  const float scale = npts > 0 ? 1.f / npts : 0.f;
+  pool.ParallelFor(count, 65536, [&](int, size_t i0, size_t i1) {
+    for (size_t i=i0; i<i1; i++) {
+      float sum = 0;
+      for (size_t p=0; p<nparts; p++)
+        sum += bins[p][i];
+      tmp[i] = sum * scale;
+    }
+  });
+  bins.clear();
+
+  // separable convolution with exp(-0.5*x^2/h^2), truncated at 3h.  like
+  // in density.cu, the densities are normalized by the number of points.
+  // the result of the third pass is in _density
+  const float h = _kernel_size;
+  float *src = tmp.data(), *dst = _density;
+  for (int q=0; q<3; q++) {
+    const int r = std::max(0, (int)ceil(3 * h / cl[q]));
+    std::vector<float> w(2*r+1);
+    for (int k=-r; k<=r; k++)
+      w[k+r] = exp(-0.5 * (k*cl[q]/h) * (k*cl[q]/h));
+
+    const size_t stride = q == 0 ? 1 : (q == 1 ? d[0] : (size_t)d[0] * d[1]);
+    const size_t nrows = count / d[q];
+    pool.ParallelFor(nrows, 256, [&](int, size_t i0, size_t i1) {
+      for (size_t row=i0; row<i1; row++) {
+        // first node of the row
+        const size_t base = q == 0 ? row * d[0] :
+          (q == 1 ? (row / d[0]) * d[0] * d[1] + row % d[0] : row);
+        for (int i=0; i<d[q]; i++) {
+          float sum = 0;
+          const int k0 = std::max(-r, -i), k1 = std::min(r, d[q]-1-i);
+          for (int k=k0; k<=k1; k++)
+            sum += w[k+r] * src[base + (i+k)*stride];
+          dst[base + i*stride] = sum;
+        }
+      }
+    });
+    std::swap(src, dst);
+  }
 
   auto t1 = clock::now();
   double elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(t1 - t0).count() / 1000000000.0;
-  fprintf(stderr, "t_density=%f\n", elapsed);
+  fprintf(stderr, "t_density=%f, npts=%zu\n", elapsed, npts);
+}
+
+void StochasticVortexExtractor::SaveDensity() const
+{
+  if (_density == NULL) return;
+
+  const GLGPUDataset *ds = (const GLGPUDataset*)_dataset;
+  const int *d = ds->dims();
+  std::ostringstream os;
+  os << ds->DataName() << ".density." << ds->TimeStep(0);
+
+  FILE *fp = fopen(os.str().c_str(), "wb");
+  if (fp == NULL) return;
+  fwrite(_density, sizeof(float), (size_t)d[0] * d[1] * d[2], fp);
+  fclose(fp);
+  fprintf(stderr, "OUT: %s\n", os.str().c_str());
 }
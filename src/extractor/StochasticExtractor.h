@@ -2,6 +2,7 @@
 #define _STOCHASTIC_EXTRACTOR_H
 
 #include "Extractor.h"
+#include <vector>
 
 class StochasticVortexExtractor : public VortexExtractor {
 public:
@@ -11,16 +12,36 @@ public:
   void SetNumberOfRuns(int);
   void SetKernelSize(float);
   void SetPertubation(float);
+  void SetSeed(unsigned int); // run i of the ensemble uses pertubation seed+i
 
   void ExtractDeterministicVortices();
   void ExtractStochasticVortices();
 
-  void EstimateDensities(int vid);
+  // gaussian kernel density of the ensemble points on the grid of the
+  // dataset, the points are binned linearly to the nodes and the bins are
+  // smoothed with a separable kernel of _kernel_size
+  void EstimateDensities();
+  const float* Density() const {return _density;}
+  void SaveDensity() const; // raw floats next to the vortex lines
+
+  // lines of the last ensemble in run order, their points are contiguous
+  // (x, y, z) in the point arena
+  struct EnsembleLine {
+    int run;
+    size_t off, npts;
+  };
+  const std::vector<float>& EnsemblePoints() const {return _pts;}
+  const std::vector<EnsembleLine>& EnsembleLines() const {return _lines;}
 
 private:
   int _nruns;
   float _kernel_size;
   float _pertubation;
+  unsigned int _seed;
+
+  std::vector<float> _pts; // point arena, the capacity is kept across ensembles
+  std::vector<std::vector<float> > _thread_pts; // points of the runs of each thread
+  std::vector<EnsembleLine> _lines;
 
   float *_density;
 };
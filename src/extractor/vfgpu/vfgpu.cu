@@ -1,8 +1,8 @@
 #include "vfgpu.h"
+#include "vfgpu_math.h"
 #include "threadIdx.cuh"
 #include <cstdio>
 #include <algorithm>
-#include <curand.h>
 
 #ifdef WITH_NETCDF
 #include <netcdf.h>
@@ -16,9 +16,8 @@ struct vfgpu_ctx_t {
   vfgpu_hdr_t h[2];
   vfgpu_hdr_t *d_h[2];
   float *d_rho[2], *d_phi[2], *d_re[2], *d_im[2];
-  float *d_pert;
 
-  curandGenerator_t gen;
+  unsigned int seed, stream; // of the pertubation
 
   unsigned int *d_pfcount;
   vfgpu_pf_t *d_pflist;
@@ -30,6 +29,15 @@ struct vfgpu_ctx_t {
   unsigned int pecount;
   vfgpu_pe_t *pelist;
 
+  int K; // multiple pertubations, node values are interleaved as [node][k]
+  int max_pfk_count; // capacity of each of the K device lists
+  float *d_pertubations, *d_rhok, *d_phik;
+  unsigned int *d_seeds;
+  unsigned int *d_pfcounts;
+  vfgpu_pf_t *d_pflists; // [k][max_pfk_count]
+  unsigned int *pfcounts;
+  vfgpu_pf_t **pflists;
+
   bool *d_pftag;  // optional for extraction, used for density estimation, indexed by face id. 
   bool *pftag;
 
@@ -57,693 +65,6 @@ static inline dim3 idivup(dim3 a, dim3 b)
   return dim3(idivup(a.x, b.x), idivup(a.y, b.y), idivup(a.z, b.z));
 }
 
-template <typename T>
-__device__
-inline bool find_zero_barycentric(const T re[3], const T im[3], T lambda[3], T epsilon=0)
-{
-  T D = re[0]*im[1] + re[1]*im[2] + re[2]*im[0] - re[2]*im[1] - re[1]*im[0] - re[0]*im[2]; // TODO: check if D=0?
-  T det[3] = {
-    re[1]*im[2] - re[2]*im[1], 
-    re[2]*im[0] - re[0]*im[2], 
-    re[0]*im[1] - re[1]*im[0]
-  };
-
-  lambda[0] = det[0]/D; 
-  lambda[1] = det[1]/D; 
-  lambda[2] = det[2]/D;
-
-  // if (lambda[0]>=0 && lambda[1]>=0 && lambda[2]>=0) return true; 
-  if (lambda[0]>=-epsilon && lambda[1]>=-epsilon && lambda[2]>=-epsilon) return true; 
-  else return false; 
-}
-
-template <typename T>
-__device__
-inline bool find_zero_triangle(const T re[3], const T im[3], const T X[3][3], T pos[3], T epsilon=0)
-{
-  T lambda[3]; 
-  bool succ = find_zero_barycentric(re, im, lambda, epsilon);
-
-  T R[3][2] = {{X[0][0]-X[2][0], X[1][0]-X[2][0]}, 
-               {X[0][1]-X[2][1], X[1][1]-X[2][1]}, 
-               {X[0][2]-X[2][2], X[1][2]-X[2][2]}}; 
-
-  pos[0] = R[0][0]*lambda[0] + R[0][1]*lambda[1] + X[2][0]; 
-  pos[1] = R[1][0]*lambda[0] + R[1][1]*lambda[1] + X[2][1]; 
-  pos[2] = R[2][0]*lambda[0] + R[2][1]*lambda[1] + X[2][2]; 
-
-  return succ; 
-}
-
-// find the zero point in [0, 1]x[0, 1] quad, using generalized eigenvalue problem
-template <typename T>
-__device__
-static inline bool find_zero_unit_quad_bilinear(const T re[4], const T im[4], T pos[2], T epsilon=0)
-{
-  T f00 = re[0], f10 = re[1], f01 = re[3], f11 = re[2], // counter-clockwise
-    g00 = im[0], g10 = im[1], g01 = im[3], g11 = im[2];
-  T A0 = f00 - f10 - f01 + f11, 
-    B0 = f10 - f00, 
-    C0 = f01 - f00, 
-    D0 = f00,
-    A1 = g00 - g10 - g01 + g11, 
-    B1 = g10 - g00, 
-    C1 = g01 - g00, 
-    D1 = g00; 
-  T M0[4] = {-B0, -D0, -B1, -D1}; // stored in row major
-  // T M1[4] = {A0, C0, A1, C1}; // (yM1 - M0)v = 0, v = {x, 1}^T
-
-  T detM1 = A0*C1 - A1*C0; // TODO: check if detM1==0
-  T invM1[4] = {C1/detM1, -C0/detM1, -A1/detM1, A0/detM1};
-
-  // Q = invM1*M0
-  T Q[4] = {
-    invM1[0]*M0[0] + invM1[1]*M0[2], 
-    invM1[0]*M0[1] + invM1[1]*M0[3], 
-    invM1[2]*M0[0] + invM1[3]*M0[2], 
-    invM1[2]*M0[1] + invM1[3]*M0[3]
-  };
-
-  // compute y=eig(Q)
-  T trace = Q[0] + Q[3];
-  T det = Q[0]*Q[3] - Q[1]*Q[2];
-  T lambda[2] = {
-    trace/2 + sqrt(trace*trace/4 - det), 
-    trace/2 - sqrt(trace*trace/4 - det)
-  }; 
-
-  T x[2] = {
-    (lambda[0]-Q[3])/Q[2], 
-    (lambda[1]-Q[3])/Q[2]
-  }; 
-  T y[2] = {
-    lambda[0], 
-    lambda[1]
-  };
-
-  bool found = false; 
-  for (int i=0; i<2; i++) // check the two roots 
-    if (x[i]>=0 && x[i]<=1 && y[i]>=0 && y[i]<=1) {
-      pos[0] = x[i]; 
-      pos[1] = y[i];
-      found = true; 
-      break; 
-    }
-  
-  if (!found) // check again, loosing creteria
-    for (int i=0; i<2; i++)  
-      if (x[i]>=-epsilon && x[i]<=1+epsilon && y[i]>=-epsilon && y[i]<=1+epsilon) {
-        pos[0] = x[i]; 
-        pos[1] = y[i];
-        found = true; 
-        break; 
-      }
-
-  return found; 
-}
-
-template <typename T>
-__device__
-static inline bool find_zero_quad_bilinear(const T re[4], const T im[4], const T X[4][3], T pos[3], T epsilon=0)
-{
-  T p[2]; 
-
-  bool succ = find_zero_unit_quad_bilinear(re, im, p, epsilon); 
-  if (!succ) return false;
-
-  T u[3], v[3]; 
-
-  u[0] = (1-p[0])*X[0][0] + p[0]*X[1][0];
-  u[1] = (1-p[0])*X[0][1] + p[0]*X[1][1];
-  u[2] = (1-p[0])*X[0][2] + p[0]*X[1][2];
-
-  v[0] = (1-p[0])*X[3][0] + p[0]*X[2][0];
-  v[1] = (1-p[0])*X[3][1] + p[0]*X[2][1];
-  v[2] = (1-p[0])*X[3][2] + p[0]*X[2][2];
-
-  pos[0] = (1-p[1])*u[0] + p[1]*v[0];
-  pos[1] = (1-p[1])*u[1] + p[1]*v[1];
-  pos[2] = (1-p[1])*u[2] + p[1]*v[2];
-
-  return true; 
-}
-
-template <typename T>
-__device__
-static inline bool find_tri_center(const T X[3][3], T pos[3])
-{
-  pos[0] = (X[0][0] + X[1][0] + X[2][0]) / 3;
-  pos[1] = (X[0][1] + X[1][1] + X[2][0]) / 3;
-  pos[2] = (X[0][2] + X[1][2] + X[2][0]) / 3;
-
-  return true;
-}
-
-template <typename T>
-__device__
-static inline bool find_quad_center(const T X[4][3], T pos[3])
-{
-  pos[0] = 0.25*(X[0][0] + X[1][0] + X[2][0] + X[3][0]);
-  pos[1] = 0.25*(X[0][1] + X[1][1] + X[2][0] + X[3][1]);
-  pos[2] = 0.25*(X[0][2] + X[1][2] + X[2][0] + X[3][2]);
-
-  return true;
-}
-
-template <typename T, int meshtype>
-__device__
-static inline bool find_zero(const T re[], const T im[], const T X[][3], T pos[3], T epsilon=T(0))
-{
-  if (meshtype == VFGPU_MESH_TET) 
-    return find_zero_triangle(re, im, X, pos, epsilon);
-    // return find_tri_center(X, pos);
-  else if (meshtype == VFGPU_MESH_HEX)
-    return find_zero_quad_bilinear(re, im, X, pos, epsilon);
-    // return find_quad_center(X, pos);
-  else
-    return false;
-}
-
-template <typename T>
-__device__
-inline static T fmod1(T x, T y)
-{
-  T z = fmod(x, y);
-  if (z<0) z += y;
-  return z;
-}
-
-template <typename T>
-__device__
-inline static T mod2pi(T x)
-{
-  T y = fmod(x, 2*M_PI); 
-  if (y<0) y+= 2*M_PI;
-  return y; 
-}
-
-template <typename T>
-__device__
-inline static T mod2pi1(T x)
-{
-  return mod2pi(x + M_PI) - M_PI;
-}
-
-template <typename T> 
-__device__
-inline int sgn(T x) 
-{
-  return (T(0) < x) - (x < T(0));
-}
-
-template <typename T>
-__device__
-static inline T inner_product(const T A[3], const T B[3])
-{
-  return A[0]*B[0] + A[1]*B[1] + A[2]*B[2];
-}
-
-template <typename T>
-__device__
-static inline T dist2(const T A[3], const T B[3])
-{
-  const T D[3] = {B[0]-A[0], B[1]-A[1], B[2]-A[2]};
-  return inner_product(D, D);
-}
-
-template <typename T> 
-__device__
-T line_integral(const vfgpu_hdr_t& h, const T X0[], const T X1[], const T A0[], const T A1[]) 
-{
-  T dX[3] = {X1[0] - X0[0], X1[1] - X0[1], X1[2] - X0[2]};
-  T A[3] = {A0[0] + A1[0], A0[1] + A1[1], A0[2] + A1[2]};
-
-  for (int i=0; i<3; i++)
-    if (dX[i] > h.lengths[i]/2) dX[i] -= h.lengths[i];
-    else if (dX[i] < -h.lengths[i]/2) dX[i] += h.lengths[i];
-
-  return 0.5 * inner_product(A, dX);
-}
-
-__device__
-inline void nid2nidx(const vfgpu_hdr_t& h, int id, int idx[3])
-{
-  const int s = h.d[0] * h.d[1]; 
-  const int k = id / s; 
-  const int j = (id - k*s) / h.d[0]; 
-  const int i = id - k*s - j*h.d[0]; 
-
-  idx[0] = i; idx[1] = j; idx[2] = k;
-}
-
-__device__
-inline int nidx2nid(const vfgpu_hdr_t& h, const int idx_[3])
-{
-  int idx[3] = {idx_[0], idx_[1], idx_[2]};
-  for (int i=0; i<3; i++) {
-    idx[i] = idx[i] % h.d[i];
-    if (idx[i] < 0)
-      idx[i] += h.d[i];
-  }
-  return idx[0] + h.d[0] * (idx[1] + h.d[1] * idx[2]); 
-}
-
-__device__
-inline bool valid_nidx(const vfgpu_hdr_t& h, const int idx[3])
-{
-  bool v[3] = {
-    idx[0]>=0 && idx[0]<h.d[0],
-    idx[1]>=0 && idx[1]<h.d[1],
-    idx[2]>=0 && idx[2]<h.d[2]
-  };
-  return v[0] && v[1] && v[2];
-}
-
-__device__ 
-inline bool valid_cidx_hex(const vfgpu_hdr_t& h, const int cidx[3])
-{
-  bool v[3] = {
-    cidx[0]>=0 && (cidx[0]<h.d[0] - (!h.pbc[0])),
-    cidx[1]>=0 && (cidx[1]<h.d[1] - (!h.pbc[1])),
-    cidx[2]>=0 && (cidx[2]<h.d[2] - (!h.pbc[2]))
-  };
-  return v[0] && v[1] && v[2];
-}
-
-__device__ 
-inline int cidx2cid_hex(const vfgpu_hdr_t& h, const int cidx[3])
-{
-  return nidx2nid(h, cidx);
-}
-
-__device__
-inline int fidx2fid_hex(const vfgpu_hdr_t& h, const int fidx[4])
-{
-  return nidx2nid(h, fidx)*3 + fidx[3];
-}
-
-__device__
-inline void fid2fidx_tet(const vfgpu_hdr_t& h, int id, int idx[4])
-{
-  int nid = id / 12;
-  nid2nidx(h, nid, idx);
-  idx[3] = id % 12;
-}
-
-__device__
-inline void fid2fidx_hex(const vfgpu_hdr_t& h, unsigned int id, int idx[4])
-{
-  unsigned int nid = id / 3;
-  nid2nidx(h, nid, idx);
-  idx[3] = id % 3;
-}
-
-__device__
-bool valid_fidx_tet(const vfgpu_hdr_t& h,const int fidx[4])
-{
-  if (fidx[3]<0 || fidx[3]>=12) return false;
-  else {
-    int o[3] = {0};
-    for (int i=0; i<3; i++)
-      if (h.pbc[i]) {
-        if (fidx[i] < 0 || fidx[i] >= h.d[i]) return false;
-      } else {
-        if (fidx[i] < 0 || fidx[i] > h.d[i]-1) return false;
-        else if (fidx[i] == h.d[i]-1) o[i] = 1;
-      }
-    
-    const int sum = o[0] + o[1] + o[2];
-    if (sum == 0) return true;
-    else if (o[0] + o[1] + o[2] > 1) return false;
-    else if (o[0] && (fidx[3] == 4 || fidx[3] == 5)) return true;
-    else if (o[1] && (fidx[3] == 2 || fidx[3] == 3)) return true; 
-    else if (o[2] && (fidx[3] == 0 || fidx[3] == 1)) return true;
-    else return false;
-  }
-}
-
-__device__
-bool valid_fidx_hex(const vfgpu_hdr_t& h, const int fidx[4])
-{
-  if (fidx[3]<0 || fidx[3]>=3) return false;
-  else {
-    int o[3] = {0}; 
-    for (int i=0; i<3; i++) 
-      if (h.pbc[i]) {
-        if (fidx[i]<0 || fidx[i]>=h.d[i]) return false;
-      } else {
-        if (fidx[i]<0 || fidx[i]>h.d[i]-1) return false;
-        else if (fidx[i] == h.d[i]-1) o[i] = 1;
-      }
-
-    const int sum = o[0] + o[1] + o[2];
-    if (sum == 0) return true;
-    else if (o[0] + o[1] + o[2] > 1) return false;
-    else if (o[0] && fidx[3] == 0) return true; 
-    else if (o[1] && fidx[3] == 1) return true;
-    else if (o[2] && fidx[3] == 2) return true;
-    else return false;
-  }
-}
-
-__device__
-inline void eid2eidx_tet(const vfgpu_hdr_t& h, int id, int idx[4])
-{
-  int nid = id / 7;
-  nid2nidx(h, nid, idx);
-  idx[3] = id % 7;
-}
-
-__device__
-inline void eid2eidx_hex(const vfgpu_hdr_t& h, int id, int idx[4]) 
-{
-  int nid = id / 3;
-  nid2nidx(h, nid, idx);
-  idx[3] = id % 3;
-}
-
-__device__
-inline bool valid_eidx_tet(const vfgpu_hdr_t& h, const int eidx[4])
-{
-  if (eidx[3]<0 || eidx[3]>=7) return false;
-  else {
-    for (int i=0; i<3; i++)
-      if (h.pbc[i]) {
-        if (eidx[i] < 0 || eidx[i] >= h.d[i]) return false;
-      } else {
-        if (eidx[i] < 0 || eidx[i] >= h.d[i]-1) return false;
-      }
-    return true;
-  }
-}
-
-__device__
-inline bool valid_eidx_hex(const vfgpu_hdr_t& h, const int eidx[4])
-{
-  if (eidx[3]<0 || eidx[3]>=3) return false;
-  else {
-    for (int i=0; i<3; i++) 
-      if (h.pbc[i]) {
-        if (eidx[i]<0 || eidx[i]>=h.d[i]) return false;
-      } else {
-        if (eidx[i]<0 || eidx[i]>=h.d[i]-1) return false;
-      }
-    return true;
-  }
-}
-
-__device__
-inline bool fid2nodes_tet(const vfgpu_hdr_t& h, int id, int nidxs[3][3])
-{
-  const int nodes_idx[12][3][3] = { // 12 types of faces
-    {{0, 0, 0}, {1, 0, 0}, {1, 1, 0}}, // ABC
-    {{0, 0, 0}, {1, 1, 0}, {0, 1, 0}}, // ACD
-    {{0, 0, 0}, {1, 0, 0}, {1, 0, 1}}, // ABF
-    {{0, 0, 0}, {0, 0, 1}, {1, 0, 1}}, // AEF
-    {{0, 0, 0}, {0, 1, 0}, {0, 0, 1}}, // ADE
-    {{0, 1, 0}, {0, 0, 1}, {0, 1, 1}}, // DEH
-    {{0, 0, 0}, {0, 1, 0}, {1, 0, 1}}, // ADF
-    {{0, 1, 0}, {1, 0, 1}, {1, 1, 1}}, // DFG
-    {{0, 1, 0}, {0, 0, 1}, {1, 0, 1}}, // DEF
-    {{1, 1, 0}, {0, 1, 0}, {1, 0, 1}}, // CDF
-    {{0, 0, 0}, {1, 1, 0}, {1, 0, 1}}, // ACF
-    {{0, 1, 0}, {0, 0, 1}, {1, 1, 1}}  // DEG
-  };
-
-  int fidx[4];
-  fid2fidx_tet(h, id, fidx);
-
-  if (valid_fidx_tet(h, fidx)) {
-    const int type = fidx[3];
-    for (int p=0; p<3; p++) 
-      for (int q=0; q<3; q++) 
-        nidxs[p][q] = fidx[q] + nodes_idx[type][p][q];
-    return true;
-  }
-  else
-    return false;
-}
-
-__device__
-inline bool fid2nodes_hex(const vfgpu_hdr_t &h, int id, int nidxs[4][3])
-{
-  const int nodes_idx[3][4][3] = { // 3 types of faces
-    {{0, 0, 0}, {0, 1, 0}, {0, 1, 1}, {0, 0, 1}}, // YZ
-    {{0, 0, 0}, {0, 0, 1}, {1, 0, 1}, {1, 0, 0}}, // ZX
-    {{0, 0, 0}, {1, 0, 0}, {1, 1, 0}, {0, 1, 0}}  // XY
-  };
-  
-  int fidx[4];
-  fid2fidx_hex(h, id, fidx);
-
-  if (valid_fidx_hex(h, fidx)) {
-    const int type = fidx[3];
-    for (int p=0; p<4; p++) 
-      for (int q=0; q<3; q++) 
-        nidxs[p][q] = fidx[q] + nodes_idx[type][p][q];
-    return true;
-  }
-  else
-    return false;
-}
-
-__device__
-inline bool eid2nodes_tet(const vfgpu_hdr_t& h, int eid, int nidxs[2][3])
-{
-  const int nodes_idx[7][2][3] = { // 7 types of edges
-    {{0, 0, 0}, {1, 0, 0}}, // AB
-    {{0, 0, 0}, {1, 1, 0}}, // AC
-    {{0, 0, 0}, {0, 1, 0}}, // AD
-    {{0, 0, 0}, {0, 0, 1}}, // AE
-    {{0, 0, 0}, {1, 0, 1}}, // AF
-    {{0, 1, 0}, {0, 0, 1}}, // DE
-    {{0, 1, 0}, {1, 0, 1}}, // DF
-  };
-  
-  int eidx[4];
-  eid2eidx_tet(h, eid, eidx);
-
-  if (valid_eidx_tet(h, eidx)) {
-    const int type = eidx[3];
-    for (int p=0; p<2; p++) 
-      for (int q=0; q<3; q++) 
-        nidxs[p][q] = eidx[q] + nodes_idx[type][p][q];
-    return true;
-  }
-  else
-    return false;
-}
-
-__device__
-inline bool eid2nodes_hex(const vfgpu_hdr_t& h, int eid, int nidxs[2][3])
-{
-  const int nodes_idx[3][2][3] = { // 3 types of edges
-    {{0, 0, 0}, {1, 0, 0}}, 
-    {{0, 0, 0}, {0, 1, 0}}, 
-    {{0, 0, 0}, {0, 0, 1}}
-  };
-
-  int eidx[4];
-  eid2eidx_hex(h, eid, eidx);
-
-  if (valid_eidx_hex(h, eidx)) {
-    const int type = eidx[3];
-    for (int p=0; p<2; p++) 
-      for (int q=0; q<3; q++) 
-        nidxs[p][q] = eidx[q] + nodes_idx[type][p][q];
-    return true;
-  }
-  else
-    return false;
-}
-
-__device__
-inline int hexcell_hexfaces(const vfgpu_hdr_t& h, const int cidx[3], int* fids)
-{
-  const int fidxs[6][4] = {
-    {cidx[0], cidx[1], cidx[2], 0},  
-    {cidx[0], cidx[1], cidx[2], 1},
-    {cidx[0], cidx[1], cidx[2], 2}, 
-    {cidx[0]+1, cidx[1], cidx[2], 0}, 
-    {cidx[0], cidx[1]+1, cidx[2], 1},
-    {cidx[0], cidx[1], cidx[2]+1, 2}};
-
-  for (int i=0; i<6; i++) 
-    fids[i] = fidx2fid_hex(h, fidxs[i]);
-
-  return 6;
-}
-
-
-template <typename T>
-__device__
-inline void nidx2pos(const vfgpu_hdr_t& h, const int nidx[3], T X[3])
-{
-  for (int i=0; i<3; i++) 
-    X[i] = nidx[i] * h.cell_lengths[i] + h.origins[i];
-}
-
-template <typename T>
-__device__
-inline void magnetic_potential(const vfgpu_hdr_t& h, T X[3], T A[3])
-{
-  if (h.B[1]>0) {
-    A[0] = -h.Kx; 
-    A[1] = X[0] * h.B[2];
-    A[2] = -X[0] * h.B[1];
-  } else {
-    A[0] = -X[1] * h.B[2] - h.Kx;
-    A[1] = 0;
-    A[2] = X[1] * h.B[0];
-  }
-}
-
-template <typename T, int meshtype>
-__device__
-inline bool get_face_values(
-    const vfgpu_hdr_t& h, 
-    int fid, 
-    T X[][3],
-    T A[][3],
-    T rho[],
-    T phi[],
-    const T *rho_,
-    const T *phi_)
-{
-  const int nnodes = meshtype == VFGPU_MESH_TET ? 3 : 4;
-  int nidxs[nnodes][3], nids[nnodes];
-  bool valid = meshtype == VFGPU_MESH_TET ? fid2nodes_tet(h, fid, nidxs) : fid2nodes_hex(h, fid, nidxs);
-  
-  if (valid) {
-    for (int i=0; i<nnodes; i++) {
-      nids[i] = nidx2nid(h, nidxs[i]);
-      // re[i] = re_[nids[i]];
-      // im[i] = im_[nids[i]];
-      // rho[i] = sqrt(re[i]*re[i] + im[i]*im[i]);
-      // phi[i] = atan2(im[i], re[i]);
-      rho[i] = rho_[nids[i]];
-      phi[i] = phi_[nids[i]];
-   
-      nidx2pos(h, nidxs[i], X[i]);
-      magnetic_potential(h, X[i], A[i]); 
-    }
-  }
-
-  return valid;
-}
-
-template <typename T, int meshtype>
-__device__
-inline bool get_vface_values(
-    const vfgpu_hdr_t& h, 
-    const vfgpu_hdr_t& h1, 
-    int eid, 
-    T X[4][3],
-    T A[4][3],
-    T phi[4],
-    const T *phi_,
-    const T *phi1_)
-{
-  int nidxs[2][3], nids[2];
-  bool valid = meshtype == VFGPU_MESH_TET ? eid2nodes_tet(h, eid, nidxs) : eid2nodes_hex(h, eid, nidxs);
-
-  if (valid) {
-    nids[0] = nidx2nid(h, nidxs[0]);
-    nids[1] = nidx2nid(h, nidxs[1]);
-
-    phi[0] = phi_[nids[0]]; 
-    phi[1] = phi_[nids[1]];
-    phi[2] = phi1_[nids[1]];
-    phi[3] = phi1_[nids[0]];
-
-    nidx2pos(h, nidxs[0], X[0]);
-    nidx2pos(h, nidxs[1], X[1]);
-    nidx2pos(h1, nidxs[1], X[2]);
-    nidx2pos(h1, nidxs[0], X[3]);
-
-    magnetic_potential(h, X[0], A[0]);
-    magnetic_potential(h, X[1], A[1]);
-    magnetic_potential(h1, X[2], A[2]);
-    magnetic_potential(h1, X[3], A[3]);
-
-    return true;
-  } else 
-    return false;
-}
-
-template <typename T>
-__device__
-inline int contour_chirality(
-    const vfgpu_hdr_t &h, 
-    int nnodes, // nnodes <= 4
-    const T phi[], 
-    const T X[][3], 
-    const T A[][3],
-    T delta[])
-{
-  T phase_jump = 0;
-  for (int i=0; i<nnodes; i++) {
-    int j = (i+1) % nnodes;
-    delta[i] = phi[j] - phi[i]; 
-    T li = line_integral(h, X[i], X[j], A[i], A[j]), 
-      qp = 0; // TODO
-    delta[i] = mod2pi1(delta[i] - li + qp);
-    phase_jump -= delta[i];
-  }
-  
-  if (fabs(phase_jump)<0.5) return 0; // not punctured
-  else return sgn(phase_jump);
-}
-
-// for space-time vfaces
-template <typename T>
-__device__
-inline int contour_chirality_spt(
-    const vfgpu_hdr_t &h, 
-    const vfgpu_hdr_t &h1, 
-    const T phi[4], 
-    const T X[4][3], 
-    const T A[4][3],
-    T delta[])
-{
-  T li[4] = { // FIXME: varying B
-    line_integral(h, X[0], X[1], A[0], A[1]), 
-    0, 
-    line_integral(h, X[1], X[0], A[2], A[3]), 
-    0};
-  T qp[4] = {0, 0, 0, 0}; // FIXME
-
-  T phase_jump = 0;
-  for (int i=0; i<4; i++) {
-    int j = (i+1) % 4;
-    delta[i] = phi[j] - phi[i]; 
-    delta[i] = mod2pi1(delta[i] - li[i] + qp[i]);
-    phase_jump -= delta[i];
-  }
-  
-  if (fabs(phase_jump)<0.5) return 0; // not punctured
-  else return sgn(phase_jump);
-}
-
-template <typename T>
-__device__
-inline void gauge_transform(
-    int nnodes, 
-    const T rho[],
-    const T delta[],
-    T phi[], 
-    T re[], 
-    T im[])
-{
-  re[0] = rho[0] * cos(phi[0]);
-  im[0] = rho[0] * sin(phi[0]);
-  for (int i=1; i<nnodes; i++) {
-    phi[i] = phi[i-1] + delta[i-1];
-    re[i] = rho[i] * cos(phi[i]);
-    im[i] = rho[i] * sin(phi[i]);
-  }
-}
-
 template <typename T, int meshtype, bool tag>
 __device__
 inline int extract_face(
@@ -821,7 +142,9 @@ static void compute_rho_phi_kernel(
     T *phi,
     const T *re,
     const T *im,
-    const T *pert=NULL)
+    unsigned int seed=0,
+    unsigned int stream=0, 
+    T sigma=0)
 {
   int idx = getGlobalIdx_3D_1D();
   if (idx>h->d[0]*h->d[1]*h->d[2]) return;
@@ -829,8 +152,9 @@ static void compute_rho_phi_kernel(
   T r, i;
 
   if (pertubation) {
-    r = re[idx] + pert[idx*2];
-    i = im[idx] + pert[idx*2+1];
+    normal_noise(seed, stream, idx, sigma, r, i);
+    r += re[idx];
+    i += im[idx];
   } else {
     r = re[idx];
     i = im[idx];
@@ -840,6 +164,37 @@ static void compute_rho_phi_kernel(
   phi[idx] = atan2(i, r);
 }
 
+template <typename T>
+__global__
+static void compute_rho_phi_multi_kernel(
+    const vfgpu_hdr_t *h, 
+    int K,
+    T *rhok, 
+    T *phik,
+    const T *re,
+    const T *im,
+    const T *pertubations,
+    const unsigned int *seeds)
+{
+  int idx = getGlobalIdx_3D_1D();
+  if (idx>=h->count) return;
+
+  // noise stream 0 of each seed, see vfgpu_compute_rho_phi()
+  for (int k=0; k<K; k++) {
+    T r, i;
+    if (pertubations[k]>0) {
+      normal_noise(seeds[k], 0u, idx, pertubations[k], r, i);
+      r += re[idx];
+      i += im[idx];
+    } else {
+      r = re[idx];
+      i = im[idx];
+    }
+    rhok[idx*K+k] = sqrt(r*r + i*i);
+    phik[idx*K+k] = atan2(i, r);
+  }
+}
+
 template <typename T, int meshtype>
 __global__
 static void count_lines_in_cell_kernel(
@@ -855,8 +210,7 @@ static void count_lines_in_cell_kernel(
   const int cid = cidx2cid_hex(*h, cidx);
 
   int fids[12]; // max is 12
-  const int n = hexcell_hexfaces(*h, cidx, fids);  
-  // TODO: hexcell_tetfaces
+  const int n = meshtype == VFGPU_MESH_TET ? hexcell_tetfaces(*h, cidx, fids) : hexcell_hexfaces(*h, cidx, fids);
 
   int npf = 0;
   for (int i=0; i<n; i++) 
@@ -904,6 +258,59 @@ static void extract_faces_kernel(
 #endif
 }
 
+// the geometry of the face is shared by the K tests
+template <typename T, int meshtype>
+__global__
+static void extract_faces_multi_kernel(
+    const vfgpu_hdr_t* h, 
+    int K,
+    unsigned int *pfcounts, // [k]
+    vfgpu_pf_t *pflists, // [k][max_pf_count]
+    int max_pf_count,
+    const T *rhok, 
+    const T *phik)
+{
+  const int nfacetypes = meshtype == VFGPU_MESH_TET ? 12 : 3;
+  const int fid = getGlobalIdx_3D_1D();
+  if (fid>=h->count*nfacetypes) return;
+
+  const int nnodes = meshtype == VFGPU_MESH_TET ? 3 : 4;
+  int nidxs[nnodes][3], nids[nnodes];
+  bool valid = meshtype == VFGPU_MESH_TET ? fid2nodes_tet(*h, fid, nidxs) : fid2nodes_hex(*h, fid, nidxs);
+  if (!valid) return;
+
+  T X[nnodes][3], A[nnodes][3], li[nnodes];
+  for (int i=0; i<nnodes; i++) {
+    nids[i] = nidx2nid(*h, nidxs[i]);
+    nidx2pos(*h, nidxs[i], X[i]);
+    magnetic_potential(*h, X[i], A[i]);
+  }
+  for (int i=0; i<nnodes; i++)
+    li[i] = line_integral(*h, X[i], X[(i+1)%nnodes], A[i], A[(i+1)%nnodes]);
+
+  for (int k=0; k<K; k++) {
+    T rho[nnodes], phi[nnodes], re[nnodes], im[nnodes], delta[nnodes];
+    for (int i=0; i<nnodes; i++) {
+      rho[i] = rhok[nids[i]*K + k];
+      phi[i] = phik[nids[i]*K + k];
+    }
+
+    int chirality = contour_chirality_li(nnodes, phi, li, delta);
+    if (chirality == 0) continue;
+
+    gauge_transform(nnodes, rho, delta, phi, re, im);
+
+    vfgpu_pf_t pf;
+    pf.fid = fid;
+    pf.chirality = chirality;
+    find_zero<T, meshtype>(re, im, X, pf.pos, T(1));
+
+    unsigned int idx = atomicInc(&pfcounts[k], 0xffffffff);
+    if (idx < (unsigned int)max_pf_count)
+      pflists[k*max_pf_count + idx] = pf;
+  }
+}
+
 template <typename T, int meshtype>
 __global__
 static void extract_edges_kernel(
@@ -1011,15 +418,9 @@ void vfgpu_compute_rho_phi(vfgpu_ctx_t* c, int slot)
     gridSize = dim3(nBlocks);
 
   if (c->pertubation>0.f) {
-    if (c->d_pert == NULL) {
-      cudaMalloc((void**)&c->d_pert, sizeof(float)*count*2); // real and imag
-      curandCreateGenerator(&c->gen, CURAND_RNG_PSEUDO_DEFAULT);
-      curandSetPseudoRandomGeneratorSeed(c->gen, 1234ULL);
-    }
-    curandGenerateNormal(c->gen, c->d_pert, count*2, 0, c->pertubation);
-    compute_rho_phi_kernel<float, true><<<gridSize, blockSize>>>(c->d_h[slot], c->d_rho[slot], c->d_phi[slot], c->d_re[slot], c->d_im[slot], c->d_pert);
+    compute_rho_phi_kernel<float, true><<<gridSize, blockSize>>>(c->d_h[slot], c->d_rho[slot], c->d_phi[slot], c->d_re[slot], c->d_im[slot], c->seed, c->stream++, c->pertubation);
   } else {
-    compute_rho_phi_kernel<float, false><<<gridSize, blockSize>>>(c->d_h[slot], c->d_rho[slot], c->d_phi[slot], c->d_re[slot], c->d_im[slot], c->d_pert);
+    compute_rho_phi_kernel<float, false><<<gridSize, blockSize>>>(c->d_h[slot], c->d_rho[slot], c->d_phi[slot], c->d_re[slot], c->d_im[slot]);
   }
 
   // cudaDeviceSynchronize();
@@ -1110,6 +511,74 @@ void vfgpu_extract_faces(vfgpu_ctx_t* c, int slot)
   // cudaDeviceSynchronize();
 }
 
+void vfgpu_extract_faces_multi(vfgpu_ctx_t* c, int slot, int K, const float *pertubations, const unsigned int *seeds)
+{
+  const int nfacetypes = c->meshtype == VFGPU_MESH_TET ? 12 : 3;
+  const int count = c->h[slot].count;
+  const int max_pf_count = count*nfacetypes*0.1; // TODO
+
+  if (c->K < K || c->max_pfk_count != max_pf_count) {
+    for (int k=0; k<c->K; k++)
+      free(c->pflists[k]);
+    c->pfcounts = (unsigned int*)realloc(c->pfcounts, K*sizeof(unsigned int));
+    c->pflists = (vfgpu_pf_t**)realloc(c->pflists, K*sizeof(vfgpu_pf_t*));
+    for (int k=0; k<K; k++)
+      c->pflists[k] = (vfgpu_pf_t*)malloc(max_pf_count*sizeof(vfgpu_pf_t));
+
+    cudaFree(c->d_pertubations);
+    cudaFree(c->d_seeds);
+    cudaFree(c->d_rhok);
+    cudaFree(c->d_phik);
+    cudaFree(c->d_pfcounts);
+    cudaFree(c->d_pflists);
+    cudaMalloc((void**)&c->d_pertubations, sizeof(float)*K);
+    cudaMalloc((void**)&c->d_seeds, sizeof(unsigned int)*K);
+    cudaMalloc((void**)&c->d_rhok, sizeof(float)*count*K);
+    cudaMalloc((void**)&c->d_phik, sizeof(float)*count*K);
+    cudaMalloc((void**)&c->d_pfcounts, sizeof(unsigned int)*K);
+    cudaMalloc((void**)&c->d_pflists, sizeof(vfgpu_pf_t)*max_pf_count*K);
+    c->K = K;
+    c->max_pfk_count = max_pf_count;
+  }
+  
+  cudaMemcpy(c->d_pertubations, pertubations, sizeof(float)*K, cudaMemcpyHostToDevice);
+  cudaMemcpy(c->d_seeds, seeds, sizeof(unsigned int)*K, cudaMemcpyHostToDevice);
+  cudaMemset(c->d_pfcounts, 0, sizeof(unsigned int)*K);
+  checkLastCudaError("extract faces multi [0]");
+
+  const int maxGridDim = 1024; // 32768;
+  const int blockSize = 256;
+  int nBlocks = idivup(count, blockSize);
+  dim3 gridSize; 
+  if (nBlocks >= maxGridDim) 
+    gridSize = dim3(idivup(nBlocks, maxGridDim), maxGridDim);
+  else 
+    gridSize = dim3(nBlocks);
+
+  compute_rho_phi_multi_kernel<float><<<gridSize, blockSize>>>(c->d_h[slot], K, c->d_rhok, c->d_phik, c->d_re[slot], c->d_im[slot], c->d_pertubations, c->d_seeds);
+  checkLastCudaError("extract faces multi [1]");
+
+  nBlocks = idivup(count*nfacetypes, blockSize);
+  if (nBlocks >= maxGridDim) 
+    gridSize = dim3(idivup(nBlocks, maxGridDim), maxGridDim);
+  else 
+    gridSize = dim3(nBlocks);
+
+  if (c->meshtype == VFGPU_MESH_HEX)
+    extract_faces_multi_kernel<float, VFGPU_MESH_HEX><<<gridSize, blockSize>>>(c->d_h[slot], K, c->d_pfcounts, c->d_pflists, max_pf_count, c->d_rhok, c->d_phik);
+  else
+    extract_faces_multi_kernel<float, VFGPU_MESH_TET><<<gridSize, blockSize>>>(c->d_h[slot], K, c->d_pfcounts, c->d_pflists, max_pf_count, c->d_rhok, c->d_phik);
+  checkLastCudaError("extract faces multi [2]");
+
+  cudaMemcpy(c->pfcounts, c->d_pfcounts, sizeof(unsigned int)*K, cudaMemcpyDeviceToHost);
+  for (int k=0; k<K; k++) {
+    c->pfcounts[k] = std::min(c->pfcounts[k], (unsigned int)max_pf_count);
+    if (c->pfcounts[k]>0)
+      cudaMemcpy(c->pflists[k], c->d_pflists + k*max_pf_count, sizeof(vfgpu_pf_t)*c->pfcounts[k], cudaMemcpyDeviceToHost);
+  }
+  checkLastCudaError("extract faces multi [3]");
+}
+
 void vfgpu_extract_edges(vfgpu_ctx_t* c)
 {
   const int nedgetypes = c->meshtype == VFGPU_MESH_TET ? 7 : 3;
@@ -1148,6 +617,7 @@ vfgpu_ctx_t* vfgpu_create_ctx()
 {
   vfgpu_ctx_t *c = (vfgpu_ctx_t*)malloc(sizeof(vfgpu_ctx_t));
   memset(c, 0, sizeof(vfgpu_ctx_t));
+  c->seed = 1234;
   return c;
 }
 
@@ -1166,12 +636,18 @@ void vfgpu_destroy_ctx(vfgpu_ctx_t *c)
 
   cudaFree(c->d_pelist);
   free(c->pelist);
- 
-  if (c->d_pert != NULL) {
-    cudaFree(c->d_pert);
-    curandDestroyGenerator(c->gen);
-  }
 
+  for (int k=0; k<c->K; k++)
+    free(c->pflists[k]);
+  free(c->pflists);
+  free(c->pfcounts);
+  cudaFree(c->d_pertubations);
+  cudaFree(c->d_seeds);
+  cudaFree(c->d_rhok);
+  cudaFree(c->d_phik);
+  cudaFree(c->d_pfcounts);
+  cudaFree(c->d_pflists);
+ 
   if (c->d_pftag != NULL) 
     cudaFree(c->d_pftag);
   if (c->pftag != NULL)
@@ -1203,6 +679,12 @@ void vfgpu_get_pflist(vfgpu_ctx_t* c, int *n, vfgpu_pf_t **pflist)
   *pflist = c->pflist;
 }
 
+void vfgpu_get_pflist_multi(vfgpu_ctx_t* c, int k, int *n, vfgpu_pf_t **pflist)
+{
+  *n = c->pfcounts[k];
+  *pflist = c->pflists[k];
+}
+
 void vfgpu_get_pelist(vfgpu_ctx_t* c, int *n, vfgpu_pe_t **pelist)
 {
   *n = c->pecount; 
@@ -1213,3 +695,14 @@ void vfgpu_set_pertubation(vfgpu_ctx_t* c, float p)
 {
   c->pertubation = p;
 }
+
+void vfgpu_set_seed(vfgpu_ctx_t* c, unsigned int seed)
+{
+  c->seed = seed;
+  c->stream = 0;
+}
+
+void vfgpu_set_number_of_threads(vfgpu_ctx_t* c, int n)
+{
+  // no impl
+}
@@ -37,6 +37,8 @@ void vfgpu_destroy_ctx(vfgpu_ctx_t*);
 void vfgpu_set_meshtype(vfgpu_ctx_t*, int);
 void vfgpu_set_enable_count_lines_in_cell(vfgpu_ctx_t*, bool);
 void vfgpu_set_pertubation(vfgpu_ctx_t*, float);
+void vfgpu_set_seed(vfgpu_ctx_t*, unsigned int); // the k-th perturbed extraction after this uses stream k
+void vfgpu_set_number_of_threads(vfgpu_ctx_t*, int); // CPU backend only
 
 void vfgpu_upload_data(
     vfgpu_ctx_t*, 
@@ -59,6 +61,13 @@ void vfgpu_extract_edges(vfgpu_ctx_t*);
 
 void vfgpu_get_pflist(vfgpu_ctx_t*, int *n, vfgpu_pf_t **pflist);
 
+// one sweep over the faces for K pertubations; the k-th list equals the
+// output of vfgpu_extract_faces() after vfgpu_set_seed(seeds[k]) and
+// vfgpu_set_pertubation(pertubations[k])
+void vfgpu_extract_faces_multi(vfgpu_ctx_t*, int slot, int K, const float *pertubations, const unsigned int *seeds);
+
+void vfgpu_get_pflist_multi(vfgpu_ctx_t*, int k, int *n, vfgpu_pf_t **pflist);
+
 void vfgpu_get_pelist(vfgpu_ctx_t*, int *n, vfgpu_pe_t **pelist);
 
 void vfgpu_clear_count_lines_in_cell(vfgpu_ctx_t* c);
@@ -0,0 +1,501 @@
+#include "def.h"
+#include "vfgpu.h"
+#include "vfgpu_math.h"
+#include "common/WorkerPool.h"
+#include <cstdio>
+#include <cstring>
+#include <vector>
+#include <thread>
+#include <algorithm>
+
+#ifdef WITH_NETCDF
+#include <netcdf.h>
+#endif
+
+// multithreaded host implementation of the vfgpu api, used in builds
+// without cuda.  faces and edges are checked with the same templates as the
+// kernels; the lists are sorted by id, unlike the gpu output.
+
+struct vfgpu_ctx_t {
+  unsigned char meshtype;
+  bool enable_count_lines_in_cell;
+  float pertubation;
+
+  vfgpu_hdr_t h[2];
+  std::vector<float> rho[2], phi[2], re[2], im[2];
+
+  unsigned int seed, stream; // of the pertubation
+
+  std::vector<vfgpu_pf_t> pflist;
+  std::vector<vfgpu_pe_t> pelist;
+  std::vector<std::vector<vfgpu_pf_t> > thread_pfs;
+  std::vector<std::vector<vfgpu_pe_t> > thread_pes;
+
+  // multiple pertubations, node values are interleaved as [node][k]
+  int K;
+  std::vector<float> rhok, phik;
+  std::vector<std::vector<vfgpu_pf_t> > pflists; // [k]
+  std::vector<std::vector<vfgpu_pf_t> > thread_pfks; // [tid*K + k]
+
+  std::vector<char> pftag; // indexed by face id
+  std::vector<int> count_lines_in_cell;
+
+  int nthreads;
+  WorkerPool *pool;
+};
+
+static const size_t chunk_size = 4096;
+
+static WorkerPool* get_pool(vfgpu_ctx_t* c)
+{
+  if (c->pool == NULL || c->pool->NumberOfThreads() != c->nthreads) {
+    delete c->pool;
+    c->pool = new WorkerPool(c->nthreads);
+  }
+  return c->pool;
+}
+
+template <typename T, int meshtype, bool tag>
+static inline int extract_face(
+    const vfgpu_hdr_t& h,
+    int fid,
+    std::vector<vfgpu_pf_t>& pflist,
+    char *pftag,
+    const T *rho_,
+    const T *phi_)
+{
+  const int nnodes = meshtype == VFGPU_MESH_TET ? 3 : 4;
+  T X[nnodes][3], A[nnodes][3], rho[nnodes], phi[nnodes], re[nnodes], im[nnodes];
+  T delta[nnodes];
+
+  bool valid = get_face_values<T, meshtype>(h, fid, X, A, rho, phi, rho_, phi_);
+  if (!valid) return 0;
+
+  // compute phase shift
+  int chirality = contour_chirality(h, nnodes, phi, X, A, delta);
+  if (chirality == 0) return 0;
+
+  // gauge transformation
+  gauge_transform(nnodes, rho, delta, phi, re, im);
+
+  // find puncture point
+  vfgpu_pf_t pf;
+  pf.fid = fid;
+  pf.chirality = chirality;
+  find_zero<T, meshtype>(re, im, X, pf.pos, T(1));
+  pflist.push_back(pf);
+
+  if (tag)
+    pftag[fid] = true;
+
+  return chirality;
+}
+
+template <typename T, int meshtype>
+static inline int extract_edge(
+    const vfgpu_hdr_t& h,
+    const vfgpu_hdr_t& h1,
+    int eid,
+    std::vector<vfgpu_pe_t>& pelist,
+    const T *phi_,
+    const T *phi1_)
+{
+  const int nnodes = 4;
+  T X[nnodes][3], A[nnodes][3], phi[nnodes];
+  T delta[nnodes];
+
+  bool valid = get_vface_values<T, meshtype>(h, h1, eid, X, A, phi, phi_, phi1_);
+  if (!valid) return 0;
+
+  // compute phase shift
+  int chirality = contour_chirality_spt(h, h1, phi, X, A, delta);
+  if (chirality == 0) return 0;
+
+  vfgpu_pe_t pe;
+  pe.eid = eid;
+  pe.chirality = chirality;
+  pelist.push_back(pe);
+
+  return chirality;
+}
+
+// the geometry of the face is shared by the K tests
+template <typename T, int meshtype>
+static inline void extract_face_multi(
+    const vfgpu_hdr_t& h,
+    int fid,
+    int K,
+    std::vector<vfgpu_pf_t> *pflists, // [k]
+    const T *rhok,
+    const T *phik)
+{
+  const int nnodes = meshtype == VFGPU_MESH_TET ? 3 : 4;
+  int nidxs[nnodes][3], nids[nnodes];
+  bool valid = meshtype == VFGPU_MESH_TET ? fid2nodes_tet(h, fid, nidxs) : fid2nodes_hex(h, fid, nidxs);
+  if (!valid) return;
+
+  T X[nnodes][3], A[nnodes][3], li[nnodes];
+  for (int i=0; i<nnodes; i++) {
+    nids[i] = nidx2nid(h, nidxs[i]);
+    nidx2pos(h, nidxs[i], X[i]);
+    magnetic_potential(h, X[i], A[i]);
+  }
+  for (int i=0; i<nnodes; i++)
+    li[i] = line_integral(h, X[i], X[(i+1)%nnodes], A[i], A[(i+1)%nnodes]);
+
+  for (int k=0; k<K; k++) {
+    T rho[nnodes], phi[nnodes], re[nnodes], im[nnodes], delta[nnodes];
+    for (int i=0; i<nnodes; i++) {
+      rho[i] = rhok[(size_t)nids[i]*K + k];
+      phi[i] = phik[(size_t)nids[i]*K + k];
+    }
+
+    int chirality = contour_chirality_li(nnodes, phi, li, delta);
+    if (chirality == 0) continue;
+
+    gauge_transform(nnodes, rho, delta, phi, re, im);
+
+    vfgpu_pf_t pf;
+    pf.fid = fid;
+    pf.chirality = chirality;
+    find_zero<T, meshtype>(re, im, X, pf.pos, T(1));
+    pflists[k].push_back(pf);
+  }
+}
+
+template <typename T, int meshtype, bool tag>
+static void extract_faces_range(vfgpu_ctx_t* c, int slot, std::vector<vfgpu_pf_t>& pflist, size_t i0, size_t i1)
+{
+  const T *rho = c->rho[slot].data(), *phi = c->phi[slot].data();
+  char *pftag = tag ? c->pftag.data() : NULL;
+  for (size_t i=i0; i<i1; i++)
+    extract_face<T, meshtype, tag>(c->h[slot], (int)i, pflist, pftag, rho, phi);
+}
+
+template <typename T, int meshtype>
+static void extract_edges_range(vfgpu_ctx_t* c, std::vector<vfgpu_pe_t>& pelist, size_t i0, size_t i1)
+{
+  const T *phi = c->phi[0].data(), *phi1 = c->phi[1].data();
+  for (size_t i=i0; i<i1; i++)
+    extract_edge<T, meshtype>(c->h[0], c->h[1], (int)i, pelist, phi, phi1);
+}
+
+void vfgpu_rotate_timesteps(vfgpu_ctx_t* c)
+{
+  std::swap(c->h[0], c->h[1]);
+  c->rho[0].swap(c->rho[1]);
+  c->phi[0].swap(c->phi[1]);
+  c->re[0].swap(c->re[1]);
+  c->im[0].swap(c->im[1]);
+}
+
+void vfgpu_upload_data(
+    vfgpu_ctx_t* c,
+    int slot,
+    const vfgpu_hdr_t& h,
+    const float *re,
+    const float *im)
+{
+  const int count = h.count;
+  const int face_count = count*(c->meshtype == VFGPU_MESH_TET ? 12 : 3);
+
+  memcpy(&c->h[slot], &h, sizeof(vfgpu_hdr_t));
+
+  c->re[slot].assign(re, re + count);
+  c->im[slot].assign(im, im + count);
+  c->rho[slot].resize(count);
+  c->phi[slot].resize(count);
+
+  if (c->enable_count_lines_in_cell && c->pftag.size() != (size_t)face_count) {
+    c->pftag.assign(face_count, 0);
+    c->count_lines_in_cell.assign(count, 0);
+  }
+}
+
+void vfgpu_set_data(
+    vfgpu_ctx_t* c,
+    int slot,
+    const vfgpu_hdr_t &h,
+    const float *psi_re_im)
+{
+  const int count = h.count;
+  std::vector<float> re(count), im(count);
+  for (int i=0; i<count; i++) {
+    re[i] = psi_re_im[i*2];
+    im[i] = psi_re_im[i*2+1];
+  }
+  vfgpu_upload_data(c, slot, h, re.data(), im.data());
+}
+
+void vfgpu_compute_rho_phi(vfgpu_ctx_t* c, int slot)
+{
+  const int count = c->h[slot].count;
+  const bool pertubation = c->pertubation>0.f;
+  const float sigma = c->pertubation;
+  const unsigned int seed = c->seed, stream = pertubation ? c->stream++ : 0;
+
+  const float *re = c->re[slot].data(), *im = c->im[slot].data();
+  float *rho = c->rho[slot].data(), *phi = c->phi[slot].data();
+
+  get_pool(c)->ParallelFor(count, chunk_size, [=](int, size_t i0, size_t i1) {
+    for (size_t i=i0; i<i1; i++) {
+      float r, m;
+      if (pertubation) {
+        normal_noise(seed, stream, (int)i, sigma, r, m);
+        r += re[i];
+        m += im[i];
+      } else {
+        r = re[i];
+        m = im[i];
+      }
+      rho[i] = sqrt(r*r + m*m);
+      phi[i] = atan2(m, r);
+    }
+  });
+}
+
+void vfgpu_clear_count_lines_in_cell(vfgpu_ctx_t* c)
+{
+  std::fill(c->count_lines_in_cell.begin(), c->count_lines_in_cell.end(), 0);
+}
+
+void vfgpu_count_lines_in_cell(vfgpu_ctx_t* c, int slot)
+{
+  const vfgpu_hdr_t &h = c->h[slot];
+  const char *pftag = c->pftag.data();
+  int *hist = c->count_lines_in_cell.data();
+  const bool tet = c->meshtype == VFGPU_MESH_TET;
+
+  get_pool(c)->ParallelFor(h.count, chunk_size, [&](int, size_t i0, size_t i1) {
+    for (size_t i=i0; i<i1; i++) {
+      int cidx[3];
+      nid2nidx(h, (int)i, cidx);
+      if (!valid_cidx_hex(h, cidx)) continue;
+      const int cid = cidx2cid_hex(h, cidx);
+
+      int fids[12]; // max is 12
+      const int n = tet ? hexcell_tetfaces(h, cidx, fids) : hexcell_hexfaces(h, cidx, fids);
+
+      int npf = 0;
+      for (int j=0; j<n; j++)
+        npf += pftag[fids[j]];
+
+      hist[cid] += npf/2;
+    }
+  });
+}
+
+void vfgpu_dump_count_lines_in_cell(vfgpu_ctx_t* c)
+{
+#ifdef WITH_NETCDF
+  int ncid;
+  int dimids[3];
+  int varids[1];
+
+  size_t starts[3] = {0, 0, 0},
+         sizes[3] = {(size_t)c->h[0].d[2], (size_t)c->h[0].d[1], (size_t)c->h[0].d[0]};
+
+  NC_SAFE_CALL( nc_create("count.nc", NC_CLOBBER | NC_64BIT_OFFSET, &ncid) );
+  NC_SAFE_CALL( nc_def_dim(ncid, "z", sizes[0], &dimids[0]) );
+  NC_SAFE_CALL( nc_def_dim(ncid, "y", sizes[1], &dimids[1]) );
+  NC_SAFE_CALL( nc_def_dim(ncid, "x", sizes[2], &dimids[2]) );
+  NC_SAFE_CALL( nc_def_var(ncid, "count", NC_INT, 3, dimids, &varids[0]) );
+  NC_SAFE_CALL( nc_enddef(ncid) );
+
+  NC_SAFE_CALL( nc_put_vara_int(ncid, varids[0], starts, sizes, c->count_lines_in_cell.data()) );
+  NC_SAFE_CALL( nc_close(ncid) );
+#else
+  fprintf(stderr, "[vfgpu] cannot dump %zu cell counts without netcdf\n", c->count_lines_in_cell.size());
+#endif
+}
+
+void vfgpu_extract_faces(vfgpu_ctx_t* c, int slot)
+{
+  const int nfacetypes = c->meshtype == VFGPU_MESH_TET ? 12 : 3;
+  const size_t face_count = (size_t)c->h[slot].count * nfacetypes;
+  const bool tag = c->enable_count_lines_in_cell;
+
+  vfgpu_compute_rho_phi(c, slot);
+
+  WorkerPool *pool = get_pool(c);
+  c->thread_pfs.resize(pool->NumberOfThreads());
+  for (size_t i=0; i<c->thread_pfs.size(); i++)
+    c->thread_pfs[i].clear();
+
+  if (tag)
+    std::fill(c->pftag.begin(), c->pftag.end(), 0);
+
+  pool->ParallelFor(face_count, chunk_size, [=](int tid, size_t i0, size_t i1) {
+    std::vector<vfgpu_pf_t> &pflist = c->thread_pfs[tid];
+    if (c->meshtype == VFGPU_MESH_HEX) {
+      if (tag) extract_faces_range<float, VFGPU_MESH_HEX, true>(c, slot, pflist, i0, i1);
+      else extract_faces_range<float, VFGPU_MESH_HEX, false>(c, slot, pflist, i0, i1);
+    } else {
+      if (tag) extract_faces_range<float, VFGPU_MESH_TET, true>(c, slot, pflist, i0, i1);
+      else extract_faces_range<float, VFGPU_MESH_TET, false>(c, slot, pflist, i0, i1);
+    }
+  });
+
+  c->pflist.clear();
+  for (size_t i=0; i<c->thread_pfs.size(); i++)
+    c->pflist.insert(c->pflist.end(), c->thread_pfs[i].begin(), c->thread_pfs[i].end());
+  std::sort(c->pflist.begin(), c->pflist.end(),
+      [](const vfgpu_pf_t& a, const vfgpu_pf_t& b) {return a.fid < b.fid;});
+}
+
+void vfgpu_extract_faces_multi(vfgpu_ctx_t* c, int slot, int K, const float *pertubations, const unsigned int *seeds)
+{
+  const int nfacetypes = c->meshtype == VFGPU_MESH_TET ? 12 : 3;
+  const int count = c->h[slot].count;
+  const size_t face_count = (size_t)count * nfacetypes;
+
+  WorkerPool *pool = get_pool(c);
+  const int nthreads = pool->NumberOfThreads();
+  c->K = K;
+  c->rhok.resize((size_t)count*K);
+  c->phik.resize((size_t)count*K);
+  c->pflists.resize(K);
+  c->thread_pfks.resize(nthreads*K);
+  for (size_t i=0; i<c->thread_pfks.size(); i++)
+    c->thread_pfks[i].clear();
+
+  const float *re = c->re[slot].data(), *im = c->im[slot].data();
+  float *rhok = c->rhok.data(), *phik = c->phik.data();
+
+  // noise stream 0 of each seed, see vfgpu_compute_rho_phi()
+  pool->ParallelFor(count, chunk_size, [=](int, size_t i0, size_t i1) {
+    for (size_t i=i0; i<i1; i++)
+      for (int k=0; k<K; k++) {
+        float r, m;
+        if (pertubations[k]>0.f) {
+          normal_noise(seeds[k], 0u, (int)i, pertubations[k], r, m);
+          r += re[i];
+          m += im[i];
+        } else {
+          r = re[i];
+          m = im[i];
+        }
+        rhok[i*K+k] = sqrt(r*r + m*m);
+        phik[i*K+k] = atan2(m, r);
+      }
+  });
+
+  pool->ParallelFor(face_count, chunk_size, [=](int tid, size_t i0, size_t i1) {
+    std::vector<vfgpu_pf_t> *pflists = &c->thread_pfks[tid*K];
+    for (size_t i=i0; i<i1; i++) {
+      if (c->meshtype == VFGPU_MESH_HEX)
+        extract_face_multi<float, VFGPU_MESH_HEX>(c->h[slot], (int)i, K, pflists, rhok, phik);
+      else
+        extract_face_multi<float, VFGPU_MESH_TET>(c->h[slot], (int)i, K, pflists, rhok, phik);
+    }
+  });
+
+  for (int k=0; k<K; k++) {
+    std::vector<vfgpu_pf_t> &pflist = c->pflists[k];
+    pflist.clear();
+    for (int t=0; t<nthreads; t++)
+      pflist.insert(pflist.end(), c->thread_pfks[t*K+k].begin(), c->thread_pfks[t*K+k].end());
+    std::sort(pflist.begin(), pflist.end(),
+        [](const vfgpu_pf_t& a, const vfgpu_pf_t& b) {return a.fid < b.fid;});
+  }
+}
+
+void vfgpu_extract_edges(vfgpu_ctx_t* c)
+{
+  const int nedgetypes = c->meshtype == VFGPU_MESH_TET ? 7 : 3;
+  const size_t edge_count = (size_t)c->h[0].count * nedgetypes;
+
+  WorkerPool *pool = get_pool(c);
+  c->thread_pes.resize(pool->NumberOfThreads());
+  for (size_t i=0; i<c->thread_pes.size(); i++)
+    c->thread_pes[i].clear();
+
+  pool->ParallelFor(edge_count, chunk_size, [=](int tid, size_t i0, size_t i1) {
+    std::vector<vfgpu_pe_t> &pelist = c->thread_pes[tid];
+    if (c->meshtype == VFGPU_MESH_TET)
+      extract_edges_range<float, VFGPU_MESH_TET>(c, pelist, i0, i1);
+    else
+      extract_edges_range<float, VFGPU_MESH_HEX>(c, pelist, i0, i1);
+  });
+
+  c->pelist.clear();
+  for (size_t i=0; i<c->thread_pes.size(); i++)
+    c->pelist.insert(c->pelist.end(), c->thread_pes[i].begin(), c->thread_pes[i].end());
+  std::sort(c->pelist.begin(), c->pelist.end(),
+      [](const vfgpu_pe_t& a, const vfgpu_pe_t& b) {return a.eid < b.eid;});
+}
+
+///////////////////
+
+vfgpu_ctx_t* vfgpu_create_ctx()
+{
+  vfgpu_ctx_t *c = new vfgpu_ctx_t;
+  c->meshtype = VFGPU_MESH_HEX;
+  c->enable_count_lines_in_cell = false;
+  c->pertubation = 0;
+  memset(c->h, 0, sizeof(c->h));
+  c->seed = 1234;
+  c->stream = 0;
+  c->K = 0;
+  c->nthreads = std::thread::hardware_concurrency();
+  if (c->nthreads == 0) c->nthreads = 1;
+  c->pool = NULL;
+  return c;
+}
+
+void vfgpu_destroy_ctx(vfgpu_ctx_t *c)
+{
+  delete c->pool;
+  delete c;
+}
+
+void vfgpu_set_meshtype(vfgpu_ctx_t* c, int meshtype)
+{
+  c->meshtype = meshtype;
+}
+
+void vfgpu_set_enable_count_lines_in_cell(vfgpu_ctx_t* c, bool b)
+{
+  c->enable_count_lines_in_cell = b;
+  if (b && c->h[0].count > 0) {
+    const int face_count = c->h[0].count*(c->meshtype == VFGPU_MESH_TET ? 12 : 3);
+    if (c->pftag.size() != (size_t)face_count) {
+      c->pftag.assign(face_count, 0);
+      c->count_lines_in_cell.assign(c->h[0].count, 0);
+    }
+  }
+}
+
+void vfgpu_get_pflist(vfgpu_ctx_t* c, int *n, vfgpu_pf_t **pflist)
+{
+  *n = c->pflist.size();
+  *pflist = c->pflist.data();
+}
+
+void vfgpu_get_pflist_multi(vfgpu_ctx_t* c, int k, int *n, vfgpu_pf_t **pflist)
+{
+  *n = c->pflists[k].size();
+  *pflist = c->pflists[k].data();
+}
+
+void vfgpu_get_pelist(vfgpu_ctx_t* c, int *n, vfgpu_pe_t **pelist)
+{
+  *n = c->pelist.size();
+  *pelist = c->pelist.data();
+}
+
+void vfgpu_set_pertubation(vfgpu_ctx_t* c, float p)
+{
+  c->pertubation = p;
+}
+
+void vfgpu_set_seed(vfgpu_ctx_t* c, unsigned int seed)
+{
+  c->seed = seed;
+  c->stream = 0;
+}
+
+void vfgpu_set_number_of_threads(vfgpu_ctx_t* c, int n)
+{
+  c->nthreads = n > 0 ? n : 1;
+}
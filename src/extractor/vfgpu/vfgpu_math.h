@@ -0,0 +1,771 @@
+#ifndef _VFGPU_MATH_H
+#define _VFGPU_MATH_H
+
+// face and edge math of vfgpu, shared by the CUDA kernels and the CPU backend
+
+#include "vfgpu.h"
+#include <cmath>
+
+#ifdef __CUDACC__
+#define VFGPU_DEVICE __device__ __host__
+#else
+#define VFGPU_DEVICE
+#endif
+
+template <typename T>
+VFGPU_DEVICE
+inline bool find_zero_barycentric(const T re[3], const T im[3], T lambda[3], T epsilon=0)
+{
+  T D = re[0]*im[1] + re[1]*im[2] + re[2]*im[0] - re[2]*im[1] - re[1]*im[0] - re[0]*im[2]; // TODO: check if D=0?
+  T det[3] = {
+    re[1]*im[2] - re[2]*im[1], 
+    re[2]*im[0] - re[0]*im[2], 
+    re[0]*im[1] - re[1]*im[0]
+  };
+
+  lambda[0] = det[0]/D; 
+  lambda[1] = det[1]/D; 
+  lambda[2] = det[2]/D;
+
+  // if (lambda[0]>=0 && lambda[1]>=0 && lambda[2]>=0) return true; 
+  if (lambda[0]>=-epsilon && lambda[1]>=-epsilon && lambda[2]>=-epsilon) return true; 
+  else return false; 
+}
+
+template <typename T>
+VFGPU_DEVICE
+inline bool find_zero_triangle(const T re[3], const T im[3], const T X[3][3], T pos[3], T epsilon=0)
+{
+  T lambda[3]; 
+  bool succ = find_zero_barycentric(re, im, lambda, epsilon);
+
+  T R[3][2] = {{X[0][0]-X[2][0], X[1][0]-X[2][0]}, 
+               {X[0][1]-X[2][1], X[1][1]-X[2][1]}, 
+               {X[0][2]-X[2][2], X[1][2]-X[2][2]}}; 
+
+  pos[0] = R[0][0]*lambda[0] + R[0][1]*lambda[1] + X[2][0]; 
+  pos[1] = R[1][0]*lambda[0] + R[1][1]*lambda[1] + X[2][1]; 
+  pos[2] = R[2][0]*lambda[0] + R[2][1]*lambda[1] + X[2][2]; 
+
+  return succ; 
+}
+
+// find the zero point in [0, 1]x[0, 1] quad, using generalized eigenvalue problem
+template <typename T>
+VFGPU_DEVICE
+static inline bool find_zero_unit_quad_bilinear(const T re[4], const T im[4], T pos[2], T epsilon=0)
+{
+  T f00 = re[0], f10 = re[1], f01 = re[3], f11 = re[2], // counter-clockwise
+    g00 = im[0], g10 = im[1], g01 = im[3], g11 = im[2];
+  T A0 = f00 - f10 - f01 + f11, 
+    B0 = f10 - f00, 
+    C0 = f01 - f00, 
+    D0 = f00,
+    A1 = g00 - g10 - g01 + g11, 
+    B1 = g10 - g00, 
+    C1 = g01 - g00, 
+    D1 = g00; 
+  T M0[4] = {-B0, -D0, -B1, -D1}; // stored in row major
+  // T M1[4] = {A0, C0, A1, C1}; // (yM1 - M0)v = 0, v = {x, 1}^T
+
+  T detM1 = A0*C1 - A1*C0; // TODO: check if detM1==0
+  T invM1[4] = {C1/detM1, -C0/detM1, -A1/detM1, A0/detM1};
+
+  // Q = invM1*M0
+  T Q[4] = {
+    invM1[0]*M0[0] + invM1[1]*M0[2], 
+    invM1[0]*M0[1] + invM1[1]*M0[3], 
+    invM1[2]*M0[0] + invM1[3]*M0[2], 
+    invM1[2]*M0[1] + invM1[3]*M0[3]
+  };
+
+  // compute y=eig(Q)
+  T trace = Q[0] + Q[3];
+  T det = Q[0]*Q[3] - Q[1]*Q[2];
+  T lambda[2] = {
+    T(trace/2 + sqrt(trace*trace/4 - det)), 
+    T(trace/2 - sqrt(trace*trace/4 - det))
+  }; 
+
+  T x[2] = {
+    (lambda[0]-Q[3])/Q[2], 
+    (lambda[1]-Q[3])/Q[2]
+  }; 
+  T y[2] = {
+    lambda[0], 
+    lambda[1]
+  };
+
+  bool found = false; 
+  for (int i=0; i<2; i++) // check the two roots 
+    if (x[i]>=0 && x[i]<=1 && y[i]>=0 && y[i]<=1) {
+      pos[0] = x[i]; 
+      pos[1] = y[i];
+      found = true; 
+      break; 
+    }
+  
+  if (!found) // check again, loosing creteria
+    for (int i=0; i<2; i++)  
+      if (x[i]>=-epsilon && x[i]<=1+epsilon && y[i]>=-epsilon && y[i]<=1+epsilon) {
+        pos[0] = x[i]; 
+        pos[1] = y[i];
+        found = true; 
+        break; 
+      }
+
+  return found; 
+}
+
+template <typename T>
+VFGPU_DEVICE
+static inline bool find_zero_quad_bilinear(const T re[4], const T im[4], const T X[4][3], T pos[3], T epsilon=0)
+{
+  T p[2]; 
+
+  bool succ = find_zero_unit_quad_bilinear(re, im, p, epsilon); 
+  if (!succ) return false;
+
+  T u[3], v[3]; 
+
+  u[0] = (1-p[0])*X[0][0] + p[0]*X[1][0];
+  u[1] = (1-p[0])*X[0][1] + p[0]*X[1][1];
+  u[2] = (1-p[0])*X[0][2] + p[0]*X[1][2];
+
+  v[0] = (1-p[0])*X[3][0] + p[0]*X[2][0];
+  v[1] = (1-p[0])*X[3][1] + p[0]*X[2][1];
+  v[2] = (1-p[0])*X[3][2] + p[0]*X[2][2];
+
+  pos[0] = (1-p[1])*u[0] + p[1]*v[0];
+  pos[1] = (1-p[1])*u[1] + p[1]*v[1];
+  pos[2] = (1-p[1])*u[2] + p[1]*v[2];
+
+  return true; 
+}
+
+template <typename T>
+VFGPU_DEVICE
+static inline bool find_tri_center(const T X[3][3], T pos[3])
+{
+  pos[0] = (X[0][0] + X[1][0] + X[2][0]) / 3;
+  pos[1] = (X[0][1] + X[1][1] + X[2][0]) / 3;
+  pos[2] = (X[0][2] + X[1][2] + X[2][0]) / 3;
+
+  return true;
+}
+
+template <typename T>
+VFGPU_DEVICE
+static inline bool find_quad_center(const T X[4][3], T pos[3])
+{
+  pos[0] = 0.25*(X[0][0] + X[1][0] + X[2][0] + X[3][0]);
+  pos[1] = 0.25*(X[0][1] + X[1][1] + X[2][0] + X[3][1]);
+  pos[2] = 0.25*(X[0][2] + X[1][2] + X[2][0] + X[3][2]);
+
+  return true;
+}
+
+template <typename T, int meshtype>
+VFGPU_DEVICE
+static inline bool find_zero(const T re[], const T im[], const T X[][3], T pos[3], T epsilon=T(0))
+{
+  if (meshtype == VFGPU_MESH_TET) 
+    return find_zero_triangle(re, im, X, pos, epsilon);
+    // return find_tri_center(X, pos);
+  else if (meshtype == VFGPU_MESH_HEX)
+    return find_zero_quad_bilinear(re, im, X, pos, epsilon);
+    // return find_quad_center(X, pos);
+  else
+    return false;
+}
+
+template <typename T>
+VFGPU_DEVICE
+inline static T fmod1(T x, T y)
+{
+  T z = fmod(x, y);
+  if (z<0) z += y;
+  return z;
+}
+
+template <typename T>
+VFGPU_DEVICE
+inline static T mod2pi(T x)
+{
+  T y = fmod(x, 2*M_PI); 
+  if (y<0) y+= 2*M_PI;
+  return y; 
+}
+
+template <typename T>
+VFGPU_DEVICE
+inline static T mod2pi1(T x)
+{
+  return mod2pi(x + M_PI) - M_PI;
+}
+
+template <typename T> 
+VFGPU_DEVICE
+inline int sgn(T x) 
+{
+  return (T(0) < x) - (x < T(0));
+}
+
+template <typename T>
+VFGPU_DEVICE
+static inline T inner_product(const T A[3], const T B[3])
+{
+  return A[0]*B[0] + A[1]*B[1] + A[2]*B[2];
+}
+
+template <typename T>
+VFGPU_DEVICE
+static inline T dist2(const T A[3], const T B[3])
+{
+  const T D[3] = {B[0]-A[0], B[1]-A[1], B[2]-A[2]};
+  return inner_product(D, D);
+}
+
+template <typename T> 
+VFGPU_DEVICE
+T line_integral(const vfgpu_hdr_t& h, const T X0[], const T X1[], const T A0[], const T A1[]) 
+{
+  T dX[3] = {X1[0] - X0[0], X1[1] - X0[1], X1[2] - X0[2]};
+  T A[3] = {A0[0] + A1[0], A0[1] + A1[1], A0[2] + A1[2]};
+
+  for (int i=0; i<3; i++)
+    if (dX[i] > h.lengths[i]/2) dX[i] -= h.lengths[i];
+    else if (dX[i] < -h.lengths[i]/2) dX[i] += h.lengths[i];
+
+  return 0.5 * inner_product(A, dX);
+}
+
+VFGPU_DEVICE
+inline void nid2nidx(const vfgpu_hdr_t& h, int id, int idx[3])
+{
+  const int s = h.d[0] * h.d[1]; 
+  const int k = id / s; 
+  const int j = (id - k*s) / h.d[0]; 
+  const int i = id - k*s - j*h.d[0]; 
+
+  idx[0] = i; idx[1] = j; idx[2] = k;
+}
+
+VFGPU_DEVICE
+inline int nidx2nid(const vfgpu_hdr_t& h, const int idx_[3])
+{
+  int idx[3] = {idx_[0], idx_[1], idx_[2]};
+  for (int i=0; i<3; i++) {
+    idx[i] = idx[i] % h.d[i];
+    if (idx[i] < 0)
+      idx[i] += h.d[i];
+  }
+  return idx[0] + h.d[0] * (idx[1] + h.d[1] * idx[2]); 
+}
+
+VFGPU_DEVICE
+inline bool valid_nidx(const vfgpu_hdr_t& h, const int idx[3])
+{
+  bool v[3] = {
+    idx[0]>=0 && idx[0]<h.d[0],
+    idx[1]>=0 && idx[1]<h.d[1],
+    idx[2]>=0 && idx[2]<h.d[2]
+  };
+  return v[0] && v[1] && v[2];
+}
+
+VFGPU_DEVICE
+inline bool valid_cidx_hex(const vfgpu_hdr_t& h, const int cidx[3])
+{
+  bool v[3] = {
+    cidx[0]>=0 && (cidx[0]<h.d[0] - (!h.pbc[0])),
+    cidx[1]>=0 && (cidx[1]<h.d[1] - (!h.pbc[1])),
+    cidx[2]>=0 && (cidx[2]<h.d[2] - (!h.pbc[2]))
+  };
+  return v[0] && v[1] && v[2];
+}
+
+VFGPU_DEVICE
+inline int cidx2cid_hex(const vfgpu_hdr_t& h, const int cidx[3])
+{
+  return nidx2nid(h, cidx);
+}
+
+VFGPU_DEVICE
+inline int fidx2fid_hex(const vfgpu_hdr_t& h, const int fidx[4])
+{
+  return nidx2nid(h, fidx)*3 + fidx[3];
+}
+
+VFGPU_DEVICE
+inline int fidx2fid_tet(const vfgpu_hdr_t& h, const int fidx[4])
+{
+  return nidx2nid(h, fidx)*12 + fidx[3];
+}
+
+VFGPU_DEVICE
+inline void fid2fidx_tet(const vfgpu_hdr_t& h, int id, int idx[4])
+{
+  int nid = id / 12;
+  nid2nidx(h, nid, idx);
+  idx[3] = id % 12;
+}
+
+VFGPU_DEVICE
+inline void fid2fidx_hex(const vfgpu_hdr_t& h, unsigned int id, int idx[4])
+{
+  unsigned int nid = id / 3;
+  nid2nidx(h, nid, idx);
+  idx[3] = id % 3;
+}
+
+VFGPU_DEVICE
+inline bool valid_fidx_tet(const vfgpu_hdr_t& h,const int fidx[4])
+{
+  if (fidx[3]<0 || fidx[3]>=12) return false;
+  else {
+    int o[3] = {0};
+    for (int i=0; i<3; i++)
+      if (h.pbc[i]) {
+        if (fidx[i] < 0 || fidx[i] >= h.d[i]) return false;
+      } else {
+        if (fidx[i] < 0 || fidx[i] > h.d[i]-1) return false;
+        else if (fidx[i] == h.d[i]-1) o[i] = 1;
+      }
+    
+    const int sum = o[0] + o[1] + o[2];
+    if (sum == 0) return true;
+    else if (o[0] + o[1] + o[2] > 1) return false;
+    else if (o[0] && (fidx[3] == 4 || fidx[3] == 5)) return true;
+    else if (o[1] && (fidx[3] == 2 || fidx[3] == 3)) return true; 
+    else if (o[2] && (fidx[3] == 0 || fidx[3] == 1)) return true;
+    else return false;
+  }
+}
+
+VFGPU_DEVICE
+inline bool valid_fidx_hex(const vfgpu_hdr_t& h, const int fidx[4])
+{
+  if (fidx[3]<0 || fidx[3]>=3) return false;
+  else {
+    int o[3] = {0}; 
+    for (int i=0; i<3; i++) 
+      if (h.pbc[i]) {
+        if (fidx[i]<0 || fidx[i]>=h.d[i]) return false;
+      } else {
+        if (fidx[i]<0 || fidx[i]>h.d[i]-1) return false;
+        else if (fidx[i] == h.d[i]-1) o[i] = 1;
+      }
+
+    const int sum = o[0] + o[1] + o[2];
+    if (sum == 0) return true;
+    else if (o[0] + o[1] + o[2] > 1) return false;
+    else if (o[0] && fidx[3] == 0) return true; 
+    else if (o[1] && fidx[3] == 1) return true;
+    else if (o[2] && fidx[3] == 2) return true;
+    else return false;
+  }
+}
+
+VFGPU_DEVICE
+inline void eid2eidx_tet(const vfgpu_hdr_t& h, int id, int idx[4])
+{
+  int nid = id / 7;
+  nid2nidx(h, nid, idx);
+  idx[3] = id % 7;
+}
+
+VFGPU_DEVICE
+inline void eid2eidx_hex(const vfgpu_hdr_t& h, int id, int idx[4]) 
+{
+  int nid = id / 3;
+  nid2nidx(h, nid, idx);
+  idx[3] = id % 3;
+}
+
+VFGPU_DEVICE
+inline bool valid_eidx_tet(const vfgpu_hdr_t& h, const int eidx[4])
+{
+  if (eidx[3]<0 || eidx[3]>=7) return false;
+  else {
+    for (int i=0; i<3; i++)
+      if (h.pbc[i]) {
+        if (eidx[i] < 0 || eidx[i] >= h.d[i]) return false;
+      } else {
+        if (eidx[i] < 0 || eidx[i] >= h.d[i]-1) return false;
+      }
+    return true;
+  }
+}
+
+VFGPU_DEVICE
+inline bool valid_eidx_hex(const vfgpu_hdr_t& h, const int eidx[4])
+{
+  if (eidx[3]<0 || eidx[3]>=3) return false;
+  else {
+    for (int i=0; i<3; i++) 
+      if (h.pbc[i]) {
+        if (eidx[i]<0 || eidx[i]>=h.d[i]) return false;
+      } else {
+        if (eidx[i]<0 || eidx[i]>=h.d[i]-1) return false;
+      }
+    return true;
+  }
+}
+
+VFGPU_DEVICE
+inline bool fid2nodes_tet(const vfgpu_hdr_t& h, int id, int nidxs[3][3])
+{
+  const int nodes_idx[12][3][3] = { // 12 types of faces
+    {{0, 0, 0}, {1, 0, 0}, {1, 1, 0}}, // ABC
+    {{0, 0, 0}, {1, 1, 0}, {0, 1, 0}}, // ACD
+    {{0, 0, 0}, {1, 0, 0}, {1, 0, 1}}, // ABF
+    {{0, 0, 0}, {0, 0, 1}, {1, 0, 1}}, // AEF
+    {{0, 0, 0}, {0, 1, 0}, {0, 0, 1}}, // ADE
+    {{0, 1, 0}, {0, 0, 1}, {0, 1, 1}}, // DEH
+    {{0, 0, 0}, {0, 1, 0}, {1, 0, 1}}, // ADF
+    {{0, 1, 0}, {1, 0, 1}, {1, 1, 1}}, // DFG
+    {{0, 1, 0}, {0, 0, 1}, {1, 0, 1}}, // DEF
+    {{1, 1, 0}, {0, 1, 0}, {1, 0, 1}}, // CDF
+    {{0, 0, 0}, {1, 1, 0}, {1, 0, 1}}, // ACF
+    {{0, 1, 0}, {0, 0, 1}, {1, 1, 1}}  // DEG
+  };
+
+  int fidx[4];
+  fid2fidx_tet(h, id, fidx);
+
+  if (valid_fidx_tet(h, fidx)) {
+    const int type = fidx[3];
+    for (int p=0; p<3; p++) 
+      for (int q=0; q<3; q++) 
+        nidxs[p][q] = fidx[q] + nodes_idx[type][p][q];
+    return true;
+  }
+  else
+    return false;
+}
+
+VFGPU_DEVICE
+inline bool fid2nodes_hex(const vfgpu_hdr_t &h, int id, int nidxs[4][3])
+{
+  const int nodes_idx[3][4][3] = { // 3 types of faces
+    {{0, 0, 0}, {0, 1, 0}, {0, 1, 1}, {0, 0, 1}}, // YZ
+    {{0, 0, 0}, {0, 0, 1}, {1, 0, 1}, {1, 0, 0}}, // ZX
+    {{0, 0, 0}, {1, 0, 0}, {1, 1, 0}, {0, 1, 0}}  // XY
+  };
+  
+  int fidx[4];
+  fid2fidx_hex(h, id, fidx);
+
+  if (valid_fidx_hex(h, fidx)) {
+    const int type = fidx[3];
+    for (int p=0; p<4; p++) 
+      for (int q=0; q<3; q++) 
+        nidxs[p][q] = fidx[q] + nodes_idx[type][p][q];
+    return true;
+  }
+  else
+    return false;
+}
+
+VFGPU_DEVICE
+inline bool eid2nodes_tet(const vfgpu_hdr_t& h, int eid, int nidxs[2][3])
+{
+  const int nodes_idx[7][2][3] = { // 7 types of edges
+    {{0, 0, 0}, {1, 0, 0}}, // AB
+    {{0, 0, 0}, {1, 1, 0}}, // AC
+    {{0, 0, 0}, {0, 1, 0}}, // AD
+    {{0, 0, 0}, {0, 0, 1}}, // AE
+    {{0, 0, 0}, {1, 0, 1}}, // AF
+    {{0, 1, 0}, {0, 0, 1}}, // DE
+    {{0, 1, 0}, {1, 0, 1}}, // DF
+  };
+  
+  int eidx[4];
+  eid2eidx_tet(h, eid, eidx);
+
+  if (valid_eidx_tet(h, eidx)) {
+    const int type = eidx[3];
+    for (int p=0; p<2; p++) 
+      for (int q=0; q<3; q++) 
+        nidxs[p][q] = eidx[q] + nodes_idx[type][p][q];
+    return true;
+  }
+  else
+    return false;
+}
+
+VFGPU_DEVICE
+inline bool eid2nodes_hex(const vfgpu_hdr_t& h, int eid, int nidxs[2][3])
+{
+  const int nodes_idx[3][2][3] = { // 3 types of edges
+    {{0, 0, 0}, {1, 0, 0}}, 
+    {{0, 0, 0}, {0, 1, 0}}, 
+    {{0, 0, 0}, {0, 0, 1}}
+  };
+
+  int eidx[4];
+  eid2eidx_hex(h, eid, eidx);
+
+  if (valid_eidx_hex(h, eidx)) {
+    const int type = eidx[3];
+    for (int p=0; p<2; p++) 
+      for (int q=0; q<3; q++) 
+        nidxs[p][q] = eidx[q] + nodes_idx[type][p][q];
+    return true;
+  }
+  else
+    return false;
+}
+
+VFGPU_DEVICE
+inline int hexcell_hexfaces(const vfgpu_hdr_t& h, const int cidx[3], int* fids)
+{
+  const int fidxs[6][4] = {
+    {cidx[0], cidx[1], cidx[2], 0},  
+    {cidx[0], cidx[1], cidx[2], 1},
+    {cidx[0], cidx[1], cidx[2], 2}, 
+    {cidx[0]+1, cidx[1], cidx[2], 0}, 
+    {cidx[0], cidx[1]+1, cidx[2], 1},
+    {cidx[0], cidx[1], cidx[2]+1, 2}};
+
+  for (int i=0; i<6; i++) 
+    fids[i] = fidx2fid_hex(h, fidxs[i]);
+
+  return 6;
+}
+
+VFGPU_DEVICE
+inline int hexcell_tetfaces(const vfgpu_hdr_t& h, const int cidx[3], int* fids)
+{
+  const int fidxs[12][4] = { // two triangles on each side of the cube
+    {cidx[0], cidx[1], cidx[2], 0},  
+    {cidx[0], cidx[1], cidx[2], 1},  
+    {cidx[0], cidx[1], cidx[2], 2},  
+    {cidx[0], cidx[1], cidx[2], 3},  
+    {cidx[0], cidx[1], cidx[2], 4},  
+    {cidx[0], cidx[1], cidx[2], 5},  
+    {cidx[0]+1, cidx[1], cidx[2], 4}, 
+    {cidx[0]+1, cidx[1], cidx[2], 5}, 
+    {cidx[0], cidx[1]+1, cidx[2], 2}, 
+    {cidx[0], cidx[1]+1, cidx[2], 3}, 
+    {cidx[0], cidx[1], cidx[2]+1, 0},
+    {cidx[0], cidx[1], cidx[2]+1, 1}};
+
+  for (int i=0; i<12; i++) 
+    fids[i] = fidx2fid_tet(h, fidxs[i]);
+
+  return 12;
+}
+
+
+template <typename T>
+VFGPU_DEVICE
+inline void nidx2pos(const vfgpu_hdr_t& h, const int nidx[3], T X[3])
+{
+  for (int i=0; i<3; i++) 
+    X[i] = nidx[i] * h.cell_lengths[i] + h.origins[i];
+}
+
+template <typename T>
+VFGPU_DEVICE
+inline void magnetic_potential(const vfgpu_hdr_t& h, T X[3], T A[3])
+{
+  if (h.B[1]>0) {
+    A[0] = -h.Kx; 
+    A[1] = X[0] * h.B[2];
+    A[2] = -X[0] * h.B[1];
+  } else {
+    A[0] = -X[1] * h.B[2] - h.Kx;
+    A[1] = 0;
+    A[2] = X[1] * h.B[0];
+  }
+}
+
+template <typename T, int meshtype>
+VFGPU_DEVICE
+inline bool get_face_values(
+    const vfgpu_hdr_t& h, 
+    int fid, 
+    T X[][3],
+    T A[][3],
+    T rho[],
+    T phi[],
+    const T *rho_,
+    const T *phi_)
+{
+  const int nnodes = meshtype == VFGPU_MESH_TET ? 3 : 4;
+  int nidxs[nnodes][3], nids[nnodes];
+  bool valid = meshtype == VFGPU_MESH_TET ? fid2nodes_tet(h, fid, nidxs) : fid2nodes_hex(h, fid, nidxs);
+  
+  if (valid) {
+    for (int i=0; i<nnodes; i++) {
+      nids[i] = nidx2nid(h, nidxs[i]);
+      // re[i] = re_[nids[i]];
+      // im[i] = im_[nids[i]];
+      // rho[i] = sqrt(re[i]*re[i] + im[i]*im[i]);
+      // phi[i] = atan2(im[i], re[i]);
+      rho[i] = rho_[nids[i]];
+      phi[i] = phi_[nids[i]];
+   
+      nidx2pos(h, nidxs[i], X[i]);
+      magnetic_potential(h, X[i], A[i]); 
+    }
+  }
+
+  return valid;
+}
+
+template <typename T, int meshtype>
+VFGPU_DEVICE
+inline bool get_vface_values(
+    const vfgpu_hdr_t& h, 
+    const vfgpu_hdr_t& h1, 
+    int eid, 
+    T X[4][3],
+    T A[4][3],
+    T phi[4],
+    const T *phi_,
+    const T *phi1_)
+{
+  int nidxs[2][3], nids[2];
+  bool valid = meshtype == VFGPU_MESH_TET ? eid2nodes_tet(h, eid, nidxs) : eid2nodes_hex(h, eid, nidxs);
+
+  if (valid) {
+    nids[0] = nidx2nid(h, nidxs[0]);
+    nids[1] = nidx2nid(h, nidxs[1]);
+
+    phi[0] = phi_[nids[0]]; 
+    phi[1] = phi_[nids[1]];
+    phi[2] = phi1_[nids[1]];
+    phi[3] = phi1_[nids[0]];
+
+    nidx2pos(h, nidxs[0], X[0]);
+    nidx2pos(h, nidxs[1], X[1]);
+    nidx2pos(h1, nidxs[1], X[2]);
+    nidx2pos(h1, nidxs[0], X[3]);
+
+    magnetic_potential(h, X[0], A[0]);
+    magnetic_potential(h, X[1], A[1]);
+    magnetic_potential(h1, X[2], A[2]);
+    magnetic_potential(h1, X[3], A[3]);
+
+    return true;
+  } else 
+    return false;
+}
+
+// with precomputed line integrals of the edges, li[i] is from node i to i+1
+template <typename T>
+VFGPU_DEVICE
+inline int contour_chirality_li(
+    int nnodes, // nnodes <= 4
+    const T phi[], 
+    const T li[],
+    T delta[])
+{
+  T phase_jump = 0;
+  for (int i=0; i<nnodes; i++) {
+    int j = (i+1) % nnodes;
+    delta[i] = phi[j] - phi[i]; 
+    T qp = 0; // TODO
+    delta[i] = mod2pi1(delta[i] - li[i] + qp);
+    phase_jump -= delta[i];
+  }
+  
+  if (fabs(phase_jump)<0.5) return 0; // not punctured
+  else return sgn(phase_jump);
+}
+
+template <typename T>
+VFGPU_DEVICE
+inline int contour_chirality(
+    const vfgpu_hdr_t &h, 
+    int nnodes, // nnodes <= 4
+    const T phi[], 
+    const T X[][3], 
+    const T A[][3],
+    T delta[])
+{
+  T li[4];
+  for (int i=0; i<nnodes; i++) {
+    int j = (i+1) % nnodes;
+    li[i] = line_integral(h, X[i], X[j], A[i], A[j]);
+  }
+  return contour_chirality_li(nnodes, phi, li, delta);
+}
+
+// for space-time vfaces
+template <typename T>
+VFGPU_DEVICE
+inline int contour_chirality_spt(
+    const vfgpu_hdr_t &h, 
+    const vfgpu_hdr_t &, // h1, FIXME: varying B
+    const T phi[4], 
+    const T X[4][3], 
+    const T A[4][3],
+    T delta[])
+{
+  T li[4] = { // FIXME: varying B
+    line_integral(h, X[0], X[1], A[0], A[1]), 
+    0, 
+    line_integral(h, X[1], X[0], A[2], A[3]), 
+    0};
+  T qp[4] = {0, 0, 0, 0}; // FIXME
+
+  T phase_jump = 0;
+  for (int i=0; i<4; i++) {
+    int j = (i+1) % 4;
+    delta[i] = phi[j] - phi[i]; 
+    delta[i] = mod2pi1(delta[i] - li[i] + qp[i]);
+    phase_jump -= delta[i];
+  }
+  
+  if (fabs(phase_jump)<0.5) return 0; // not punctured
+  else return sgn(phase_jump);
+}
+
+template <typename T>
+VFGPU_DEVICE
+inline void gauge_transform(
+    int nnodes, 
+    const T rho[],
+    const T delta[],
+    T phi[], 
+    T re[], 
+    T im[])
+{
+  re[0] = rho[0] * cos(phi[0]);
+  im[0] = rho[0] * sin(phi[0]);
+  for (int i=1; i<nnodes; i++) {
+    phi[i] = phi[i-1] + delta[i-1];
+    re[i] = rho[i] * cos(phi[i]);
+    im[i] = rho[i] * sin(phi[i]);
+  }
+}
+
+// counter-based gaussian noise: the pertubation of a node is a function of
+// (seed, stream, node id) only, regardless of the order of evaluation
+VFGPU_DEVICE
+inline unsigned long long mix64(unsigned long long x) // splitmix64 finalizer
+{
+  x ^= x >> 30; x *= 0xbf58476d1ce4e5b9ULL;
+  x ^= x >> 27; x *= 0x94d049bb133111ebULL;
+  x ^= x >> 31;
+  return x;
+}
+
+template <typename T>
+VFGPU_DEVICE
+inline void normal_noise(unsigned int seed, unsigned int stream, int idx, T sigma, T &n0, T &n1)
+{
+  const unsigned long long k = mix64(
+      mix64(((unsigned long long)seed << 32) | stream) + 0x9e3779b97f4a7c15ULL * (unsigned int)idx);
+  const T u0 = ((k >> 32) + T(1)) * T(2.3283064365386963e-10), // (0, 1]
+          u1 = (k & 0xffffffffULL) * T(2.3283064365386963e-10); // [0, 1)
+  const T r = sigma * sqrt(T(-2) * log(u0));
+  n0 = r * cos(T(2*M_PI) * u1); // box-muller
+  n1 = r * sin(T(2*M_PI) * u1);
+}
+
+#endif
@@ -2,14 +2,16 @@
 #include <cassert>
 #include <cstdio>
 #include <limits.h>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 static const char BDATTypeNames[] = {
   'b', 'B', 'h', 'H', 'i', 'I', 'q', 'Q', 'f', 'd', 's'};
 static const int BDATTypeSizes[] = {
   1, 1, 2, 2, 4, 4, 8, 8, 8, 16, 1};
-static const std::string BDATTypeNamesLong[] = {
-  "INT8", "UINT8", "INT16", "UINT16", "INT32", "UINT32", 
-  "INT64", "UINT64", "FLOAT", "DOUBLE", "CHAR"};
 static const std::string BDATSignature = "BDAT";
 
 static unsigned int TypeID2RecType(unsigned int id)
@@ -29,14 +31,6 @@ static unsigned int TypeID2RecType(unsigned int id)
   }
 }
 
-static std::string RecType2String(unsigned int recType)
-{
-  if (recType<=BDAT_CHAR)
-    return BDATTypeNamesLong[recType];
-  else 
-    return std::string();
-}
-
 BDATReader::BDATReader(const std::string& filename) 
   : state(BDAT_STATE_HEADER)
 {
@@ -86,8 +80,8 @@ std::string BDATReader::ReadNextRecordInfo()
 
   recType = TypeID2RecType(typeID);
 
-  // fprintf(stderr, "recID=%d, recName=%s, recType=%s, recNum=%d, recLen=%d\n", 
-  //     recID, recName.c_str(), RecType2String(recType).c_str(), recNum, recLen);
+  // fprintf(stderr, "recID=%d, recName=%s, recType=%d, recNum=%d, recLen=%d\n", 
+  //     recID, recName.c_str(), recType, recNum, recLen);
 
   state = BDAT_STATE_DATA;
 
@@ -122,3 +116,74 @@ bool BDATReader::ReadString(int length, std::string *str)
   
   return count>0;
 }
+
+////////////////
+BDATMappedReader::BDATMappedReader(const std::string& filename) :
+  base(NULL), size(0), valid(false)
+{
+  int fd = open(filename.c_str(), O_RDONLY);
+  if (fd < 0) return;
+
+  struct stat st;
+  if (fstat(fd, &st) != 0 || st.st_size < 8) {
+    close(fd);
+    return;
+  }
+  size = st.st_size;
+
+  void *p = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd); // the mapping stays valid
+  if (p == MAP_FAILED) return;
+  base = (const char*)p;
+
+  if (std::string(base, 4) != BDATSignature) 
+    return;
+
+  // record headers: IDlen, name, typeID, recNum, recLen.  a record that
+  // runs past the end of the file makes the whole file invalid
+  size_t pos = 8; // signature and BOM
+  while (pos < size) {
+    unsigned int IDlen, typeID;
+    if (pos + 4 > size) return; // truncated
+    memcpy(&IDlen, base + pos, 4);
+    const size_t length = IDlen & 0xff;
+    if (pos + 4 + length + 12 > size) return; // truncated
+
+    Record r;
+    r.recID = IDlen >> 8;
+    r.name.assign(base + pos + 4, length);
+    memcpy(&typeID, base + pos + 4 + length, 4);
+    memcpy(&r.recNum, base + pos + 8 + length, 4);
+    memcpy(&r.recLen, base + pos + 12 + length, 4);
+    r.recType = TypeID2RecType(typeID);
+    r.offset = pos + 16 + length;
+    if (r.offset + r.Size() > size) return; // truncated
+    
+    records.push_back(r);
+    pos = r.offset + r.Size();
+  }
+
+  valid = true;
+}
+
+BDATMappedReader::~BDATMappedReader()
+{
+  if (base) 
+    munmap((void*)base, size);
+}
+
+const BDATMappedReader::Record* BDATMappedReader::FindRecord(const std::string& name) const
+{
+  for (size_t i=0; i<records.size(); i++) 
+    if (records[i].name == name) 
+      return &records[i];
+  return NULL;
+}
+
+void BDATMappedReader::WillNeed(const Record &r) const
+{
+  const size_t pagesize = sysconf(_SC_PAGESIZE);
+  const size_t lo = r.offset / pagesize * pagesize;
+  madvise((void*)(base + lo), r.offset + r.Size() - lo, MADV_SEQUENTIAL);
+  madvise((void*)(base + lo), r.offset + r.Size() - lo, MADV_WILLNEED);
+}
@@ -2,6 +2,8 @@
 #define _BDATREADER_H
 
 #include <string>
+#include <vector>
+#include <cstring>
 
 class BDATReader {
   enum {
@@ -36,6 +38,49 @@ private: // the state machine
   int valid, state;
 };
 
+// memory-mapped BDAT file.  the record headers are indexed once when the
+// file is opened; the record data are read in place from the mapping.
+class BDATMappedReader {
+public:
+  struct Record {
+    std::string name;
+    unsigned int recID, recType, recNum, recLen;
+    size_t offset; // of the data in the file
+    size_t Size() const {return (size_t)recNum * recLen;}
+  };
+
+  BDATMappedReader(const std::string &filename);
+  ~BDATMappedReader();
+
+  bool Valid() const {return valid;}
+
+  size_t NumberOfRecords() const {return records.size();}
+  const Record& GetRecord(size_t i) const {return records[i];}
+  const Record* FindRecord(const std::string &name) const; //!< NULL if not found
+
+  const void* RecordData(const Record &r) const {return base + r.offset;}
+  template <typename T> const T* RecordArray(const Record &r) const { //!< NULL if not aligned for T
+    return (r.offset % sizeof(T)) == 0 ? (const T*)(base + r.offset) : NULL;
+  }
+  template <typename T> T Value(const Record &r) const { //!< first element
+    T v;
+    memcpy(&v, base + r.offset, sizeof(T));
+    return v;
+  }
+
+  void WillNeed(const Record &r) const; //!< starts paging in the record
+
+private:
+  BDATMappedReader(const BDATMappedReader&);
+  BDATMappedReader& operator=(const BDATMappedReader&);
+
+private:
+  const char *base;
+  size_t size;
+  std::vector<Record> records;
+  bool valid;
+};
+
 enum {
   BDAT_INT8 = 0, 
   BDAT_UINT8, 
@@ -100,6 +100,33 @@ void GLDataset::GetFaceValues(const CFace& f, int slot, float X[][3], float A_[]
   AverageA(f.nodes.size(), A_);
 }
 
+void GLDataset::GetFaceValues(const CFaceView& f, int slot, float X[][3], float A_[][3], float rho[], float phi[], float re[], float im[]) const
+{
+  for (int i=0; i<f.nnodes; i++) {
+    Pos(f.nodes[i], X[i]);
+    A(f.nodes[i], A_[i], slot);
+    RhoPhiReIm(f.nodes[i], rho[i], phi[i], re[i], im[i], slot);
+  }
+    
+  AverageA(f.nnodes, A_);
+}
+
+void GLDataset::GetSpaceTimeEdgeValues(const CEdgeView& e, float X[][3], float A_[][3], float rho[], float phi[], float re[], float im[]) const
+{
+  Pos(e.node0, X[0]);
+  Pos(e.node1, X[1]);
+
+  A(e.node0, A_[0], 0);
+  A(e.node1, A_[1], 0);
+  A(e.node1, A_[2], 1);
+  A(e.node0, A_[3], 1);
+
+  RhoPhiReIm(e.node0, rho[0], phi[0], re[0], im[0], 0);
+  RhoPhiReIm(e.node1, rho[1], phi[1], re[1], im[1], 0);
+  RhoPhiReIm(e.node1, rho[2], phi[2], re[2], im[2], 1);
+  RhoPhiReIm(e.node0, rho[3], phi[3], re[3], im[3], 1);
+}
+
 void GLDataset::GetSpaceTimeEdgeValues(const CEdge& e, float X[][3], float A_[][3], float rho[], float phi[], float re[], float im[]) const
 {
   Pos(e.node0, X[0]);
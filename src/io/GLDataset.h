@@ -30,6 +30,9 @@ public: // mesh utils
   virtual void GetFaceValues(const CFace&, int timeslot, float X[][3], float A[][3], float rho[], float phi[], float re[], float im[]) const;
   virtual void GetSpaceTimeEdgeValues(const CEdge&, float X[][3], float A[][3], float rho[], float phi[], float re[], float im[]) const;
   
+  void GetFaceValues(const CFaceView&, int timeslot, float X[][3], float A[][3], float rho[], float phi[], float re[], float im[]) const;
+  void GetSpaceTimeEdgeValues(const CEdgeView&, float X[][3], float A[][3], float rho[], float phi[], float re[], float im[]) const;
+  
   virtual CellIdType Pos2CellId(const float X[]) const = 0; //!< returns the elemId for a given position
   // virtual bool OnBoundary(ElemIdType id) const = 0;
 
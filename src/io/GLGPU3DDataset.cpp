@@ -177,6 +177,7 @@ bool GLGPU3DDataset::Supercurrent(const float X[3], float J[3], int slot) const
   static const int st[3] = {0};
   float gpt[3];
   const float *j[3] = {_Jx[slot], _Jy[slot], _Jz[slot]};
+  if (j[0] == NULL || j[1] == NULL || j[2] == NULL) return false; // not precomputed, or a region of interest
  
   Pos2Grid(X, gpt);
   if (isnan(gpt[0]) || gpt[0]<=1 || gpt[0]>dims()[0]-2 || 
@@ -1,5 +1,7 @@
 #include "GLGPUDataset.h"
 #include "GLGPU_IO_Helper.h"
+#include "GLGPUPrefetcher.h"
+#include "PsiKernel.h"
 #include "common/Utils.hpp"
 #include "glpp/GL_post_process.h"
 #include <cassert>
@@ -25,7 +27,13 @@ void free1(T **p)
   }
 }
 
-GLGPUDataset::GLGPUDataset()
+GLGPUDataset::GLGPUDataset() :
+  _load_rho_phi(true),
+  _has_roi(false),
+  _prefetch_depth(0), 
+  _prefetch_threads(1),
+  _prefetch_bytes(0),
+  _prefetcher(NULL)
 {
   memset(_rho, 0, sizeof(float*)*2);
   memset(_phi, 0, sizeof(float*)*2);
@@ -38,6 +46,8 @@ GLGPUDataset::GLGPUDataset()
 
 GLGPUDataset::~GLGPUDataset()
 {
+  delete _prefetcher;
+
   for (int i=0; i<2; i++) {
     free1(&_rho[i]);
     free1(&_phi[i]);
@@ -110,6 +120,9 @@ bool GLGPUDataset::OpenDataFile(const std::string &filename)
 
   char fname[1024];
 
+  delete _prefetcher;
+  _prefetcher = NULL;
+
   _filenames.clear();
   while (ifs.getline(fname, 1024)) {
     // std::cout << fname << std::endl;
@@ -127,16 +140,23 @@ bool GLGPUDataset::OpenDataFileByPattern(const std::string &pattern)
   glob_t results;
 
   glob(pattern.c_str(), 0, NULL, &results);
+  delete _prefetcher;
+  _prefetcher = NULL;
   _filenames.clear();
   for (int i=0; i<results.gl_pathc; i++) 
     _filenames.push_back(results.gl_pathv[i]);
 
+  globfree(&results);
+
   // fprintf(stderr, "found %lu files\n", _filenames.size());
-  return _filenames.size()>0;
+  if (_filenames.empty()) return false;
+  return true;
 }
 
 void GLGPUDataset::CloseDataFile()
 {
+  delete _prefetcher;
+  _prefetcher = NULL;
   _filenames.clear();
 }
 
@@ -147,7 +167,13 @@ bool GLGPUDataset::LoadTimeStep(int timestep, int slot)
   const std::string &filename = _filenames[timestep];
 
   // load
-  if (OpenBDATDataFile(filename, slot)) succ = true; 
+  if (_prefetch_depth > 0) {
+    if (_prefetcher == NULL)
+      _prefetcher = new GLGPUPrefetcher(_filenames, _prefetch_depth, _prefetch_threads, _prefetch_bytes, _precompute_supercurrent, _load_rho_phi, _has_roi ? _roi : NULL);
+    succ = _prefetcher->Fetch(timestep, _h[slot], 
+        &_rho[slot], &_phi[slot], &_re[slot], &_im[slot], &_Jx[slot], &_Jy[slot], &_Jz[slot]);
+  } 
+  else if (OpenBDATDataFile(filename, slot)) succ = true; 
   else if (OpenLegacyDataFile(filename, slot)) succ = true;
 
   if (!succ) return false;
@@ -162,6 +188,46 @@ bool GLGPUDataset::LoadTimeStep(int timestep, int slot)
   return true;
 }
 
+void GLGPUDataset::SetPrefetch(int depth, int nthreads, size_t max_bytes)
+{
+  delete _prefetcher;
+  _prefetcher = NULL;
+  _prefetch_depth = depth;
+  _prefetch_threads = nthreads;
+  _prefetch_bytes = max_bytes;
+}
+
+void GLGPUDataset::SetLoadRhoPhi(bool b)
+{
+  delete _prefetcher;
+  _prefetcher = NULL;
+  _load_rho_phi = b;
+
+  if (!b) 
+    for (int i=0; i<2; i++) {
+      free1(&_rho[i]);
+      free1(&_phi[i]);
+    }
+}
+
+void GLGPUDataset::SetRegionOfInterest(const int lo[3], const int hi[3], int halo)
+{
+  delete _prefetcher;
+  _prefetcher = NULL;
+
+  _has_roi = lo != NULL && hi != NULL;
+  if (_has_roi) 
+    for (int i=0; i<3; i++) {
+      _roi[i] = lo[i] - halo;
+      _roi[3+i] = hi[i] + halo;
+    }
+
+  // the supercurrent needs the whole domain; with a region of interest it is
+  // not computed, and Supercurrent() fails
+  if (_has_roi && _precompute_supercurrent)
+    fprintf(stderr, "WARNING: supercurrent is not computed with a region of interest.\n");
+}
+
 void GLGPUDataset::GetDataArray(GLHeader& h, float **rho, float **phi, float **re, float **im, float **J, int slot)
 {
   h = _h[slot];
@@ -184,8 +250,11 @@ bool GLGPUDataset::BuildDataFromArray(const GLHeader& h, const float *rho, const
   _re[0] = (float*)malloc(sizeof(float)*count); 
   _im[0] = (float*)malloc(sizeof(float)*count); 
 
-  memcpy(_rho[0], rho, sizeof(float)*count);
-  memcpy(_phi[0], phi, sizeof(float)*count);
+  if (rho && phi) {
+    memcpy(_rho[0], rho, sizeof(float)*count);
+    memcpy(_phi[0], phi, sizeof(float)*count);
+  } else 
+    psi_kernel_rhophi(count, re, im, _rho[0], _phi[0]);
   memcpy(_re[0], re, sizeof(float)*count);
   memcpy(_im[0], im, sizeof(float)*count);
   
@@ -234,16 +303,16 @@ bool GLGPUDataset::OpenLegacyDataFile(const std::string& filename, int slot)
   int ndims;
   _h[slot].dtype = DTYPE_CA02;
 
-  free1(&_rho[slot]); 
-  free1(&_phi[slot]); 
-  free1(&_re[slot]); 
-  free1(&_im[slot]);
+  // rho, phi, re, and im are reused
   free1(&_Jx[slot]);
   free1(&_Jy[slot]);
   free1(&_Jz[slot]);
 
   if (!::GLGPU_IO_Helper_ReadLegacy(
-        filename, _h[slot], &_rho[slot], &_phi[slot], &_re[slot], &_im[slot], &_Jx[slot], &_Jy[slot], &_Jz[slot], false, _precompute_supercurrent))
+        filename, _h[slot], 
+        _load_rho_phi ? &_rho[slot] : NULL, _load_rho_phi ? &_phi[slot] : NULL, 
+        &_re[slot], &_im[slot], &_Jx[slot], &_Jy[slot], &_Jz[slot], false, _precompute_supercurrent, 
+        _has_roi ? _roi : NULL))
     return false;
   else 
     return true;
@@ -260,7 +329,10 @@ void GLGPUDataset::WriteNetCDF(const std::string& filename, int slot) {
 void GLGPUDataset::WriteRaw(const std::string& prefix, int slot) {
   const int count = _h[0].dims[0] * _h[0].dims[1] * _h[0].dims[2];
 
+  if (_Jx[slot] == NULL) return; // not computed
+
   FILE *fp = fopen(prefix.c_str(), "wb");
+  if (fp == NULL) return;
   fwrite(_Jx[slot], sizeof(float), count, fp);
   fwrite(_Jy[slot], sizeof(float), count, fp);
   fwrite(_Jz[slot], sizeof(float), count, fp);
@@ -272,16 +344,16 @@ bool GLGPUDataset::OpenBDATDataFile(const std::string& filename, int slot)
   int ndims;
   _h[slot].dtype = DTYPE_BDAT;
   
-  free1(&_rho[slot]); 
-  free1(&_phi[slot]); 
-  free1(&_re[slot]); 
-  free1(&_im[slot]); 
+  // rho, phi, re, and im are reused
   free1(&_Jx[slot]);
   free1(&_Jy[slot]);
   free1(&_Jz[slot]);
 
   if (!::GLGPU_IO_Helper_ReadBDAT(
-        filename, _h[slot], &_rho[slot], &_phi[slot], &_re[slot], &_im[slot], &_Jx[slot], &_Jy[slot], &_Jz[slot], false, _precompute_supercurrent))
+        filename, _h[slot], 
+        _load_rho_phi ? &_rho[slot] : NULL, _load_rho_phi ? &_phi[slot] : NULL, 
+        &_re[slot], &_im[slot], &_Jx[slot], &_Jy[slot], &_Jz[slot], false, _precompute_supercurrent, 
+        _has_roi ? _roi : NULL))
     return false;
   else 
     return true;
@@ -15,6 +15,10 @@ public:
   bool OpenDataFile(const std::string& filename); // file list
   bool OpenDataFileByPattern(const std::string& pattern); 
   bool LoadTimeStep(int timestep, int slot=0);
+  void SetPrefetch(int depth, int nthreads=1, size_t max_bytes=0); // decode up to depth upcoming timesteps in the background, 0 disables; max_bytes bounds the arrays in flight
+  void SetLoadRhoPhi(bool); // if false, only re and im are loaded and Rho()/Phi() are unavailable
+  void SetRegionOfInterest(const int lo[3], const int hi[3], int halo=1); // only load the nodes [lo, hi) and halo nodes around them, without the supercurrent; NULL loads the domain
+  bool HasRegionOfInterest() const {return _has_roi;}
   void WriteNetCDF(const std::string& filename, int slot=0);
   void WriteRaw(const std::string& prefix, int slot=0);
   void RotateTimeSteps();
@@ -24,7 +28,7 @@ public:
 
   void PrintInfo(int slot=0) const;
 
-  bool BuildDataFromArray(const GLHeader&, const float *rho, const float *phi, const float *re, const float *im);
+  bool BuildDataFromArray(const GLHeader&, const float *rho, const float *phi, const float *re, const float *im); // rho and phi are derived from re and im if NULL
   void GetDataArray(GLHeader& h, float **rho, float **phi, float **re, float **im, float **J, int slot=0);
   // float *GetSupercurrentDataArray() const {return _J[0];} // FIXME
   
@@ -83,6 +87,13 @@ protected:
   float *_Jx[2], *_Jy[2], *_Jz[2]; // supercurrent
 
   std::vector<std::string> _filenames; // filenames for different timesteps
+
+  bool _load_rho_phi;
+  int _roi[6]; // lo[3], hi[3] including the halo
+  bool _has_roi;
+  int _prefetch_depth, _prefetch_threads;
+  size_t _prefetch_bytes;
+  class GLGPUPrefetcher *_prefetcher; // created on first load
 };
 
 #endif
@@ -0,0 +1,198 @@
+#include "GLGPUPrefetcher.h"
+#include "GLGPU_IO_Helper.h"
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+
+GLGPUPrefetcher::GLGPUPrefetcher(const std::vector<std::string>& filenames, int depth, int nthreads, size_t max_bytes, bool supercurrent, bool rhophi, const int *box) :
+  _filenames(filenames),
+  _supercurrent(supercurrent),
+  _rhophi(rhophi),
+  _max_bytes(max_bytes),
+  _frame_bytes(0),
+  _has_box(box != NULL),
+  _seq(0),
+  _last_timestep(-1),
+  _quit(false)
+{
+  if (depth < 1) depth = 1;
+  if (nthreads < 1) nthreads = 1;
+  if (box) memcpy(_box, box, sizeof(_box));
+
+  _frames.resize(depth);
+  for (int i=0; i<depth; i++) {
+    Frame &f = _frames[i];
+    memset(&f, 0, sizeof(Frame));
+    f.timestep = -1;
+    f.state = FRAME_FREE;
+  }
+
+  for (int i=0; i<nthreads; i++)
+    _threads.push_back(std::thread(&GLGPUPrefetcher::worker, this));
+}
+
+GLGPUPrefetcher::~GLGPUPrefetcher()
+{
+  {
+    std::unique_lock<std::mutex> lock(_mutex);
+    _quit = true;
+  }
+  _cond_queued.notify_all();
+  for (size_t i=0; i<_threads.size(); i++)
+    _threads[i].join();
+
+  for (size_t i=0; i<_frames.size(); i++) {
+    Frame &f = _frames[i];
+    free(f.rho); free(f.phi); free(f.re); free(f.im);
+    free(f.Jx); free(f.Jy); free(f.Jz);
+  }
+}
+
+bool GLGPUPrefetcher::load(int timestep, GLHeader &h,
+    float **rho, float **phi, float **re, float **im, float **Jx, float **Jy, float **Jz) const
+{
+  const std::string &filename = _filenames[timestep];
+
+  // the supercurrent is always allocated anew
+  free(*Jx); free(*Jy); free(*Jz);
+  *Jx = *Jy = *Jz = NULL;
+
+  if (!_rhophi) rho = phi = NULL;
+
+  const int *box = _has_box ? _box : NULL;
+
+  h.dtype = DTYPE_BDAT;
+  if (GLGPU_IO_Helper_ReadBDAT(filename, h, rho, phi, re, im, Jx, Jy, Jz, false, _supercurrent, box))
+    return true;
+
+  h.dtype = DTYPE_CA02;
+  return GLGPU_IO_Helper_ReadLegacy(filename, h, rho, phi, re, im, Jx, Jy, Jz, false, _supercurrent, box);
+}
+
+size_t GLGPUPrefetcher::frame_bytes(const GLHeader &h) const
+{
+  const size_t n = (size_t)h.dims[0] * h.dims[1] * h.dims[2];
+  const int narrays = 2 + (_rhophi ? 2 : 0) + (_supercurrent && !_has_box ? 3 : 0); // no supercurrent for a box
+  return n * narrays * sizeof(float);
+}
+
+GLGPUPrefetcher::Frame* GLGPUPrefetcher::find(int timestep)
+{
+  for (size_t i=0; i<_frames.size(); i++)
+    if (_frames[i].state != FRAME_FREE && _frames[i].timestep == timestep)
+      return &_frames[i];
+  return NULL;
+}
+
+void GLGPUPrefetcher::worker()
+{
+  std::unique_lock<std::mutex> lock(_mutex);
+  while (1) {
+    Frame *f = NULL;
+    for (size_t i=0; i<_frames.size(); i++)
+      if (_frames[i].state == FRAME_QUEUED && (f == NULL || _frames[i].seq < f->seq))
+        f = &_frames[i];
+
+    if (f == NULL) {
+      if (_quit) return;
+      _cond_queued.wait(lock);
+      continue;
+    }
+
+    f->state = FRAME_LOADING;
+    lock.unlock();
+    const bool succ = load(f->timestep, f->h, &f->rho, &f->phi, &f->re, &f->im, &f->Jx, &f->Jy, &f->Jz);
+    lock.lock();
+    f->succ = succ;
+    f->state = FRAME_READY;
+    _cond_ready.notify_all();
+  }
+}
+
+void GLGPUPrefetcher::schedule(int timestep, int stride)
+{
+  const int depth = _frames.size();
+  
+  // frames of other timesteps than this and the next ones are dropped,
+  // unless they are being loaded
+  for (int i=0; i<depth; i++) {
+    Frame &f = _frames[i];
+    if (f.state == FRAME_FREE || f.state == FRAME_LOADING) continue;
+    if (f.timestep < timestep || (f.timestep - timestep) % stride != 0 
+        || (f.timestep - timestep) / stride > depth)
+      f.state = FRAME_FREE;
+  }
+
+  // frames allowed in flight; one until the size of a timestep is known
+  int nframes = depth;
+  if (_max_bytes > 0)
+    nframes = _frame_bytes > 0 ? std::max((size_t)1, std::min((size_t)depth, _max_bytes / _frame_bytes)) : 1;
+  int nbusy = 0;
+  for (int i=0; i<depth; i++)
+    if (_frames[i].state != FRAME_FREE) nbusy ++;
+
+  // queue the next timesteps
+  for (int k=1; k<=depth && nbusy<nframes; k++) {
+    const int t = timestep + k*stride;
+    if (t >= (int)_filenames.size()) break;
+    if (find(t) != NULL) continue;
+
+    Frame *f = NULL;
+    for (int i=0; i<depth; i++)
+      if (_frames[i].state == FRAME_FREE) {
+        f = &_frames[i];
+        break;
+      }
+    if (f == NULL) break;
+
+    f->timestep = t;
+    f->seq = ++_seq;
+    f->state = FRAME_QUEUED;
+    nbusy ++;
+  }
+  _cond_queued.notify_all();
+}
+
+bool GLGPUPrefetcher::Fetch(int timestep, GLHeader &h,
+    float **rho, float **phi, float **re, float **im, float **Jx, float **Jy, float **Jz)
+{
+  std::unique_lock<std::mutex> lock(_mutex);
+
+  const int stride = (_last_timestep >= 0 && timestep > _last_timestep) ? timestep - _last_timestep : 1;
+  _last_timestep = timestep;
+
+  Frame *frame = find(timestep);
+  if (frame == NULL) { // not prefetched, load with the caller's arrays
+    schedule(timestep, stride);
+    lock.unlock();
+    const bool succ = load(timestep, h, rho, phi, re, im, Jx, Jy, Jz);
+    if (succ && _frame_bytes == 0) {
+      lock.lock();
+      _frame_bytes = frame_bytes(h);
+      schedule(timestep, stride);
+    }
+    return succ;
+  }
+
+  if (frame->state == FRAME_QUEUED)
+    frame->seq = 0; // next to be loaded
+  schedule(timestep, stride);
+  while (frame->state != FRAME_READY)
+    _cond_ready.wait(lock);
+
+  // hand over the arrays, the caller's ones are reused
+  std::swap(h, frame->h);
+  std::swap(*rho, frame->rho);
+  std::swap(*phi, frame->phi);
+  std::swap(*re, frame->re);
+  std::swap(*im, frame->im);
+  std::swap(*Jx, frame->Jx);
+  std::swap(*Jy, frame->Jy);
+  std::swap(*Jz, frame->Jz);
+  frame->state = FRAME_FREE;
+  const bool succ = frame->succ;
+  if (succ) _frame_bytes = frame_bytes(h);
+
+  schedule(timestep, stride); // the freed frame takes the last timestep
+  return succ;
+}
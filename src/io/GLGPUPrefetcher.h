@@ -0,0 +1,61 @@
+#ifndef _GLGPUPREFETCHER_H
+#define _GLGPUPREFETCHER_H
+
+#include "GLHeader.h"
+#include <string>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+// decodes upcoming timesteps of a GLGPU file list on background threads
+// into a ring of buffers.  the arrays of a fetched timestep are exchanged
+// with the ones of the caller, which are reused for later timesteps.
+// max_bytes bounds the decoded arrays of the timesteps that are queued,
+// being loaded or ready; 0 only bounds them by depth.  box restricts the
+// reads to a sub-volume, see GLGPU_IO_Helper_ReadBDAT().
+class GLGPUPrefetcher {
+public:
+  GLGPUPrefetcher(const std::vector<std::string>& filenames, int depth, int nthreads=1, size_t max_bytes=0, bool supercurrent=false, bool rhophi=true, const int *box=NULL);
+  ~GLGPUPrefetcher();
+
+  // waits for the timestep (or loads it if not prefetched) and schedules the
+  // next depth timesteps, assuming the stride of the last two fetches
+  bool Fetch(int timestep, GLHeader &h,
+      float **rho, float **phi, float **re, float **im, float **Jx, float **Jy, float **Jz);
+
+private:
+  enum {FRAME_FREE, FRAME_QUEUED, FRAME_LOADING, FRAME_READY};
+  struct Frame {
+    int timestep, state;
+    unsigned long seq; // queue order
+    bool succ;
+    GLHeader h;
+    float *rho, *phi, *re, *im, *Jx, *Jy, *Jz;
+  };
+
+  bool load(int timestep, GLHeader &h,
+      float **rho, float **phi, float **re, float **im, float **Jx, float **Jy, float **Jz) const;
+  void worker();
+  void schedule(int timestep, int stride); // the caller holds the lock
+  Frame* find(int timestep);
+  size_t frame_bytes(const GLHeader &h) const;
+
+private:
+  const std::vector<std::string> _filenames;
+  const bool _supercurrent, _rhophi;
+  const size_t _max_bytes;
+  size_t _frame_bytes; // of the last fetched timestep, 0 if none yet
+  int _box[6];
+  bool _has_box;
+  std::vector<Frame> _frames;
+  std::vector<std::thread> _threads;
+
+  std::mutex _mutex;
+  std::condition_variable _cond_queued, _cond_ready;
+  unsigned long _seq;
+  int _last_timestep;
+  bool _quit;
+};
+
+#endif
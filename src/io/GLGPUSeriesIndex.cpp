@@ -0,0 +1,259 @@
+#include "GLGPUSeriesIndex.h"
+#include "GLGPU_IO_Helper.h"
+#include "BDATReader.h"
+#include "common/WorkerPool.h"
+#include <map>
+#include <cstdio>
+#include <cstring>
+#include <algorithm>
+#include <thread>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// file layout, native byte order:
+//   magic[8], version (u32), sizeof(GLHeader) (u32), number of entries (u64),
+//   per entry: path (u32 length + bytes), mtime in ns (i64), size (u64), GLHeader,
+//     number of records (u32), per record: name (u32 length + bytes),
+//     recID, recType, recNum, recLen (u32), offset (u64)
+static const char index_magic[8] = {'G', 'L', 'G', 'P', 'U', 'I', 'D', 'X'};
+static const uint32_t index_version = 2;
+
+namespace {
+  struct Cursor {
+    const char *p, *end;
+    template <typename T> bool get(T &v) {
+      if (end - p < (ptrdiff_t)sizeof(T)) return false;
+      memcpy(&v, p, sizeof(T));
+      p += sizeof(T);
+      return true;
+    }
+    bool get(std::string &s) {
+      uint32_t n;
+      if (!get(n) || end - p < (ptrdiff_t)n) return false;
+      s.assign(p, n);
+      p += n;
+      return true;
+    }
+  };
+
+  template <typename T> void put(std::string &buf, const T& v) {buf.append((const char*)&v, sizeof(T));}
+  void put(std::string &buf, const std::string& s) {
+    put(buf, (uint32_t)s.size());
+    buf.append(s);
+  }
+}
+
+static bool stat_file(const std::string& filename, int64_t &mtime, uint64_t &size)
+{
+  struct stat st;
+  if (stat(filename.c_str(), &st) != 0) return false;
+  mtime = (int64_t)st.st_mtim.tv_sec * 1000000000 + st.st_mtim.tv_nsec;
+  size = st.st_size;
+  return true;
+}
+
+const GLGPUSeriesIndex::Record* GLGPUSeriesIndex::Entry::FindRecord(const std::string& name) const
+{
+  for (size_t i=0; i<records.size(); i++)
+    if (records[i].name == name) return &records[i];
+  return NULL;
+}
+
+GLGPUSeriesIndex::GLGPUSeriesIndex() :
+  _nupdated(0)
+{
+}
+
+void GLGPUSeriesIndex::Clear()
+{
+  _entries.clear();
+  _nupdated = 0;
+}
+
+std::string GLGPUSeriesIndex::DefaultIndexFilename(const std::vector<std::string>& filenames)
+{
+  if (filenames.empty()) return std::string();
+  const std::string& f = filenames[0];
+  const size_t pos = f.find_last_of('/');
+  const std::string dir = pos == std::string::npos ? std::string() : f.substr(0, pos+1);
+
+  // fnv-1a of the list, so that different series in a directory do not
+  // share a sidecar
+  uint64_t hash = 14695981039346656037ULL;
+  for (size_t i=0; i<filenames.size(); i++)
+    for (size_t j=0; j<=filenames[i].size(); j++) { // including the terminating null
+      hash ^= (unsigned char)filenames[i].c_str()[j];
+      hash *= 1099511628211ULL;
+    }
+
+  char name[64];
+  snprintf(name, sizeof(name), ".glgpu_series.%016llx.idx", (unsigned long long)hash);
+  return dir + name;
+}
+
+bool GLGPUSeriesIndex::read_entry(Entry& e)
+{
+  e.records.clear();
+
+  BDATMappedReader reader(e.filename);
+  if (reader.Valid()) {
+    for (size_t i=0; i<reader.NumberOfRecords(); i++) {
+      const BDATMappedReader::Record& r = reader.GetRecord(i);
+      Record r1 = {r.name, r.recID, r.recType, r.recNum, r.recLen, r.offset};
+      e.records.push_back(r1);
+    }
+    if (GLGPU_IO_Helper_ReadBDAT(e.filename, e.h, NULL, NULL, NULL, NULL, NULL, NULL, NULL, true))
+      return true;
+    e.records.clear();
+  }
+  return GLGPU_IO_Helper_ReadLegacy(e.filename, e.h, NULL, NULL, NULL, NULL, NULL, NULL, NULL, true);
+}
+
+bool GLGPUSeriesIndex::Build(const std::vector<std::string>& filenames, const std::string& index_filename)
+{
+  std::vector<Entry> old_entries;
+  const bool loaded = !index_filename.empty() && load(index_filename, old_entries);
+
+  std::map<std::string, size_t> old_map;
+  for (size_t i=0; i<old_entries.size(); i++)
+    old_map[old_entries[i].filename] = i;
+
+  // reuse the entries whose data files are unchanged
+  _entries.clear();
+  _entries.resize(filenames.size());
+  std::vector<size_t> stale;
+  size_t ninvalid = 0;
+  for (size_t i=0; i<filenames.size(); i++) {
+    Entry &e = _entries[i];
+    e.filename = filenames[i];
+    e.valid = stat_file(e.filename, e.mtime, e.size);
+    if (!e.valid) {
+      e.mtime = e.size = 0;
+      memset(&e.h, 0, sizeof(GLHeader));
+      ninvalid ++;
+      continue;
+    }
+
+    std::map<std::string, size_t>::iterator it = old_map.find(e.filename);
+    if (it != old_map.end() && old_entries[it->second].mtime == e.mtime && old_entries[it->second].size == e.size) {
+      e.h = old_entries[it->second].h;
+      e.records.swap(old_entries[it->second].records);
+    } else
+      stale.push_back(i);
+  }
+
+  // read the headers of the others; latency bound, so use a few threads
+  std::vector<char> succ(stale.size(), 0);
+  if (stale.size() > 1) {
+    WorkerPool pool(std::min(16, std::max(2, (int)std::thread::hardware_concurrency())));
+    pool.ParallelFor(stale.size(), 1, [&](int, size_t i0, size_t i1) {
+      for (size_t j=i0; j<i1; j++)
+        succ[j] = read_entry(_entries[stale[j]]);
+    });
+  } else if (stale.size() == 1)
+    succ[0] = read_entry(_entries[stale[0]]);
+
+  for (size_t j=0; j<stale.size(); j++)
+    if (!succ[j]) {
+      Entry &e = _entries[stale[j]];
+      e.valid = false;
+      e.records.clear();
+      memset(&e.h, 0, sizeof(GLHeader));
+      ninvalid ++;
+    }
+  _nupdated = stale.size();
+
+  const bool changed = !loaded || !stale.empty() || old_entries.size() != _entries.size() - ninvalid;
+  if (!index_filename.empty() && changed && !save(index_filename))
+    fprintf(stderr, "cannot write series index: %s\n", index_filename.c_str());
+
+  return ninvalid == 0;
+}
+
+bool GLGPUSeriesIndex::load(const std::string& index_filename, std::vector<Entry>& entries) const
+{
+  FILE *fp = fopen(index_filename.c_str(), "rb");
+  if (!fp) return false;
+
+  std::string buf;
+  char chunk[65536];
+  size_t n;
+  while ((n = fread(chunk, 1, sizeof(chunk), fp)) > 0)
+    buf.append(chunk, n);
+  fclose(fp);
+
+  Cursor c = {buf.data(), buf.data() + buf.size()};
+  char magic[8];
+  uint32_t version, header_size;
+  uint64_t nentries;
+  if (!c.get(magic) || memcmp(magic, index_magic, 8) != 0) return false;
+  if (!c.get(version) || version != index_version) return false;
+  if (!c.get(header_size) || header_size != sizeof(GLHeader)) return false;
+  if (!c.get(nentries) || nentries > buf.size()) return false;
+
+  entries.resize(nentries);
+  for (uint64_t i=0; i<nentries; i++) {
+    Entry &e = entries[i];
+    e.valid = true;
+    uint32_t nrecords;
+    if (!c.get(e.filename) || !c.get(e.mtime) || !c.get(e.size) || !c.get(e.h) || !c.get(nrecords) || nrecords > buf.size()) {
+      entries.clear();
+      return false;
+    }
+    e.records.resize(nrecords);
+    for (uint32_t j=0; j<nrecords; j++) {
+      Record &r = e.records[j];
+      if (!c.get(r.name) || !c.get(r.recID) || !c.get(r.recType) || !c.get(r.recNum) || !c.get(r.recLen) || !c.get(r.offset)) {
+        entries.clear();
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+bool GLGPUSeriesIndex::save(const std::string& index_filename) const
+{
+  std::string buf;
+  buf.append(index_magic, 8);
+  put(buf, index_version);
+  put(buf, (uint32_t)sizeof(GLHeader));
+  uint64_t nvalid = 0;
+  for (size_t i=0; i<_entries.size(); i++)
+    if (_entries[i].valid) nvalid ++;
+
+  put(buf, nvalid);
+  for (size_t i=0; i<_entries.size(); i++) {
+    const Entry &e = _entries[i];
+    if (!e.valid) continue;
+    put(buf, e.filename);
+    put(buf, e.mtime);
+    put(buf, e.size);
+    put(buf, e.h);
+    put(buf, (uint32_t)e.records.size());
+    for (size_t j=0; j<e.records.size(); j++) {
+      const Record &r = e.records[j];
+      put(buf, r.name);
+      put(buf, r.recID);
+      put(buf, r.recType);
+      put(buf, r.recNum);
+      put(buf, r.recLen);
+      put(buf, r.offset);
+    }
+  }
+
+  // written aside and renamed, so that concurrent readers never see a
+  // partial index
+  char suffix[32];
+  snprintf(suffix, sizeof(suffix), ".%d.tmp", (int)getpid());
+  const std::string tmp_filename = index_filename + suffix;
+
+  FILE *fp = fopen(tmp_filename.c_str(), "wb");
+  if (!fp) return false;
+  const bool succ = fwrite(buf.data(), 1, buf.size(), fp) == buf.size();
+  if (fclose(fp) != 0 || !succ || rename(tmp_filename.c_str(), index_filename.c_str()) != 0) {
+    unlink(tmp_filename.c_str());
+    return false;
+  }
+  return true;
+}
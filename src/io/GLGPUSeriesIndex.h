@@ -0,0 +1,60 @@
+#ifndef _GLGPUSERIESINDEX_H
+#define _GLGPUSERIESINDEX_H
+
+#include "GLHeader.h"
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+// headers and record offsets of all files of a GLGPU timestep series, kept
+// in a sidecar file so that opening a series does not read every data file.
+// an entry is valid as long as mtime and size of its data file are unchanged;
+// only new or changed files are read again.  files that cannot be read are
+// kept as invalid entries and tried again on the next Build().
+class GLGPUSeriesIndex {
+public:
+  struct Record { // of a BDAT file, legacy files have none
+    std::string name;
+    unsigned int recID, recType, recNum, recLen;
+    uint64_t offset; // of the data in the file
+  };
+
+  struct Entry {
+    std::string filename;
+    bool valid; // false if the file cannot be read
+    int64_t mtime; // ns
+    uint64_t size;
+    GLHeader h;
+    std::vector<Record> records;
+
+    const Record* FindRecord(const std::string& name) const; //!< NULL if not found
+  };
+
+  GLGPUSeriesIndex();
+
+  // loads the index file, brings it up to date with the data files and
+  // writes it back if anything changed.  no sidecar is used if
+  // index_filename is empty, and failing to write it is not an error.
+  // returns false if any data file cannot be read.
+  bool Build(const std::vector<std::string>& filenames, const std::string& index_filename);
+  void Clear();
+
+  size_t NumberOfEntries() const {return _entries.size();}
+  const Entry& GetEntry(size_t i) const {return _entries[i];}
+  const GLHeader& Header(size_t i) const {return _entries[i].h;}
+  size_t NumberOfUpdatedEntries() const {return _nupdated;} //!< data files read by the last Build()
+
+  static std::string DefaultIndexFilename(const std::string& list_filename) {return list_filename + ".idx";}
+  static std::string DefaultIndexFilename(const std::vector<std::string>& filenames); //!< in the directory of the first file, named by a hash of the list
+
+private:
+  bool load(const std::string& index_filename, std::vector<Entry>& entries) const;
+  bool save(const std::string& index_filename) const;
+  static bool read_entry(Entry& e);
+
+private:
+  std::vector<Entry> _entries;
+  size_t _nupdated;
+};
+
+#endif
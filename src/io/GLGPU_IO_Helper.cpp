@@ -1,11 +1,13 @@
 #include "def.h"
 #include "GLGPU_IO_Helper.h"
+#include "PsiKernel.h"
 #include "glpp/GL_post_process.h"
 #include <cmath>
 #include <cassert>
 #include <cstdio>
 #include <cstdlib>
 #include <cstring>
+#include <algorithm>
 
 #if WITH_LIBMESH || WITH_NETCDF
 #include <netcdf.h>
@@ -24,64 +26,88 @@ enum {
 static const int GLGPU_LEGACY_TAG_SIZE = 4;
 static const char GLGPU_LEGACY_TAG[] = "CA02";
 
+// clips box to the domain of h and turns h into the header of the box, lo
+// being the index of its first node
+static bool crop_header(GLHeader &h, const int *box, int lo[3])
+{
+  for (int i=0; i<3; i++) {
+    const int l = std::max(0, box[i]), u = std::min(h.dims[i], box[3+i]);
+    if (u <= l) return false;
+    lo[i] = l;
+    if (u - l < h.dims[i]) h.pbc[i] = false;
+    h.origins[i] += l * h.cell_lengths[i];
+    h.dims[i] = u - l;
+  }
+  return true;
+}
+
+// calls f(src, dst, n) for the contiguous runs of n nodes of the box lo+[0,
+// dims) of a grid d; src and dst are node offsets in the grid and the box
+template <typename F>
+static void box_runs(const int d[3], const int lo[3], const int dims[3], F f)
+{
+  size_t run = dims[0];
+  int nj = dims[1], nk = dims[2];
+  if (dims[0] == d[0]) {
+    run *= dims[1]; nj = 1;
+    if (dims[1] == d[1]) {run *= dims[2]; nk = 1;}
+  }
+
+  size_t dst = 0;
+  for (int k=0; k<nk; k++) 
+    for (int j=0; j<nj; j++) {
+      const size_t src = lo[0] + (size_t)d[0] * ((lo[1] + j) + (size_t)d[1] * (lo[2] + k));
+      f(src, dst, run);
+      dst += run;
+    }
+}
+
 bool GLGPU_IO_Helper_ReadBDAT(
     const std::string& filename, 
     GLHeader &h,
     float **rho, float **phi, float **re, float **im, float **Jx, float **Jy, float **Jz,
-    bool header_only, bool supercurrent)
+    bool header_only, bool supercurrent, const int *box)
 {
-  BDATReader *reader = new BDATReader(filename); 
-  if (!reader->Valid()) {
-    delete reader;
+  BDATMappedReader reader(filename); 
+  if (!reader.Valid()) 
     return false;
-  }
 
-  std::string name, buf;
-  while (1) {
-    name = reader->ReadNextRecordInfo();
-    if (name.size()==0) break;
-    
-    unsigned int type = reader->RecType(), 
-                 recID = reader->RedID(); 
-    float f; // temp var
+  const BDATMappedReader::Record *psi = NULL;
+
+  for (size_t k=0; k<reader.NumberOfRecords(); k++) {
+    const BDATMappedReader::Record &r = reader.GetRecord(k);
+    const std::string &name = r.name;
+    unsigned int type = r.recType; 
 
-    if (name != "psi")
-      reader->ReadNextRecordData(&buf);
-    else if (!header_only)
-      reader->ReadNextRecordData(&buf);
-    else break;
-    void *p = (void*)buf.data();
+    if (name == "psi" && header_only) break;
+    if (r.Size() < 4) continue;
 
     if (name == "dim") {
       assert(type == BDAT_INT32);
-      memcpy(&h.ndims, p, sizeof(int));
+      h.ndims = reader.Value<int>(r);
       h.dims[0] = h.dims[1] = h.dims[2] = 1;
       assert(h.ndims == 2 || h.ndims == 3);
     } else if (name == "Nx") {
       assert(type == BDAT_INT32);
-      memcpy(&h.dims[0], p, sizeof(int));
+      h.dims[0] = reader.Value<int>(r);
     } else if (name == "Ny") {
       assert(type == BDAT_INT32);
-      memcpy(&h.dims[1], p, sizeof(int));
+      h.dims[1] = reader.Value<int>(r);
     } else if (name == "Nz") {
       assert(type == BDAT_INT32);
-      memcpy(&h.dims[2], p, sizeof(int));
+      h.dims[2] = reader.Value<int>(r);
     } else if (name == "Lx") {
       assert(type == BDAT_FLOAT);
-      memcpy(&f, p, sizeof(float));
-      h.lengths[0] = f;
+      h.lengths[0] = reader.Value<float>(r);
     } else if (name == "Ly") {
       assert(type == BDAT_FLOAT);
-      memcpy(&f, p, sizeof(float));
-      h.lengths[1] = f;
+      h.lengths[1] = reader.Value<float>(r);
     } else if (name == "Lz") {
       assert(type == BDAT_FLOAT);
-      memcpy(&f, p, sizeof(float));
-      h.lengths[2] = f;
+      h.lengths[2] = reader.Value<float>(r);
     } else if (name == "BC") {
       assert(type == BDAT_INT32);
-      int btype; 
-      memcpy(&btype, p, sizeof(int));
+      int btype = reader.Value<int>(r); 
       h.pbc[0] = ((btype & 0x0000ff) == 0x01);
       h.pbc[1] = ((btype & 0x00ff00) == 0x0100);
       h.pbc[2] = ((btype & 0xff0000) == 0x010000); 
@@ -89,73 +115,32 @@ bool GLGPU_IO_Helper_ReadBDAT(
       // TODO
     } else if (name == "zaniso") {
       assert(type == BDAT_FLOAT);
-      memcpy(&f, p, sizeof(float));
-      // h.zaniso = p;
+      // h.zaniso = reader.Value<float>(r);
     } else if (name == "t") {
       assert(type == BDAT_FLOAT);
-      memcpy(&f, p, sizeof(float));
-      h.time = f;
+      h.time = reader.Value<float>(r);
     } else if (name == "Tf") {
       assert(type == BDAT_FLOAT);
     } else if (name == "Bx") {
       assert(type == BDAT_FLOAT);
-      memcpy(&f, p, sizeof(float));
-      h.B[0] = f;
+      h.B[0] = reader.Value<float>(r);
     } else if (name == "By") {
       assert(type == BDAT_FLOAT);
-      memcpy(&f, p, sizeof(float));
-      h.B[1] = f;
+      h.B[1] = reader.Value<float>(r);
     } else if (name == "Bz") {
       assert(type == BDAT_FLOAT);
-      memcpy(&f, p, sizeof(float));
-      h.B[2] = f;
+      h.B[2] = reader.Value<float>(r);
     } else if (name == "Jxext") {
       assert(type == BDAT_FLOAT);
-      memcpy(&f, p, sizeof(float));
-      h.Jxext = f;
+      h.Jxext = reader.Value<float>(r);
     } else if (name == "K") {
       assert(type == BDAT_FLOAT);
-      memcpy(&f, p, sizeof(float));
-      h.Kex = f;
+      h.Kex = reader.Value<float>(r);
     } else if (name == "V") {
       assert(type == BDAT_FLOAT);
-      memcpy(&f, p, sizeof(float));
-      h.V = f;
+      h.V = reader.Value<float>(r);
     } else if (name == "psi" && !header_only) {
-      if (type == BDAT_FLOAT) {
-        int count = buf.size()/sizeof(float)/2;
-        int optype = recID == 2000 ? 0 : 1;
-        float *data = (float*)p;
-
-        *rho = (float*)malloc(sizeof(float)*count);
-        *phi = (float*)malloc(sizeof(float)*count);
-        *re = (float*)malloc(sizeof(float)*count);
-        *im = (float*)malloc(sizeof(float)*count);
-
-        if (optype == 0) { // re, im
-#pragma omp parallel for
-          for (int i=0; i<count; i++) {
-            const float R = data[i*2], I = data[i*2+1];
-            (*rho)[i] = sqrt(R*R + I*I);
-            (*phi)[i] = atan2(I, R);
-            (*re)[i] = R;
-            (*im)[i] = I;
-          }
-        } else { // rho^2, phi
-#pragma omp parallel for
-          for (int i=0; i<count; i++) {
-            const float Rho = sqrt(data[i*2]), Phi = data[i*2+1];
-            (*rho)[i] = Rho; 
-            (*phi)[i] = Phi;
-            (*re)[i] = Rho * cos(Phi);
-            (*im)[i] = Rho * sin(Phi);
-          }
-        }
-      } else if (type == BDAT_DOUBLE) {
-        // TODO
-        assert(false);
-      } else 
-        assert(false);
+      psi = &r; // decoded once the header is complete
     }
   }
   
@@ -167,10 +152,61 @@ bool GLGPU_IO_Helper_ReadBDAT(
       h.cell_lengths[i] = h.lengths[i] / (h.dims[i] - 1);
   }
 
-  if (supercurrent)
+  const int d[3] = {h.dims[0], h.dims[1], h.dims[2]};
+  int lo[3] = {0, 0, 0};
+  if (box && !crop_header(h, box, lo))
+    return false;
+
+  if (header_only) 
+    return true;
+  else if (psi == NULL) 
+    return false; // no field, e.g. a truncated file
+  else {
+    const BDATMappedReader::Record &r = *psi;
+    if (r.recType == BDAT_FLOAT) {
+      // the fields are derived straight from the mapping, which is not
+      // necessarily aligned.  of a box, only the pages of its rows are
+      // touched.
+      const size_t elem_size = sizeof(float)*2;
+      int count = r.Size()/elem_size;
+      int optype = r.recID == 2000 ? 0 : 1;
+      const void *data = reader.RecordData(r);
+      char *buf = NULL;
+
+      if ((size_t)d[0]*d[1]*d[2] > (size_t)count) return false;
+      if (box) {
+        const char *src = (const char*)data;
+        count = h.dims[0] * h.dims[1] * h.dims[2];
+        buf = (char*)malloc(elem_size*count);
+        box_runs(d, lo, h.dims, [=](size_t i, size_t j, size_t n) {
+          memcpy(buf + j*elem_size, src + i*elem_size, n*elem_size);
+        });
+        data = buf;
+      } else 
+        reader.WillNeed(r);
+
+      const bool rhophi = rho != NULL && phi != NULL;
+      if (rhophi) {
+        *rho = (float*)realloc(*rho, sizeof(float)*count);
+        *phi = (float*)realloc(*phi, sizeof(float)*count);
+      }
+      *re = (float*)realloc(*re, sizeof(float)*count);
+      *im = (float*)realloc(*im, sizeof(float)*count);
+
+      if (optype == 0) // re, im
+        psi_kernel_from_reim(count, data, *re, *im, 
+            rhophi ? *rho : NULL, rhophi ? *phi : NULL);
+      else // rho^2, phi
+        psi_kernel_from_rhophi(count, data, true, 
+            rhophi ? *rho : NULL, rhophi ? *phi : NULL, *re, *im);
+      free(buf);
+    } else // TODO: BDAT_DOUBLE
+      return false;
+  }
+
+  if (supercurrent && !box) // needs the whole domain, Jx/Jy/Jz stay NULL for a box
     GLGPU_IO_Helper_ComputeSupercurrent(h, *re, *im, Jx, Jy, Jz);
 
-  delete reader;
   return true;
 }
 
@@ -178,7 +214,7 @@ bool GLGPU_IO_Helper_ReadLegacy(
     const std::string& filename, 
     GLHeader& h,
     float **rho, float **phi, float **re, float **im, float **Jx, float **Jy, float **Jz,
-    bool header_only, bool supercurrent)
+    bool header_only, bool supercurrent, const int *box)
 {
   FILE *fp = fopen(filename.c_str(), "rb");
   if (!fp) return false;
@@ -274,6 +310,13 @@ bool GLGPU_IO_Helper_ReadLegacy(
     fread(&h.Kex, sizeof(float), 1, fp);
     fread(&Kex_dot, sizeof(float), 1, fp); 
   }
+
+  const int d[3] = {h.dims[0], h.dims[1], h.dims[2]};
+  int lo[3] = {0, 0, 0};
+  if (box && !crop_header(h, box, lo)) {
+    fclose(fp);
+    return false;
+  }
  
   if (header_only) {
     fclose(fp);
@@ -285,45 +328,42 @@ bool GLGPU_IO_Helper_ReadLegacy(
   for (int i=0; i<h.ndims; i++) 
     count *= h.dims[i]; 
 
-  int offset = ftell(fp);
+  long offset = ftell(fp);
 
-  // mem allocation 
-  *rho = (float*)malloc(sizeof(float)*count);
-  *phi = (float*)malloc(sizeof(float)*count);
-  *re = (float*)malloc(sizeof(float)*count);
-  *im = (float*)malloc(sizeof(float)*count);
+  // mem allocation, arrays are reused if given
+  const bool rhophi = rho != NULL && phi != NULL;
+  if (rhophi) {
+    *rho = (float*)realloc(*rho, sizeof(float)*count);
+    *phi = (float*)realloc(*phi, sizeof(float)*count);
+  }
+  *re = (float*)realloc(*re, sizeof(float)*count);
+  *im = (float*)realloc(*im, sizeof(float)*count);
 
   if (datatype == GLGPU_TYPE_FLOAT) {
     // raw data
     float *buf = (float*)malloc(sizeof(float)*count*2); // complex numbers
-    fread(buf, sizeof(float), count*2, fp);
+    if (box) { // seek to the rows of the box
+      const size_t elem_size = sizeof(float)*2;
+      box_runs(d, lo, h.dims, [=](size_t i, size_t j, size_t n) {
+        fseek(fp, offset + i*elem_size, SEEK_SET);
+        fread(buf + j*2, elem_size, n, fp);
+      });
+    } else 
+      fread(buf, sizeof(float), count*2, fp);
     
-    if (optype == 0) { // re, im
-#pragma omp parallel for
-      for (int i=0; i<count; i++) {
-        const float R = buf[i*2], I = buf[i*2+1]; 
-        (*rho)[i] = sqrt(R*R + I*I);
-        (*phi)[i] = atan2(I, R);
-        (*re)[i] = R;
-        (*im)[i] = I;
-      }
-    } else { // rho, phi
-#pragma omp parallel for
-      for (int i=0; i<count; i++) {
-        const float Rho = buf[i*2], Phi = buf[i*2+1];
-        (*rho)[i] = Rho; 
-        (*phi)[i] = Phi;
-        (*re)[i] = Rho * cos(Phi);
-        (*im)[i] = Rho * sin(Phi);
-      }
-    }
+    if (optype == 0) // re, im
+      psi_kernel_from_reim(count, buf, *re, *im, 
+          rhophi ? *rho : NULL, rhophi ? *phi : NULL);
+    else // rho, phi
+      psi_kernel_from_rhophi(count, buf, false, 
+          rhophi ? *rho : NULL, rhophi ? *phi : NULL, *re, *im);
 
     free(buf);
   } else if (datatype == GLGPU_TYPE_DOUBLE) {
     assert(false);
   }
   
-  if (supercurrent)
+  if (supercurrent && !box) // needs the whole domain, Jx/Jy/Jz stay NULL for a box
     GLGPU_IO_Helper_ComputeSupercurrent(h, *re, *im, Jx, Jy, Jz);
 
   fclose(fp);
@@ -365,18 +405,23 @@ bool GLGPU_IO_Helper_WriteNetCDF(
   NC_SAFE_CALL( nc_def_var(ncid, "phi", NC_FLOAT, 3, dimids, &varids[1]) );
   NC_SAFE_CALL( nc_def_var(ncid, "re", NC_FLOAT, 3, dimids, &varids[2]) );
   NC_SAFE_CALL( nc_def_var(ncid, "im", NC_FLOAT, 3, dimids, &varids[3]) );
-  NC_SAFE_CALL( nc_def_var(ncid, "Jx", NC_FLOAT, 3, dimids, &varids[4]) );
-  NC_SAFE_CALL( nc_def_var(ncid, "Jy", NC_FLOAT, 3, dimids, &varids[5]) );
-  NC_SAFE_CALL( nc_def_var(ncid, "Jz", NC_FLOAT, 3, dimids, &varids[6]) );
+  const bool has_J = Jx != NULL && Jy != NULL && Jz != NULL; // not computed for a region of interest
+  if (has_J) {
+    NC_SAFE_CALL( nc_def_var(ncid, "Jx", NC_FLOAT, 3, dimids, &varids[4]) );
+    NC_SAFE_CALL( nc_def_var(ncid, "Jy", NC_FLOAT, 3, dimids, &varids[5]) );
+    NC_SAFE_CALL( nc_def_var(ncid, "Jz", NC_FLOAT, 3, dimids, &varids[6]) );
+  }
   NC_SAFE_CALL( nc_enddef(ncid) );
 
   NC_SAFE_CALL( nc_put_vara_float(ncid, varids[0], starts, sizes, rho) ); 
   NC_SAFE_CALL( nc_put_vara_float(ncid, varids[1], starts, sizes, phi) ); 
   NC_SAFE_CALL( nc_put_vara_float(ncid, varids[2], starts, sizes, re) ); 
   NC_SAFE_CALL( nc_put_vara_float(ncid, varids[3], starts, sizes, im) ); 
-  NC_SAFE_CALL( nc_put_vara_float(ncid, varids[4], starts, sizes, Jx) ); 
-  NC_SAFE_CALL( nc_put_vara_float(ncid, varids[5], starts, sizes, Jy) ); 
-  NC_SAFE_CALL( nc_put_vara_float(ncid, varids[6], starts, sizes, Jz) ); 
+  if (has_J) {
+    NC_SAFE_CALL( nc_put_vara_float(ncid, varids[4], starts, sizes, Jx) ); 
+    NC_SAFE_CALL( nc_put_vara_float(ncid, varids[5], starts, sizes, Jy) ); 
+    NC_SAFE_CALL( nc_put_vara_float(ncid, varids[6], starts, sizes, Jz) ); 
+  }
 
   NC_SAFE_CALL( nc_close(ncid) );
 
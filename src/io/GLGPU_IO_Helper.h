@@ -4,17 +4,26 @@
 #include "GLHeader.h"
 #include "BDATReader.h"
 
+// rho, phi, re and im are reallocated, i.e. existing arrays are reused.
+// rho and phi may be NULL if only re and im are needed.
+//
+// box, if given, is a sub-volume {lo[3], hi[3]} in node indices (hi
+// exclusive), clipped to the domain.  only the nodes of the box are read and
+// decoded; dims and origins of hdr are those of the box, so that positions
+// stay global, and lengths stay those of the domain.  reading fails if the
+// box does not intersect the domain.  the supercurrent is not computed for a
+// box, its gauge needs the indices of the domain.
 bool GLGPU_IO_Helper_ReadBDAT(
     const std::string& filename, 
     GLHeader &hdr,
     float **rho, float **phi, float **re, float **im, float **Jx, float **Jy, float **Jz,
-    bool header_only=false, bool supercurrent=false);
+    bool header_only=false, bool supercurrent=false, const int *box=NULL);
 
 bool GLGPU_IO_Helper_ReadLegacy(
     const std::string& filename, 
     GLHeader &hdr, 
     float **rho, float **phi, float **re, float **im, float **Jx, float **Jy, float **Jz,
-    bool header_only=false, bool supercurrent=false);
+    bool header_only=false, bool supercurrent=false, const int *box=NULL);
 
 void GLGPU_IO_Helper_ComputeSupercurrent(
     GLHeader &h, const float *re, const float *im, float **Jx, float **Jy, float **Jz);
@@ -0,0 +1,329 @@
+#include "PsiKernel.h"
+#include "common/WorkerPool.h"
+#include <cmath>
+#include <cstring>
+#include <mutex>
+#include <thread>
+#include <functional>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define PSI_KERNEL_AVX2 1
+#include <immintrin.h>
+#endif
+
+// the vector code does the same float operations in the same order as the
+// scalar code, so both give identical results.  no fma.
+
+// pi, pi/2 and pi/4 as a float plus a correction
+static const float pi_hi = 3.14159274101257324e+0f, pi_lo = -8.74227766e-8f,
+                   pio2_hi = 1.57079637050628662e+0f, pio2_lo = -4.37113883e-8f,
+                   pio4_hi = 7.85398185253143311e-1f, pio4_lo = -2.18556941e-8f,
+                   tan_pio8 = 4.14213562e-1f;
+
+// atan on [-tan(pi/8), tan(pi/8)] (cephes atanf)
+static const float at0 = 8.05374449538e-2f, at1 = -1.38776856032e-1f,
+                   at2 = 1.99777106478e-1f, at3 = -3.33329491539e-1f;
+
+// sin and cos on [-pi/4, pi/4] (cephes sinf/cosf).  the reduction by
+// multiples y of pi/4 subtracts pi/4 in four parts, the first three of 12
+// bits, so that the products are exact for y < 2^12 and results near the
+// zeros keep their relative accuracy.
+static const float fopi = 1.27323954473516f, // 4/pi
+                   dp1 = 7.8515625e-1f, dp2 = 2.4187564849853516e-4f, 
+                   dp3 = 3.7747668102383614e-8f, dp4 = 1.2816720341285448e-12f,
+                   sn0 = -1.9515295891e-4f, sn1 = 8.3321608736e-3f, sn2 = -1.6666654611e-1f,
+                   cs0 = 2.443315711809948e-5f, cs1 = -1.388731625493765e-3f, cs2 = 4.166664568298827e-2f;
+
+static const size_t chunk_size = 16384;
+
+float psi_kernel_atan2f(float y, float x)
+{
+  const float ax = fabsf(x), ay = fabsf(y);
+  const bool swap = ay > ax;
+  const float num = swap ? ax : ay, den = swap ? ay : ax;
+  const float a = den > 0 ? num / den : 0.f; // [0, 1]
+  const bool big = a > tan_pio8; // atan(a) = pi/4 + atan((a-1)/(a+1))
+  const float t = big ? (a - 1.f) / (a + 1.f) : a;
+  const float z = t * t;
+  float p = at0 * z;
+  p = p + at1; p = p * z;
+  p = p + at2; p = p * z;
+  p = p + at3; p = p * z;
+  p = p * t;
+  float r = p + t;
+  if (big) r = pio4_hi + (r + pio4_lo);
+  if (swap) r = (pio2_hi - r) + pio2_lo;
+  if (std::signbit(x)) r = (pi_hi - r) + pi_lo;
+  return copysignf(r, y);
+}
+
+void psi_kernel_sincosf(float x, float *s, float *c)
+{
+  const float ax = fabsf(x);
+  if (!(ax <= psi_kernel_sincos_max)) {
+    *s = sinf(x);
+    *c = cosf(x);
+    return;
+  }
+
+  int j = (int)(ax * fopi);
+  j = j + (j & 1);
+  const float y = (float)j;
+  const float r = (((ax - y * dp1) - y * dp2) - y * dp3) - y * dp4;
+  const float z = r * r;
+
+  float p = sn0 * z;
+  p = p + sn1; p = p * z;
+  p = p + sn2; p = p * z;
+  p = p * r;
+  const float ps = p + r;
+
+  float q = cs0 * z;
+  q = q + cs1; q = q * z;
+  q = q + cs2; q = q * z;
+  q = q * z;
+  q = q - 0.5f * z;
+  const float pc = q + 1.f;
+
+  const int k = (j >> 1) & 3; // quadrant
+  float sv = (k & 1) ? pc : ps,
+        cv = (k & 1) ? ps : pc;
+  if (k & 2) sv = -sv;
+  if ((k + 1) & 2) cv = -cv;
+  if (std::signbit(x)) sv = -sv;
+  *s = sv;
+  *c = cv;
+}
+
+static inline void store(float *p, size_t i, float v)
+{
+  if (p) p[i] = v;
+}
+
+static void from_reim_scalar(size_t i0, size_t i1, const char *src, size_t stride, const char *src_im,
+    float *re, float *im, float *rho, float *phi)
+{
+  for (size_t i=i0; i<i1; i++) {
+    float R, I;
+    memcpy(&R, src + i*stride, sizeof(float));
+    memcpy(&I, src_im + i*stride, sizeof(float));
+    store(re, i, R);
+    store(im, i, I);
+    store(rho, i, sqrtf(R*R + I*I));
+    if (phi) phi[i] = psi_kernel_atan2f(I, R);
+  }
+}
+
+static void from_rhophi_scalar(size_t i0, size_t i1, const char *src, bool squared,
+    float *rho, float *phi, float *re, float *im)
+{
+  for (size_t i=i0; i<i1; i++) {
+    float v[2], s, c;
+    memcpy(v, src + i*sizeof(v), sizeof(v));
+    const float Rho = squared ? sqrtf(v[0]) : v[0], Phi = v[1];
+    store(rho, i, Rho);
+    store(phi, i, Phi);
+    psi_kernel_sincosf(Phi, &s, &c);
+    store(re, i, Rho * c);
+    store(im, i, Rho * s);
+  }
+}
+
+#if PSI_KERNEL_AVX2
+static bool avx2_supported()
+{
+  static const bool supported = __builtin_cpu_supports("avx2");
+  return supported;
+}
+
+__attribute__((target("avx2")))
+static inline __m256 atan2_avx2(__m256 y, __m256 x)
+{
+  const __m256 sign = _mm256_set1_ps(-0.f),
+               one = _mm256_set1_ps(1.f);
+  const __m256 ax = _mm256_andnot_ps(sign, x), ay = _mm256_andnot_ps(sign, y);
+  const __m256 swap = _mm256_cmp_ps(ay, ax, _CMP_GT_OQ);
+  const __m256 num = _mm256_blendv_ps(ay, ax, swap), den = _mm256_blendv_ps(ax, ay, swap);
+  const __m256 a = _mm256_and_ps(_mm256_div_ps(num, den),
+      _mm256_cmp_ps(den, _mm256_setzero_ps(), _CMP_GT_OQ));
+  const __m256 big = _mm256_cmp_ps(a, _mm256_set1_ps(tan_pio8), _CMP_GT_OQ);
+  const __m256 t = _mm256_blendv_ps(a, _mm256_div_ps(_mm256_sub_ps(a, one), _mm256_add_ps(a, one)), big);
+  const __m256 z = _mm256_mul_ps(t, t);
+  __m256 p = _mm256_mul_ps(_mm256_set1_ps(at0), z);
+  p = _mm256_mul_ps(_mm256_add_ps(p, _mm256_set1_ps(at1)), z);
+  p = _mm256_mul_ps(_mm256_add_ps(p, _mm256_set1_ps(at2)), z);
+  p = _mm256_mul_ps(_mm256_add_ps(p, _mm256_set1_ps(at3)), z);
+  p = _mm256_mul_ps(p, t);
+  __m256 r = _mm256_add_ps(p, t);
+  r = _mm256_blendv_ps(r, _mm256_add_ps(_mm256_set1_ps(pio4_hi), _mm256_add_ps(r, _mm256_set1_ps(pio4_lo))), big);
+  r = _mm256_blendv_ps(r, _mm256_add_ps(_mm256_sub_ps(_mm256_set1_ps(pio2_hi), r), _mm256_set1_ps(pio2_lo)), swap);
+  r = _mm256_blendv_ps(r, _mm256_add_ps(_mm256_sub_ps(_mm256_set1_ps(pi_hi), r), _mm256_set1_ps(pi_lo)), x); // sign of x
+  return _mm256_or_ps(_mm256_andnot_ps(sign, r), _mm256_and_ps(sign, y));
+}
+
+// false if any lane is out of the range of the polynomials
+__attribute__((target("avx2")))
+static inline bool sincos_avx2(__m256 x, __m256 &s, __m256 &c)
+{
+  const __m256 sign = _mm256_set1_ps(-0.f);
+  const __m256 ax = _mm256_andnot_ps(sign, x);
+  if (_mm256_movemask_ps(_mm256_cmp_ps(ax, _mm256_set1_ps(psi_kernel_sincos_max), _CMP_NLE_UQ)))
+    return false;
+
+  __m256i j = _mm256_cvttps_epi32(_mm256_mul_ps(ax, _mm256_set1_ps(fopi)));
+  j = _mm256_add_epi32(j, _mm256_and_si256(j, _mm256_set1_epi32(1)));
+  const __m256 y = _mm256_cvtepi32_ps(j);
+  __m256 r = _mm256_sub_ps(ax, _mm256_mul_ps(y, _mm256_set1_ps(dp1)));
+  r = _mm256_sub_ps(r, _mm256_mul_ps(y, _mm256_set1_ps(dp2)));
+  r = _mm256_sub_ps(r, _mm256_mul_ps(y, _mm256_set1_ps(dp3)));
+  r = _mm256_sub_ps(r, _mm256_mul_ps(y, _mm256_set1_ps(dp4)));
+  const __m256 z = _mm256_mul_ps(r, r);
+
+  __m256 p = _mm256_mul_ps(_mm256_set1_ps(sn0), z);
+  p = _mm256_mul_ps(_mm256_add_ps(p, _mm256_set1_ps(sn1)), z);
+  p = _mm256_mul_ps(_mm256_add_ps(p, _mm256_set1_ps(sn2)), z);
+  p = _mm256_mul_ps(p, r);
+  const __m256 ps = _mm256_add_ps(p, r);
+
+  __m256 q = _mm256_mul_ps(_mm256_set1_ps(cs0), z);
+  q = _mm256_mul_ps(_mm256_add_ps(q, _mm256_set1_ps(cs1)), z);
+  q = _mm256_mul_ps(_mm256_add_ps(q, _mm256_set1_ps(cs2)), z);
+  q = _mm256_mul_ps(q, z);
+  q = _mm256_sub_ps(q, _mm256_mul_ps(_mm256_set1_ps(0.5f), z));
+  const __m256 pc = _mm256_add_ps(q, _mm256_set1_ps(1.f));
+
+  const __m256i k = _mm256_and_si256(_mm256_srli_epi32(j, 1), _mm256_set1_epi32(3));
+  const __m256 odd = _mm256_castsi256_ps(_mm256_cmpeq_epi32(
+        _mm256_and_si256(k, _mm256_set1_epi32(1)), _mm256_set1_epi32(1)));
+  const __m256 sv = _mm256_blendv_ps(ps, pc, odd),
+               cv = _mm256_blendv_ps(pc, ps, odd);
+  const __m256 ssign = _mm256_xor_ps(_mm256_castsi256_ps(_mm256_slli_epi32(_mm256_and_si256(k, _mm256_set1_epi32(2)), 30)),
+                                     _mm256_and_ps(sign, x)),
+               csign = _mm256_castsi256_ps(_mm256_slli_epi32(
+                   _mm256_and_si256(_mm256_add_epi32(k, _mm256_set1_epi32(1)), _mm256_set1_epi32(2)), 30));
+  s = _mm256_xor_ps(sv, ssign);
+  c = _mm256_xor_ps(cv, csign);
+  return true;
+}
+
+__attribute__((target("avx2")))
+static inline void store_avx2(float *p, size_t i, __m256 v)
+{
+  if (p) _mm256_storeu_ps(p + i, v);
+}
+
+// 8 (a, b) pairs to a and b
+__attribute__((target("avx2")))
+static inline void load_pairs_avx2(const char *src, __m256 &a, __m256 &b)
+{
+  const __m256 v0 = _mm256_loadu_ps((const float*)src),
+               v1 = _mm256_loadu_ps((const float*)src + 8);
+  a = _mm256_castpd_ps(_mm256_permute4x64_pd(_mm256_castps_pd(_mm256_shuffle_ps(v0, v1, 0x88)), 0xD8));
+  b = _mm256_castpd_ps(_mm256_permute4x64_pd(_mm256_castps_pd(_mm256_shuffle_ps(v0, v1, 0xDD)), 0xD8));
+}
+
+__attribute__((target("avx2")))
+static size_t from_reim_avx2(size_t i0, size_t i1, const char *src, bool interleaved, const char *src_im,
+    float *re, float *im, float *rho, float *phi)
+{
+  size_t i = i0;
+  for (; i+8<=i1; i+=8) {
+    __m256 R, I;
+    if (interleaved)
+      load_pairs_avx2(src + i*2*sizeof(float), R, I);
+    else {
+      R = _mm256_loadu_ps((const float*)src + i);
+      I = _mm256_loadu_ps((const float*)src_im + i);
+    }
+    store_avx2(re, i, R);
+    store_avx2(im, i, I);
+    store_avx2(rho, i, _mm256_sqrt_ps(_mm256_add_ps(_mm256_mul_ps(R, R), _mm256_mul_ps(I, I))));
+    if (phi) store_avx2(phi, i, atan2_avx2(I, R));
+  }
+  return i;
+}
+
+__attribute__((target("avx2")))
+static size_t from_rhophi_avx2(size_t i0, size_t i1, const char *src, bool squared,
+    float *rho, float *phi, float *re, float *im)
+{
+  size_t i = i0;
+  for (; i+8<=i1; i+=8) {
+    __m256 Rho, Phi, s, c;
+    load_pairs_avx2(src + i*2*sizeof(float), Rho, Phi);
+    if (squared) Rho = _mm256_sqrt_ps(Rho);
+    if (!sincos_avx2(Phi, s, c)) {
+      from_rhophi_scalar(i, i+8, src, squared, rho, phi, re, im);
+      continue;
+    }
+    store_avx2(rho, i, Rho);
+    store_avx2(phi, i, Phi);
+    store_avx2(re, i, _mm256_mul_ps(Rho, c));
+    store_avx2(im, i, _mm256_mul_ps(Rho, s));
+  }
+  return i;
+}
+#endif
+
+// runs f(i0, i1) on chunks of [0, n).  the pool is shared by all datasets;
+// if it is busy, e.g. with a timestep being prefetched, the caller does all
+// the work.
+static void parallel_for(size_t n, const std::function<void(size_t, size_t)>& f)
+{
+  static std::mutex mutex;
+  static WorkerPool *pool = NULL; // never destroyed
+
+  if (n <= chunk_size) {
+    f(0, n);
+    return;
+  }
+
+  std::unique_lock<std::mutex> lock(mutex, std::try_to_lock);
+  if (!lock.owns_lock()) {
+    f(0, n);
+    return;
+  }
+
+  if (pool == NULL)
+    pool = new WorkerPool(std::thread::hardware_concurrency());
+  pool->ParallelFor(n, chunk_size, [&f](int, size_t i0, size_t i1) {f(i0, i1);});
+}
+
+static void from_reim(size_t n, const char *src, bool interleaved, const char *src_im,
+    float *re, float *im, float *rho, float *phi)
+{
+  parallel_for(n, [=](size_t i0, size_t i1) {
+    size_t i = i0;
+#if PSI_KERNEL_AVX2
+    if (avx2_supported())
+      i = from_reim_avx2(i0, i1, src, interleaved, src_im, re, im, rho, phi);
+#endif
+    from_reim_scalar(i, i1, src, interleaved ? 2*sizeof(float) : sizeof(float), src_im, re, im, rho, phi);
+  });
+}
+
+void psi_kernel_from_reim(size_t n, const void *src,
+    float *re, float *im, float *rho, float *phi)
+{
+  const char *p = (const char*)src;
+  from_reim(n, p, true, p + sizeof(float), re, im, rho, phi);
+}
+
+void psi_kernel_rhophi(size_t n, const float *re, const float *im, float *rho, float *phi)
+{
+  from_reim(n, (const char*)re, false, (const char*)im, NULL, NULL, rho, phi);
+}
+
+void psi_kernel_from_rhophi(size_t n, const void *src, bool squared,
+    float *rho, float *phi, float *re, float *im)
+{
+  const char *p = (const char*)src;
+  parallel_for(n, [=](size_t i0, size_t i1) {
+    size_t i = i0;
+#if PSI_KERNEL_AVX2
+    if (avx2_supported())
+      i = from_rhophi_avx2(i0, i1, p, squared, rho, phi, re, im);
+#endif
+    from_rhophi_scalar(i, i1, p, squared, rho, phi, re, im);
+  });
+}
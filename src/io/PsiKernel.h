@@ -0,0 +1,32 @@
+#ifndef _PSIKERNEL_H
+#define _PSIKERNEL_H
+
+#include <cstddef>
+
+// conversions between the re/im and rho/phi representations of psi at load
+// time.  loops run on a shared worker pool and use AVX2 if available at
+// runtime.  atan2 and sincos are float polynomials; the scalar and vector
+// paths give identical results, within the bounds below of libm (atan2f,
+// sinf, cosf).  rho is sqrtf(re*re + im*im), correctly rounded.  inputs are
+// assumed to be finite.
+static const int psi_kernel_atan2_max_ulp = 3,
+                 psi_kernel_sincos_max_ulp = 2; // |phi| <= psi_kernel_sincos_max, libm beyond
+static const float psi_kernel_sincos_max = 2048.f;
+
+// psi as interleaved (re, im) pairs, src need not be aligned.  outputs that
+// are NULL are not computed.
+void psi_kernel_from_reim(size_t n, const void *src,
+    float *re, float *im, float *rho, float *phi);
+
+// psi as interleaved (rho, phi) pairs, or (rho^2, phi) if squared
+void psi_kernel_from_rhophi(size_t n, const void *src, bool squared,
+    float *rho, float *phi, float *re, float *im);
+
+// rho and phi from separate re and im arrays
+void psi_kernel_rhophi(size_t n, const float *re, const float *im, float *rho, float *phi);
+
+// scalar versions of the polynomials, for the checks
+float psi_kernel_atan2f(float y, float x);
+void psi_kernel_sincosf(float x, float *s, float *c);
+
+#endif
@@ -11,6 +11,7 @@
 #include "vtkStreamingDemandDrivenPipeline.h"
 #include "vtkBDATSeriesReader.h"
 #include "io/GLGPU_IO_Helper.h"
+#include "io/GLGPUSeriesIndex.h"
 #include <assert.h>
 
 vtkStandardNewMacro(vtkBDATSeriesReader);
@@ -64,28 +65,23 @@ int vtkBDATSeriesReader::RequestInformation(
   TimeSteps.clear();
   TimeStepsMap.clear();
 
-  GLHeader h;
+  GLGPUSeriesIndex index;
+  index.Build(FileNames, GLGPUSeriesIndex::DefaultIndexFilename(FileNames));
 
+  bool first = true;
   for (int fidx=0; fidx<nfiles; fidx++) {
-    bool succ = false;
-    if (!succ) {
-      succ = GLGPU_IO_Helper_ReadBDAT(
-          FileNames[fidx], h, NULL, NULL, NULL, NULL, NULL, NULL, NULL, true);
-    } 
-    if (!succ) {
-      succ = GLGPU_IO_Helper_ReadLegacy(
-          FileNames[fidx], h, NULL, NULL, NULL, NULL, NULL, NULL, NULL, true);
-    }
-    if (!succ) {
-      fprintf(stderr, "cannot open file: %s\n", FileNames[fidx].c_str());
-      assert(false); // TODO
+    if (!index.GetEntry(fidx).valid) {
+      vtkWarningMacro(<< "Skipping unreadable file " << FileNames[fidx]);
+      continue;
     }
+    const GLHeader &h = index.Header(fidx);
 
     TimeSteps.push_back(h.time);
     TimeStepsMap[h.time] = fidx;
     // fprintf(stderr, "fidx=%d, time=%f\n", fidx, time);
  
-    if (fidx == 0) {
+    if (first) {
+      first = false;
       int ext[6] = {0, h.dims[0]-1, 0, h.dims[1]-1, 0, h.dims[2]-1};
       double cell_lengths[3] = {h.cell_lengths[0], h.cell_lengths[1], h.cell_lengths[2]},
              origins[3] = {h.origins[0], h.origins[1], h.origins[2]};
@@ -97,6 +93,11 @@ int vtkBDATSeriesReader::RequestInformation(
     }
   }
 
+  if (TimeSteps.empty()) {
+    vtkErrorMacro("Error opening file series");
+    return 0;
+  }
+
   outInfo->Set(vtkStreamingDemandDrivenPipeline::TIME_STEPS(), 
       &TimeSteps[0], static_cast<int>(TimeSteps.size()));
 
@@ -0,0 +1,184 @@
+#include "io/GLGPU3DDataset.h"
+#include "extractor/Extractor.h"
+#include <atomic>
+#include <new>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <unistd.h>
+
+// counts the heap allocations of each stage of the extraction loop on a
+// synthetic series of moving vortex lines and a ring.  the buffers grow with
+// the largest frame seen, so the series is run twice; fails if the face,
+// space, edge or rotate stages allocate in the second pass
+
+static std::atomic<size_t> n_alloc(0);
+
+void* operator new(size_t n)
+{
+  n_alloc.fetch_add(1, std::memory_order_relaxed);
+  void *p = malloc(n ? n : 1);
+  if (!p) throw std::bad_alloc();
+  return p;
+}
+
+void operator delete(void *p) noexcept {free(p);}
+void operator delete(void *p, size_t) noexcept {free(p);}
+
+static size_t allocs_since(size_t &a0)
+{
+  const size_t a1 = n_alloc.load(std::memory_order_relaxed), n = a1 - a0;
+  a0 = a1;
+  return n;
+}
+
+static void write_record(FILE *fp, const char *name, unsigned int id, unsigned int type, unsigned int num, unsigned int len, const void *data)
+{
+  const unsigned int IDlen = (id << 8) | (unsigned int)strlen(name);
+  fwrite(&IDlen, 4, 1, fp);
+  fwrite(name, 1, strlen(name), fp);
+  fwrite(&type, 4, 1, fp);
+  fwrite(&num, 4, 1, fp);
+  fwrite(&len, 4, 1, fp);
+  fwrite(data, len, num, fp);
+}
+
+static void write_int(FILE *fp, const char *name, int v) {write_record(fp, name, 0, 0x400, 1, 4, &v);}
+static void write_float(FILE *fp, const char *name, float v) {write_record(fp, name, 0, 0x402, 1, 4, &v);}
+
+// three lines along z that drift in x and y, and a ring that shrinks
+static bool write_frame(const std::string& filename, int n, int t)
+{
+  FILE *fp = fopen(filename.c_str(), "wb");
+  if (!fp) return false;
+
+  const float L = n * 0.5f, s = t * 0.35f;
+  fwrite("BDAT", 1, 4, fp);
+  const unsigned int BOM = 0x01020304;
+  fwrite(&BOM, 4, 1, fp);
+  write_int(fp, "dim", 3);
+  write_int(fp, "Nx", n);
+  write_int(fp, "Ny", n);
+  write_int(fp, "Nz", n);
+  write_float(fp, "Lx", L);
+  write_float(fp, "Ly", L);
+  write_float(fp, "Lz", L);
+  write_int(fp, "BC", 0);
+  write_float(fp, "t", t * 0.1f);
+  write_float(fp, "Bx", 0.f);
+  write_float(fp, "By", 0.f);
+  write_float(fp, "Bz", 0.01f);
+  write_float(fp, "Jxext", 0.f);
+  write_float(fp, "K", 0.f);
+  write_float(fp, "V", 0.f);
+
+  const float lines[3][5] = { // x0, y0, slope x, slope y, charge
+    {-0.25f, -0.2f, 0.05f, 0.02f, 1},
+    {0.2f, 0.25f, -0.03f, 0.04f, 1},
+    {0.3f, -0.3f, 0.f, -0.06f, -1}};
+  std::vector<float> psi((size_t)n*n*n*2);
+  for (int k=0; k<n; k++)
+    for (int j=0; j<n; j++)
+      for (int i=0; i<n; i++) {
+        const float x = -L/2 + i*L/(n-1), y = -L/2 + j*L/(n-1), z = -L/2 + k*L/(n-1);
+        float phi = 0, rho = 1;
+        for (int l=0; l<3; l++) {
+          const float x0 = lines[l][0]*L + lines[l][2]*z + (lines[l][4] > 0 ? s*0.5f : -s*0.4f),
+                      y0 = lines[l][1]*L + lines[l][3]*z + 0.1f*s;
+          phi += lines[l][4] * atan2f(y-y0, x-x0);
+          rho *= tanhf(sqrtf((x-x0)*(x-x0) + (y-y0)*(y-y0)));
+        }
+        const float R = std::max(0.5f, L*0.15f - s*0.6f),
+                    rc = sqrtf((x-0.1f*L)*(x-0.1f*L) + (y+0.05f*L)*(y+0.05f*L)), dz = z - 0.2f*L;
+        phi += atan2f(dz, rc-R) - atan2f(dz, rc+R);
+        rho *= tanhf(sqrtf((rc-R)*(rc-R) + dz*dz));
+
+        const size_t id = i + n*(j + (size_t)n*k);
+        psi[id*2] = rho * cosf(phi);
+        psi[id*2+1] = rho * sinf(phi);
+      }
+  write_record(fp, "psi", 2000, 0x402, psi.size(), 4, psi.data());
+  return fclose(fp) == 0;
+}
+
+static bool run(const std::string& list_filename, int T, bool tet)
+{
+  GLGPU3DDataset ds;
+  if (!ds.OpenDataFile(list_filename)) return false;
+  ds.LoadTimeStep(0, 0);
+  ds.SetMeshType(tet ? GLGPU3D_MESH_TET : GLGPU3D_MESH_HEX);
+  ds.BuildMeshGraph();
+
+  VortexExtractor extractor;
+  extractor.SetDataset(&ds);
+  extractor.SetNumberOfThreads(2);
+
+  bool succ = true;
+  for (int pass=0; pass<2; pass++) {
+    extractor.Clear();
+    if (!ds.LoadTimeStep(0, 0)) return false;
+    extractor.ExtractFaces(0);
+    extractor.TraceOverSpace(0);
+
+    for (int t=1; t<T; t++) {
+      size_t a0 = n_alloc, a[6];
+      if (!ds.LoadTimeStep(t, 1)) return false;
+      a[0] = allocs_since(a0);
+      extractor.ExtractFaces(1);
+      a[1] = allocs_since(a0);
+      extractor.TraceOverSpace(1);
+      a[2] = allocs_since(a0);
+      extractor.ExtractEdges();
+      a[3] = allocs_since(a0);
+      extractor.TraceOverTime();
+      a[4] = allocs_since(a0);
+      extractor.RotateTimeSteps();
+      ds.RotateTimeSteps();
+      a[5] = allocs_since(a0);
+      fprintf(stdout, "%s pass=%d, t=%d, n_alloc: load=%zu, faces=%zu, space=%zu, edges=%zu, time=%zu, rotate=%zu\n",
+          tet ? "tet" : "hex", pass, t, a[0], a[1], a[2], a[3], a[4], a[5]);
+
+      // loading and the transition matrix, which is returned per frame, allocate
+      if (pass > 0 && a[1] + a[2] + a[3] + a[5] > 0)
+        succ = false;
+    }
+  }
+  return succ;
+}
+
+int main(int argc, char **argv)
+{
+  const int n = argc > 1 ? atoi(argv[1]) : 24,
+            T = argc > 2 ? atoi(argv[2]) : 8;
+
+  char dir[] = "/tmp/test_allocs.XXXXXX";
+  if (!mkdtemp(dir)) return EXIT_FAILURE;
+
+  std::vector<std::string> filenames;
+  const std::string list_filename = std::string(dir) + "/series.list";
+  FILE *fp = fopen(list_filename.c_str(), "w");
+  bool succ = fp != NULL;
+  for (int t=0; succ && t<T; t++) {
+    char filename[64];
+    snprintf(filename, sizeof(filename), "/frame_%04d.bdat", t);
+    filenames.push_back(dir + std::string(filename));
+    succ = write_frame(filenames.back(), n, t);
+    fprintf(fp, "%s\n", filenames.back().c_str());
+  }
+  if (fp) fclose(fp);
+
+  succ = succ && run(list_filename, T, false);
+  succ = succ && run(list_filename, T, true);
+
+  for (size_t i=0; i<filenames.size(); i++)
+    unlink(filenames[i].c_str());
+  unlink(list_filename.c_str());
+  rmdir(dir);
+
+  fprintf(stdout, succ ? "passed\n" : "FAILED\n");
+  return succ ? EXIT_SUCCESS : EXIT_FAILURE;
+}
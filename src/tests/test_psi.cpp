@@ -0,0 +1,87 @@
+#include "io/PsiKernel.h"
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+#include <stdint.h>
+
+// checks the psi conversion kernels against libm (double precision,
+// rounded to float) and the vector path against the scalar one
+
+static int64_t ordered(float x)
+{
+  int32_t i;
+  memcpy(&i, &x, sizeof(i));
+  return i < 0 ? (int64_t)INT32_MIN - i : i;
+}
+
+static int64_t ulps(float a, float b)
+{
+  return llabs(ordered(a) - ordered(b));
+}
+
+static float rand_float(float lo, float hi)
+{
+  return lo + (hi - lo) * (float)rand() / RAND_MAX;
+}
+
+int main(int argc, char **argv)
+{
+  const size_t n = argc > 1 ? atol(argv[1]) : 1<<22;
+  bool succ = true;
+
+  // re/im of all magnitudes and signs, and the axes and diagonals
+  std::vector<float> reim(2*n), re(n), im(n), rho(n), phi(n);
+  for (size_t i=0; i<n; i++) {
+    const float s = powf(10.f, rand_float(-20.f, 20.f));
+    reim[2*i] = rand_float(-1.f, 1.f) * s;
+    reim[2*i+1] = rand_float(-1.f, 1.f) * s;
+    if (i % 16 == 0) reim[2*i] = 0;
+    else if (i % 16 == 1) reim[2*i+1] = 0;
+    else if (i % 16 == 2) reim[2*i+1] = reim[2*i];
+    else if (i % 16 == 3) reim[2*i+1] = -reim[2*i];
+  }
+  psi_kernel_from_reim(n, reim.data(), re.data(), im.data(), rho.data(), phi.data());
+
+  int64_t max_atan2 = 0, max_rho = 0;
+  size_t nmismatch = 0;
+  for (size_t i=0; i<n; i++) {
+    const float R = reim[2*i], I = reim[2*i+1];
+    if (re[i] != R || im[i] != I) nmismatch ++;
+    if (phi[i] != psi_kernel_atan2f(I, R)) nmismatch ++;
+    max_atan2 = std::max(max_atan2, ulps(phi[i], (float)atan2((double)I, (double)R)));
+    max_rho = std::max(max_rho, ulps(rho[i], sqrtf(R*R + I*I)));
+  }
+
+  // phases over the whole polynomial range, dense around multiples of pi/2
+  std::vector<float> rhophi(2*n);
+  for (size_t i=0; i<n; i++) {
+    float x;
+    if (i % 2) x = rand_float(-psi_kernel_sincos_max, psi_kernel_sincos_max);
+    else x = (float)((rand() % 2600 - 1300) * M_PI/2) + rand_float(-1e-3f, 1e-3f);
+    rhophi[2*i] = rand_float(0.f, 2.f);
+    rhophi[2*i+1] = x;
+  }
+  psi_kernel_from_rhophi(n, rhophi.data(), false, rho.data(), phi.data(), re.data(), im.data());
+
+  int64_t max_sincos = 0;
+  for (size_t i=0; i<n; i++) {
+    const float x = rhophi[2*i+1];
+    float s, c;
+    psi_kernel_sincosf(x, &s, &c);
+    if (re[i] != rhophi[2*i] * c || im[i] != rhophi[2*i] * s) nmismatch ++;
+    max_sincos = std::max(max_sincos, ulps(s, (float)sin((double)x)));
+    max_sincos = std::max(max_sincos, ulps(c, (float)cos((double)x)));
+  }
+
+  fprintf(stderr, "n=%zu, max_ulp_atan2=%lld (bound %d), max_ulp_sincos=%lld (bound %d), max_ulp_rho=%lld, vector/scalar mismatches=%zu\n",
+      n, (long long)max_atan2, psi_kernel_atan2_max_ulp, (long long)max_sincos, psi_kernel_sincos_max_ulp, 
+      (long long)max_rho, nmismatch);
+
+  succ = max_atan2 <= psi_kernel_atan2_max_ulp 
+      && max_sincos <= psi_kernel_sincos_max_ulp 
+      && max_rho == 0 && nmismatch == 0;
+  fprintf(stderr, succ ? "PASSED\n" : "FAILED\n");
+  return succ ? 0 : 1;
+}